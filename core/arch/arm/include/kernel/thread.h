@@ -87,14 +87,25 @@ struct thread_vector_table {
 };
 extern struct thread_vector_table thread_vector_table;
 
+/* Number of size classes in the FS RPC payload cache, see tee_fs_rpc.h */
+#define THREAD_RPC_FS_NUM_PAYLOAD	3
+
+struct thread_rpc_fs_payload {
+	void *va;
+	struct mobj *mobj;
+	uint64_t cookie;
+	size_t size;
+};
+
 struct thread_specific_data {
 	TAILQ_HEAD(, tee_ta_session) sess_stack;
 	struct tee_ta_ctx *ctx;
 	struct pgt_cache pgt_cache;
-	void *rpc_fs_payload;
-	struct mobj *rpc_fs_payload_mobj;
-	uint64_t rpc_fs_payload_cookie;
-	size_t rpc_fs_payload_size;
+	struct thread_rpc_fs_payload rpc_fs_payload[THREAD_RPC_FS_NUM_PAYLOAD];
+	/* Allocation size for the largest size class */
+	size_t rpc_fs_payload_hwm;
+	/* Largest request in the largest size class since last clear */
+	size_t rpc_fs_payload_peak;
 };
 
 struct thread_user_vfp_state {
@@ -651,6 +662,23 @@ uint32_t thread_rpc_cmd(uint32_t cmd, size_t num_params,
 unsigned long thread_smc(unsigned long func_id, unsigned long a1,
 			 unsigned long a2, unsigned long a3);
 
+/*
+ * Statistics on the thread pool
+ */
+struct thread_stats {
+	size_t max_threads;	/* number of threads, CFG_NUM_THREADS */
+	size_t active;		/* number of threads currently allocated */
+	size_t max_active;	/* highest number of threads allocated */
+	size_t limit_hits;	/* number of calls rejected, no free thread */
+	size_t stacks;		/* number of threads which have a stack */
+};
+
+/*
+ * Returns the statistics on the thread pool, max_active and limit_hits
+ * are reset.
+ */
+void thread_get_stats(struct thread_stats *stats);
+
 #endif /*ASM*/
 
 #endif /*KERNEL_THREAD_H*/
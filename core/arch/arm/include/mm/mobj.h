@@ -119,6 +119,20 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie);
 
+/*
+ * Statistics on mobj_reg_shm_find_by_cookie(), @ticks and @max_ticks are
+ * in units of the system counter (CNTPCT) and include the time spent
+ * waiting for the lock.
+ */
+struct mobj_reg_shm_stats {
+	size_t lookups;
+	size_t probes;		/* Number of objects compared */
+	uint64_t ticks;		/* Accumulated lookup time */
+	uint64_t max_ticks;	/* Longest single lookup */
+};
+
+void mobj_reg_shm_get_stats(struct mobj_reg_shm_stats *stats);
+
 TEE_Result mobj_reg_shm_map(struct mobj *mobj);
 TEE_Result mobj_reg_shm_unmap(struct mobj *mobj);
 
@@ -144,4 +158,33 @@ static inline bool mobj_is_paged(struct mobj *mobj __unused)
 
 struct mobj *mobj_seccpy_shm_alloc(size_t size);
 
+#ifdef CFG_DEMAND_ZERO_USER_TA
+/*
+ * mobj_dz_alloc() - Allocate a demand-zero mobj from TA RAM
+ * @size:	size of the mobj
+ * @init_size:	size of the initial part which is allocated immediately
+ *
+ * Pages beyond @init_size are allocated and zeroed by mobj_dz_get_page()
+ * on first access. mobj_get_pa() returns TEE_ERROR_NO_DATA for a page
+ * which hasn't been allocated yet.
+ */
+struct mobj *mobj_dz_alloc(size_t size, size_t init_size);
+
+/*
+ * mobj_dz_get_page() - Get the physical page at an offset in a demand-zero
+ * mobj, the page is allocated and zeroed if needed
+ * @mobj:	demand-zero mobj
+ * @offs:	offset into the mobj
+ * @pa:		physical address of the page holding @offs
+ */
+TEE_Result mobj_dz_get_page(struct mobj *mobj, size_t offs, paddr_t *pa);
+
+bool mobj_is_dz(struct mobj *mobj);
+#else
+static inline bool mobj_is_dz(struct mobj *mobj __unused)
+{
+	return false;
+}
+#endif
+
 #endif /*__MM_MOBJ_H*/
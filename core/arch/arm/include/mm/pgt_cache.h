@@ -20,9 +20,11 @@
 
 struct pgt {
 	void *tbl;
-#if defined(CFG_PAGED_USER_TA)
+#if defined(CFG_PAGED_USER_TA) || !defined(CFG_WITH_PAGER)
 	vaddr_t vabase;
 	struct tee_ta_ctx *ctx;
+#endif
+#if defined(CFG_PAGED_USER_TA)
 	size_t num_used_entries;
 #endif
 #if defined(CFG_WITH_PAGER)
@@ -33,13 +35,27 @@ struct pgt {
 	SLIST_ENTRY(pgt) link;
 };
 
+/*
+ * Page tables needed by one user TA context. Each thread can have a
+ * context mapped, so the pool holds at least this many per thread or
+ * threads could end up waiting for each other's tables.
+ */
+#define PGT_CACHE_MIN_PER_THREAD	2
+
 /*
  * Reserve 2 page tables per thread, but at least 4 page tables in total
+ * unless configured otherwise
  */
-#if CFG_NUM_THREADS < 2
+#if defined(CFG_PGT_CACHE_ENTRIES)
+#if CFG_PGT_CACHE_ENTRIES < CFG_NUM_THREADS * PGT_CACHE_MIN_PER_THREAD
+#error CFG_PGT_CACHE_ENTRIES must be at least 2 * CFG_NUM_THREADS
+#endif
+#define PGT_CACHE_SIZE	ROUNDUP(CFG_PGT_CACHE_ENTRIES, PGT_NUM_PGT_PER_PAGE)
+#elif CFG_NUM_THREADS < 2
 #define PGT_CACHE_SIZE	4
 #else
-#define PGT_CACHE_SIZE	ROUNDUP(CFG_NUM_THREADS * 2, PGT_NUM_PGT_PER_PAGE)
+#define PGT_CACHE_SIZE	ROUNDUP(CFG_NUM_THREADS * PGT_CACHE_MIN_PER_THREAD, \
+				PGT_NUM_PGT_PER_PAGE)
 #endif
 
 SLIST_HEAD(pgt_cache, pgt);
@@ -49,7 +65,13 @@ static inline bool pgt_check_avail(size_t num_tbls)
 	return num_tbls <= PGT_CACHE_SIZE;
 }
 
-void pgt_alloc(struct pgt_cache *pgt_cache, void *owning_ctx,
+/*
+ * Allocates the tables covering [begin, last] for @owning_ctx. Returns
+ * true if any of the tables isn't the one which was used at the same
+ * address by @owning_ctx the last time, that is, if the TLB may hold
+ * entries of @owning_ctx which refer to another table.
+ */
+bool pgt_alloc(struct pgt_cache *pgt_cache, void *owning_ctx,
 	       vaddr_t begin, vaddr_t last);
 void pgt_free(struct pgt_cache *pgt_cache, bool save_ctx);
 
@@ -70,6 +92,18 @@ void pgt_transfer(struct pgt_cache *pgt_cache, void *old_ctx, vaddr_t old_va,
 
 void pgt_init(void);
 
+struct pgt_cache_stats {
+	size_t hits;		/* Tables found cached with their content */
+	size_t misses;		/* Tables which had to be populated again */
+	size_t evictions;	/* Cached tables taken over by someone else */
+};
+
+/*
+ * pgt_get_stats() - Get and reset the page table cache statistics
+ * @stats:	Receives the counters accumulated since last call
+ */
+void pgt_get_stats(struct pgt_cache_stats *stats);
+
 #if defined(CFG_PAGED_USER_TA)
 void pgt_flush_ctx(struct tee_ta_ctx *ctx);
 
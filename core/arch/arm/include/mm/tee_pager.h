@@ -98,6 +98,23 @@ void tee_pager_init(tee_mm_entry_t *mm_alias);
 void tee_pager_add_core_area(vaddr_t base, size_t size, uint32_t flags,
 			     const void *store, const void *hashes);
 
+/*
+ * tee_pager_init_uta_areas() - Initializes an empty list of user ta areas
+ * @utc:	user ta context without areas
+ *
+ * The list is otherwise initialized by the first tee_pager_add_uta_area().
+ *
+ * Return true on success of false if out of memory
+ */
+#ifdef CFG_PAGED_USER_TA
+bool tee_pager_init_uta_areas(struct user_ta_ctx *utc);
+#else
+static inline bool tee_pager_init_uta_areas(struct user_ta_ctx *utc __unused)
+{
+	return true;
+}
+#endif
+
 /*
  * tee_pager_add_uta_area() - Adds a pageable user ta area
  * @utc:	user ta context of the area
@@ -245,6 +262,14 @@ struct tee_pager_stats {
 	size_t zi_released;
 	size_t npages;		/* number of load pages */
 	size_t npages_all;	/* number of pages */
+	size_t faults;		/* number of faults handled by the pager */
+	uint64_t ticks;		/* counter ticks since last read */
+	size_t lock_count;	/* number of times the pager lock was taken */
+	uint64_t lock_wait_ticks; /* counter ticks spent waiting for the lock */
+	uint64_t lock_hold_ticks; /* counter ticks the lock was held */
+	size_t unlocked_loads;	/* pages loaded without holding the lock */
+	size_t reserve_refills;	/* refills of the per-CPU page reserves */
+	size_t fault_around;	/* pages loaded by fault-around, not hits */
 };
 
 #ifdef CFG_WITH_PAGER
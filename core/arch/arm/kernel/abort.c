@@ -13,6 +13,7 @@
 #include <kernel/user_ta.h>
 #include <mm/core_mmu.h>
 #include <mm/mobj.h>
+#include <mm/tee_mmu.h>
 #include <mm/tee_pager.h>
 #include <tee/tee_svc.h>
 #include <trace.h>
@@ -578,7 +579,7 @@ static enum fault_type get_fault_type(struct abort_info *ai)
 	if (abort_is_user_exception(ai)) {
 		if (is_vfp_fault(ai))
 			return FAULT_TYPE_USER_TA_VFP;
-#ifndef CFG_WITH_PAGER
+#if !defined(CFG_WITH_PAGER) && !defined(CFG_DEMAND_ZERO_USER_TA)
 		return FAULT_TYPE_USER_TA_PANIC;
 #endif
 	}
@@ -658,6 +659,8 @@ void abort_handler(uint32_t abort_type, struct thread_abort_regs *regs)
 	default:
 		thread_kernel_save_vfp();
 		handled = tee_pager_handle_fault(&ai);
+		if (!handled)
+			handled = tee_mmu_handle_dz_fault(&ai);
 		thread_kernel_restore_vfp();
 		if (!handled) {
 			abort_print_error(&ai);
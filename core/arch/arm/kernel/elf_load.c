@@ -7,6 +7,7 @@
 #include <tee_api_defines.h>
 #include <kernel/tee_misc.h>
 #include <kernel/user_ta.h>
+#include <mm/core_mmu.h>
 #include <stdlib.h>
 #include <string.h>
 #include <util.h>
@@ -32,6 +33,7 @@ struct elf_load_state {
 	void *phdr;
 
 	size_t vasize;
+	size_t init_size;
 	void *shdr;
 };
 
@@ -319,6 +321,23 @@ static TEE_Result load_head(struct elf_load_state *state, size_t head_size)
 	if (ADD_OVERFLOW(phdr.p_vaddr, phdr.p_memsz, &state->vasize))
 		return TEE_ERROR_SECURITY;
 
+	/*
+	 * Calculate how much of the virtual memory is initialized from the
+	 * ELF, what's above is only zero initialized (.bss and the heap).
+	 */
+	for (n = 0; n < ehdr.e_phnum; n++) {
+		size_t end;
+
+		copy_phdr(&phdr, state, n);
+		if (phdr.p_type != PT_LOAD)
+			continue;
+		if (ADD_OVERFLOW(phdr.p_vaddr, phdr.p_filesz, &end))
+			return TEE_ERROR_SECURITY;
+		state->init_size = MAX(state->init_size, end);
+	}
+	state->init_size = MIN(ROUNDUP(state->init_size, SMALL_PAGE_SIZE),
+			       state->vasize);
+
 	/* Read .ta_head from first segment if the segment is large enough */
 	if (ptload0.p_filesz < head_size)
 		return TEE_ERROR_BAD_FORMAT;
@@ -365,6 +384,11 @@ TEE_Result elf_load_head(struct elf_load_state *state, size_t head_size,
 	return res;
 }
 
+size_t elf_load_get_init_size(struct elf_load_state *state)
+{
+	return state->init_size;
+}
+
 TEE_Result elf_load_get_next_segment(struct elf_load_state *state, size_t *idx,
 			vaddr_t *vaddr, size_t *size, uint32_t *flags,
 			uint32_t *type)
@@ -571,11 +595,20 @@ TEE_Result elf_load_body(struct elf_load_state *state, vaddr_t vabase)
 
 	copy_ehdr(&ehdr, state);
 
+#ifdef CFG_DEMAND_ZERO_USER_TA
+	/*
+	 * Memory above state->init_size is zeroed on demand when first
+	 * accessed, only clear the part that is initialized from the ELF
+	 * (covering eventual gaps and the start of .bss).
+	 */
+	memset(dst, 0, state->init_size);
+#else
 	/*
 	 * Zero initialize everything to make sure that all memory not
 	 * updated from the ELF is zero (covering .bss and eventual gaps).
 	 */
 	memset(dst, 0, state->vasize);
+#endif
 
 	/*
 	 * Copy the segments
@@ -61,6 +61,11 @@ TEE_Result elf_load_init(const struct user_ta_store_ops *ta_store,
 TEE_Result elf_load_head(struct elf_load_state *state, size_t head_size,
 			void **head, size_t *vasize, bool *is_32bit);
 TEE_Result elf_load_body(struct elf_load_state *state, vaddr_t vabase);
+/*
+ * Returns the page aligned size of the part of the TA virtual memory which
+ * is initialized from the ELF, valid after elf_load_head()
+ */
+size_t elf_load_get_init_size(struct elf_load_state *state);
 TEE_Result elf_load_get_next_segment(struct elf_load_state *state, size_t *idx,
 			vaddr_t *vaddr, size_t *size, uint32_t *flags,
 			uint32_t *type);
@@ -283,9 +283,49 @@ static void init_vcore(tee_mm_pool_t *mm_vcore)
 		panic("tee_mm_vcore init failed");
 }
 
+/*
+ * Checks that the hashes of what's in the pageable area are OK. Pages
+ * which are loaded by the pager are verified again by the pager each time
+ * they're paged in, with CFG_PAGER_LAZY_HASH_CHECK=y only the init part,
+ * which is already mapped, is checked here.
+ */
+static void check_pageable_hashes(const uint8_t *hashes,
+				  const uint8_t *paged_store,
+				  size_t pageable_size __maybe_unused,
+				  size_t init_size __maybe_unused)
+{
+	uint64_t cntpct = read_cntpct();
+	uint64_t __maybe_unused ticks;
+#ifdef CFG_PAGER_LAZY_HASH_CHECK
+	size_t check_size = init_size;
+#else
+	size_t check_size = pageable_size;
+#endif
+	size_t n;
+
+	DMSG("Checking hashes of pageable area");
+	for (n = 0; (n * SMALL_PAGE_SIZE) < check_size; n++) {
+		const uint8_t *hash = hashes + n * TEE_SHA256_HASH_SIZE;
+		const uint8_t *page = paged_store + n * SMALL_PAGE_SIZE;
+		TEE_Result res;
+
+		DMSG("hash pg_idx %zu hash %p page %p", n, hash, page);
+		res = hash_sha256_check(hash, page, SMALL_PAGE_SIZE);
+		if (res != TEE_SUCCESS) {
+			EMSG("Hash failed for page %zu at %p: res 0x%x",
+			     n, page, res);
+			panic();
+		}
+	}
+
+	ticks = read_cntpct() - cntpct;
+	IMSG("Checked hashes of %zu/%zu pageable pages in %" PRIu64
+	     " cycles (%" PRIu64 " us)", n, pageable_size / SMALL_PAGE_SIZE,
+	     ticks, ticks * 1000000 / read_cntfrq());
+}
+
 static void init_runtime(unsigned long pageable_part)
 {
-	size_t n;
 	size_t init_size = (size_t)__init_size;
 	size_t pageable_size = __pageable_end - __pageable_start;
 	size_t hash_size = (pageable_size / SMALL_PAGE_SIZE) *
@@ -339,21 +379,7 @@ static void init_runtime(unsigned long pageable_part)
 		__pageable_part_end - __pageable_part_start);
 	asan_memcpy_unchecked(paged_store, __init_start, init_size);
 
-	/* Check that hashes of what's in pageable area is OK */
-	DMSG("Checking hashes of pageable area");
-	for (n = 0; (n * SMALL_PAGE_SIZE) < pageable_size; n++) {
-		const uint8_t *hash = hashes + n * TEE_SHA256_HASH_SIZE;
-		const uint8_t *page = paged_store + n * SMALL_PAGE_SIZE;
-		TEE_Result res;
-
-		DMSG("hash pg_idx %zu hash %p page %p", n, hash, page);
-		res = hash_sha256_check(hash, page, SMALL_PAGE_SIZE);
-		if (res != TEE_SUCCESS) {
-			EMSG("Hash failed for page %zu at %p: res 0x%x",
-			     n, page, res);
-			panic();
-		}
-	}
+	check_pageable_hashes(hashes, paged_store, pageable_size, init_size);
 
 	/*
 	 * Assert prepaged init sections are page aligned so that nothing
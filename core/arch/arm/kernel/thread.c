@@ -31,6 +31,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <keep.h>
 #include <kernel/asan.h>
 #include <kernel/misc.h>
@@ -41,6 +42,7 @@
 #include <kernel/thread_defs.h>
 #include <kernel/thread.h>
 #include <mm/core_memprot.h>
+#include <mm/core_mmu.h>
 #include <mm/mobj.h>
 #include <mm/tee_mm.h>
 #include <mm/tee_mmu.h>
@@ -49,6 +51,7 @@
 #include <smccc.h>
 #include <sm/optee_smc.h>
 #include <sm/sm.h>
+#include <string.h>
 #include <tee/tee_cryp_utl.h>
 #include <tee/tee_fs_rpc.h>
 #include <trace.h>
@@ -122,9 +125,19 @@ linkage uint32_t name[num_stacks] \
 #define GET_STACK(stack) \
 	((vaddr_t)(stack) + STACK_SIZE(stack))
 
+/*
+ * Stacks allocated with CFG_THREAD_DYN_STACKS are STACK_THREAD_SIZE bytes
+ * with the canaries inside, to keep the allocation a whole number of
+ * pages.
+ */
+#define DYN_STACK_BASE(va_end) \
+	((va_end) + STACK_CANARY_SIZE / 2 - STACK_THREAD_SIZE)
+#define DYN_STACK_VA_END(base) \
+	((base) + STACK_THREAD_SIZE - STACK_CANARY_SIZE / 2)
+
 DECLARE_STACK(stack_tmp, CFG_TEE_CORE_NB_CORE, STACK_TMP_SIZE, static);
 DECLARE_STACK(stack_abt, CFG_TEE_CORE_NB_CORE, STACK_ABT_SIZE, static);
-#ifndef CFG_WITH_PAGER
+#if !defined(CFG_WITH_PAGER) && !defined(CFG_THREAD_DYN_STACKS)
 DECLARE_STACK(stack_thread, CFG_NUM_THREADS, STACK_THREAD_SIZE, static);
 #endif
 
@@ -166,6 +179,31 @@ static uint8_t thread_user_kdata_page[
 static unsigned int thread_global_lock = SPINLOCK_UNLOCK;
 static bool thread_prealloc_rpc_cache;
 
+/*
+ * Bitmap of free threads. A thread is allocated by atomically clearing
+ * its bit, without taking thread_global_lock.
+ */
+#define THREAD_FREE_MAP_BITS	32
+static uint32_t thread_free_map[ROUNDUP(CFG_NUM_THREADS,
+					THREAD_FREE_MAP_BITS) /
+				THREAD_FREE_MAP_BITS];
+
+/*
+ * The thread last freed on each core. It's tried first when a thread is
+ * allocated on that core since its stack is likely still in the cache.
+ */
+static size_t thread_core_hint[CFG_TEE_CORE_NB_CORE];
+
+static void lock_global(void)
+{
+	cpu_spin_lock(&thread_global_lock);
+}
+
+static void unlock_global(void)
+{
+	cpu_spin_unlock(&thread_global_lock);
+}
+
 static void init_canaries(void)
 {
 #ifdef CFG_WITH_STACK_CANARIES
@@ -184,7 +222,7 @@ static void init_canaries(void)
 
 	INIT_CANARY(stack_tmp);
 	INIT_CANARY(stack_abt);
-#ifndef CFG_WITH_PAGER
+#if !defined(CFG_WITH_PAGER) && !defined(CFG_THREAD_DYN_STACKS)
 	INIT_CANARY(stack_thread);
 #endif
 #endif/*CFG_WITH_STACK_CANARIES*/
@@ -196,9 +234,30 @@ static void init_canaries(void)
 		panic(); \
 	} while (0)
 
+#ifdef CFG_THREAD_DYN_STACKS
+/*
+ * Checks the canaries of the stack of thread n, the caller makes sure
+ * that the stack can't be released meanwhile.
+ */
+static void check_dyn_stack_canaries(size_t n __maybe_unused)
+{
+#ifdef CFG_WITH_STACK_CANARIES
+	uint32_t *stack = (uint32_t *)DYN_STACK_BASE(threads[n].stack_va_end);
+
+	if (stack[0] != START_CANARY_VALUE)
+		CANARY_DIED(stack_thread, start, n);
+	if (stack[STACK_THREAD_SIZE / sizeof(uint32_t) - 1] != END_CANARY_VALUE)
+		CANARY_DIED(stack_thread, end, n);
+#endif
+}
+#endif
+
 void thread_check_canaries(void)
 {
 #ifdef CFG_WITH_STACK_CANARIES
+#ifdef CFG_THREAD_DYN_STACKS
+	int ct;
+#endif
 	size_t n;
 
 	for (n = 0; n < ARRAY_SIZE(stack_tmp); n++) {
@@ -215,7 +274,7 @@ void thread_check_canaries(void)
 			CANARY_DIED(stack_abt, end, n);
 
 	}
-#ifndef CFG_WITH_PAGER
+#if !defined(CFG_WITH_PAGER) && !defined(CFG_THREAD_DYN_STACKS)
 	for (n = 0; n < ARRAY_SIZE(stack_thread); n++) {
 		if (GET_START_CANARY(stack_thread, n) != START_CANARY_VALUE)
 			CANARY_DIED(stack_thread, start, n);
@@ -223,19 +282,249 @@ void thread_check_canaries(void)
 			CANARY_DIED(stack_thread, end, n);
 	}
 #endif
+#ifdef CFG_THREAD_DYN_STACKS
+	/*
+	 * Only the stack of the current thread can't be released under us.
+	 * The stacks of the other threads are checked when the threads are
+	 * freed and before the stacks are released.
+	 */
+	ct = thread_get_id_may_fail();
+	if (ct != -1)
+		check_dyn_stack_canaries(ct);
+#endif
 #endif/*CFG_WITH_STACK_CANARIES*/
 }
 
-static void lock_global(void)
+static bool claim_free_thread(size_t n)
 {
-	cpu_spin_lock(&thread_global_lock);
+	uint32_t *word = thread_free_map + n / THREAD_FREE_MAP_BITS;
+	uint32_t bit = BIT32(n % THREAD_FREE_MAP_BITS);
+	uint32_t old = atomic_load_u32(word);
+
+	while (old & bit)
+		if (atomic_cas_u32(word, &old, old & ~bit))
+			return true;
+
+	return false;
 }
 
-static void unlock_global(void)
+static void release_free_thread(size_t n)
 {
-	cpu_spin_unlock(&thread_global_lock);
+	uint32_t *word = thread_free_map + n / THREAD_FREE_MAP_BITS;
+	uint32_t bit = BIT32(n % THREAD_FREE_MAP_BITS);
+	uint32_t old = atomic_load_u32(word);
+
+	/* Make the updates of the thread visible before it's free again */
+	dsb();
+	while (!atomic_cas_u32(word, &old, old | bit))
+		;
 }
 
+/* Returns a free thread, or -1 if there's none, in O(1) */
+static int alloc_free_thread(void)
+{
+	size_t hint = thread_core_hint[get_core_pos()];
+	uint32_t *word;
+	uint32_t old;
+	size_t n;
+
+	if (claim_free_thread(hint))
+		return hint;
+
+	for (n = 0; n < ARRAY_SIZE(thread_free_map); n++) {
+		word = thread_free_map + n;
+		old = atomic_load_u32(word);
+		while (old) {
+			size_t b = __builtin_ctz(old);
+
+			if (atomic_cas_u32(word, &old, old & ~BIT32(b)))
+				return n * THREAD_FREE_MAP_BITS + b;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Claims all threads if they're all free, to keep them from being
+ * allocated while the state shared by all threads is updated.
+ */
+static bool claim_all_threads(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		if (!claim_free_thread(n)) {
+			while (n)
+				release_free_thread(--n);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void release_all_threads(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++)
+		release_free_thread(n);
+}
+
+#ifdef CFG_THREAD_DYN_STACKS
+/*
+ * Thread stacks are allocated from TA RAM the first time a thread is
+ * used. When a thread is freed the stacks of other free threads are
+ * released as long as more than CFG_THREAD_POOL_MIN threads have a
+ * stack. thread_nstacks and the stack_va_end of threads being given or
+ * losing a stack are updated with thread_global_lock held.
+ */
+static size_t thread_nstacks;
+
+static bool thread_alloc_stack(size_t n)
+{
+	tee_mm_entry_t *mm;
+	vaddr_t va;
+
+	if (threads[n].stack_va_end)
+		return true;
+
+	mm = tee_mm_alloc(&tee_mm_sec_ddr, STACK_THREAD_SIZE);
+	if (!mm)
+		return false;
+	va = (vaddr_t)phys_to_virt(tee_mm_get_smem(mm), MEM_AREA_TA_RAM);
+	if (!va) {
+		tee_mm_free(mm);
+		return false;
+	}
+
+#ifdef CFG_WITH_STACK_CANARIES
+	((uint32_t *)va)[0] = START_CANARY_VALUE;
+	((uint32_t *)va)[STACK_THREAD_SIZE / sizeof(uint32_t) - 1] =
+		END_CANARY_VALUE;
+#endif
+
+	lock_global();
+	threads[n].stack_va_end = DYN_STACK_VA_END(va);
+	thread_nstacks++;
+	unlock_global();
+
+	return true;
+}
+
+static void thread_free_stack(size_t n)
+{
+	vaddr_t va = DYN_STACK_BASE(threads[n].stack_va_end);
+
+	check_dyn_stack_canaries(n);
+
+	lock_global();
+	threads[n].stack_va_end = 0;
+	thread_nstacks--;
+	unlock_global();
+
+	/*
+	 * The memory goes back to TA RAM, don't leave anything from the
+	 * stack there for the next TA to find.
+	 */
+	memset((void *)va, 0, STACK_THREAD_SIZE);
+	cache_op_inner(DCACHE_AREA_CLEAN, (void *)va, STACK_THREAD_SIZE);
+	tee_mm_free(tee_mm_find(&tee_mm_sec_ddr, virt_to_phys((void *)va)));
+}
+
+/* Releases the stacks of free threads above CFG_THREAD_POOL_MIN */
+static void thread_trim_stacks(void)
+{
+	size_t n;
+
+	for (n = 0; n < CFG_NUM_THREADS; n++) {
+		if (thread_nstacks <= CFG_THREAD_POOL_MIN)
+			break;
+		/* Claiming the thread keeps it from being allocated */
+		if (!claim_free_thread(n))
+			continue;
+		if (threads[n].stack_va_end)
+			thread_free_stack(n);
+		release_free_thread(n);
+	}
+}
+
+static size_t __maybe_unused thread_get_nstacks(void)
+{
+	return thread_nstacks;
+}
+#else
+static bool thread_alloc_stack(size_t n __unused)
+{
+	return true;
+}
+
+static void thread_trim_stacks(void)
+{
+}
+
+static size_t __maybe_unused thread_get_nstacks(void)
+{
+	return CFG_NUM_THREADS;
+}
+#endif /*CFG_THREAD_DYN_STACKS*/
+
+#ifdef CFG_WITH_STATS
+static uint32_t thread_nactive;
+static uint32_t thread_max_active;
+static uint32_t thread_limit_hits;
+
+static void stat_thread_alloc(void)
+{
+	uint32_t nactive = atomic_inc32(&thread_nactive);
+	uint32_t old = atomic_load_u32(&thread_max_active);
+
+	while (nactive > old)
+		if (atomic_cas_u32(&thread_max_active, &old, nactive))
+			break;
+}
+
+static void stat_thread_free(void)
+{
+	atomic_dec32(&thread_nactive);
+}
+
+static void stat_thread_limit_hit(void)
+{
+	atomic_inc32(&thread_limit_hits);
+}
+
+void thread_get_stats(struct thread_stats *stats)
+{
+	stats->max_threads = CFG_NUM_THREADS;
+	stats->active = atomic_load_u32(&thread_nactive);
+	stats->max_active = atomic_load_u32(&thread_max_active);
+	stats->limit_hits = atomic_load_u32(&thread_limit_hits);
+	stats->stacks = thread_get_nstacks();
+
+	atomic_store_u32(&thread_max_active, stats->active);
+	atomic_store_u32(&thread_limit_hits, 0);
+}
+#else
+static void stat_thread_alloc(void)
+{
+}
+
+static void stat_thread_free(void)
+{
+}
+
+static void stat_thread_limit_hit(void)
+{
+}
+
+void thread_get_stats(struct thread_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+#endif /*CFG_WITH_STATS*/
+
 #ifdef ARM32
 uint32_t thread_get_exceptions(void)
 {
@@ -426,6 +715,11 @@ void thread_init_boot_thread(void)
 	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
 		thread_core_local[n].curr_thread = -1;
 
+	/* All threads but the boot thread are free */
+	for (n = 1; n < CFG_NUM_THREADS; n++)
+		thread_free_map[n / THREAD_FREE_MAP_BITS] |=
+			BIT32(n % THREAD_FREE_MAP_BITS);
+
 	l->curr_thread = 0;
 	threads[0].state = THREAD_STATE_ACTIVE;
 }
@@ -438,33 +732,34 @@ void thread_clr_boot_thread(void)
 	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
 	assert(TAILQ_EMPTY(&threads[l->curr_thread].mutexes));
 	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	release_free_thread(l->curr_thread);
 	l->curr_thread = -1;
 }
 
 static void thread_alloc_and_run(struct thread_smc_args *args)
 {
-	size_t n;
 	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
+	int n;
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
-		}
+	/*
+	 * The thread is ours once its bit is cleared in thread_free_map,
+	 * no one else updates the state of a free thread.
+	 */
+	n = alloc_free_thread();
+	if (n >= 0 && !thread_alloc_stack(n)) {
+		release_free_thread(n);
+		n = -1;
 	}
-
-	unlock_global();
-
-	if (!found_thread) {
+	if (n < 0) {
+		stat_thread_limit_hit();
 		args->a0 = OPTEE_SMC_RETURN_ETHREAD_LIMIT;
 		return;
 	}
+	assert(threads[n].state == THREAD_STATE_FREE);
+	threads[n].state = THREAD_STATE_ACTIVE;
+	stat_thread_alloc();
 
 	l->curr_thread = n;
 
@@ -696,6 +991,9 @@ void thread_state_free(void)
 	assert(TAILQ_EMPTY(&threads[ct].mutexes));
 
 	thread_lazy_restore_ns_vfp();
+#ifdef CFG_THREAD_DYN_STACKS
+	check_dyn_stack_canaries(ct);
+#endif
 	tee_pager_release_phys(
 		(void *)(threads[ct].stack_va_end - STACK_THREAD_SIZE),
 		STACK_THREAD_SIZE);
@@ -708,6 +1006,11 @@ void thread_state_free(void)
 	l->curr_thread = -1;
 
 	unlock_global();
+
+	stat_thread_free();
+	thread_trim_stacks();
+	thread_core_hint[get_core_pos()] = ct;
+	release_free_thread(ct);
 }
 
 #ifdef CFG_WITH_PAGER
@@ -885,7 +1188,7 @@ static void init_thread_stacks(void)
 			panic("init stack failed");
 	}
 }
-#else
+#elif !defined(CFG_THREAD_DYN_STACKS)
 static void init_thread_stacks(void)
 {
 	size_t n;
@@ -896,6 +1199,18 @@ static void init_thread_stacks(void)
 			panic("thread_init_stack failed");
 	}
 }
+#elif defined(CFG_THREAD_DYN_STACKS)
+static void init_thread_stacks(void)
+{
+	/*
+	 * Thread stacks are allocated from TA RAM when the threads are
+	 * first used. All stacks together may take at most half of TA RAM,
+	 * leaving the rest for loading TAs.
+	 */
+	if ((size_t)CFG_NUM_THREADS * STACK_THREAD_SIZE >
+	    (tee_mm_sec_ddr.hi - tee_mm_sec_ddr.lo) / 2)
+		panic("TA RAM too small for the thread stacks");
+}
 #endif /*CFG_WITH_PAGER*/
 
 static void init_user_kcode(void)
@@ -1319,15 +1634,13 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!claim_all_threads()) {
+		thread_unmask_exceptions(exceptions);
+		return false;
 	}
 
+	lock_global();
+
 	rv = true;
 	for (n = 0; n < CFG_NUM_THREADS; n++) {
 		if (threads[n].rpc_arg) {
@@ -1343,29 +1656,24 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	thread_prealloc_rpc_cache = false;
 out:
 	unlock_global();
+	release_all_threads();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
 
 bool thread_enable_prealloc_rpc_cache(void)
 {
-	bool rv;
-	size_t n;
+	bool rv = false;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (claim_all_threads()) {
+		lock_global();
+		thread_prealloc_rpc_cache = true;
+		unlock_global();
+		release_all_threads();
+		rv = true;
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
@@ -156,10 +156,16 @@ static TEE_Result get_elf_segments(struct user_ta_ctx *utc,
 	return TEE_SUCCESS;
 }
 
-static struct mobj *alloc_ta_mem(size_t size)
+/*
+ * Allocates memory for a TA where only the first @init_size bytes have to
+ * be backed with physical memory from start.
+ */
+static struct mobj *alloc_ta_mem(size_t size, size_t init_size __maybe_unused)
 {
-#ifdef CFG_PAGED_USER_TA
+#if defined(CFG_PAGED_USER_TA)
 	return mobj_paged_alloc(size);
+#elif defined(CFG_DEMAND_ZERO_USER_TA)
+	return mobj_dz_alloc(size, init_size);
 #else
 	return mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
 #endif
@@ -188,7 +194,8 @@ static TEE_Result load_elf(struct user_ta_ctx *utc,
 		goto out;
 	ta_head = p;
 
-	utc->mobj_code = alloc_ta_mem(vasize);
+	utc->mobj_code = alloc_ta_mem(vasize,
+				      elf_load_get_init_size(elf_state));
 	if (!utc->mobj_code) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
@@ -196,7 +203,7 @@ static TEE_Result load_elf(struct user_ta_ctx *utc,
 
 	/* Ensure proper aligment of stack */
 	utc->mobj_stack = alloc_ta_mem(ROUNDUP(ta_head->stack_size,
-					       STACK_ALIGNMENT));
+					       STACK_ALIGNMENT), 0);
 	if (!utc->mobj_stack) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
@@ -320,7 +327,7 @@ static TEE_Result ta_load(const TEE_UUID *uuid,
 	utc->entry_func = ta_head->entry.ptr64;
 	utc->ctx.ref_count = 1;
 	condvar_init(&utc->ctx.busy_cv);
-	TAILQ_INSERT_TAIL(&tee_ctxes, &utc->ctx, link);
+	tee_ta_register_ctx(&utc->ctx);
 	*ta_ctx = &utc->ctx;
 
 	tee_mmu_set_ctx(NULL);
@@ -502,9 +509,9 @@ static void user_ta_dump_state(struct tee_ta_ctx *ctx)
 	char flags[7] = { '\0', };
 	size_t n = 0;
 
-	EMSG_RAW(" arch: %s  load address: %#" PRIxVA " ctx-idr: %d",
+	EMSG_RAW(" arch: %s  load address: %#" PRIxVA " ctx-idr: %" PRIu32,
 		 utc->is_32bit ? "arm" : "aarch64", utc->load_addr,
-		 utc->vm_info->asid);
+		 utc->vm_info->id);
 	EMSG_RAW(" stack: 0x%" PRIxVA " %zu",
 		 utc->stack_addr, utc->mobj_stack->size);
 	TAILQ_FOREACH(r, &utc->vm_info->regions, link) {
@@ -570,7 +577,7 @@ static void user_ta_ctx_destroy(struct tee_ta_ctx *ctx)
 
 static uint32_t user_ta_get_instance_id(struct tee_ta_ctx *ctx)
 {
-	return to_user_ta_ctx(ctx)->vm_info->asid;
+	return to_user_ta_ctx(ctx)->vm_info->id;
 }
 
 static const struct tee_ta_ops user_ta_ops __rodata_unpaged = {
@@ -1289,6 +1289,25 @@ static void set_region(struct core_mmu_table_info *tbl_info,
 	}
 }
 
+/*
+ * Returns true if the directory entry at @va can map @region directly
+ * with a section (v7) or a block (LPAE), @pa is updated with the physical
+ * address to map.
+ */
+static bool get_block_pa(struct vm_region *region, vaddr_t va, vaddr_t end,
+			 paddr_t *pa)
+{
+	if ((va & CORE_MMU_PGDIR_MASK) || end - va < CORE_MMU_PGDIR_SIZE)
+		return false;
+	if (region->mobj->phys_granule || mobj_is_paged(region->mobj) ||
+	    mobj_is_dz(region->mobj))
+		return false;
+	if (mobj_get_pa(region->mobj, va - region->va + region->offset, 0, pa))
+		return false;
+
+	return !(*pa & CORE_MMU_PGDIR_MASK);
+}
+
 static void set_pg_region(struct core_mmu_table_info *dir_info,
 			struct vm_region *region, struct pgt **pgt,
 			struct core_mmu_table_info *pg_info)
@@ -1308,20 +1327,48 @@ static void set_pg_region(struct core_mmu_table_info *dir_info,
 			 * We're assigning a new translation table.
 			 */
 			unsigned int idx;
-
-			assert(*pgt); /* We should have alloced enough */
+			vaddr_t va_base;
 
 			/* Virtual addresses must grow */
 			assert(r.va > pg_info->va_base);
 
 			idx = core_mmu_va2idx(dir_info, r.va);
+			va_base = core_mmu_idx2va(dir_info, idx);
+
+			/*
+			 * Skip the tables of directory entries without any
+			 * region, the tables are allocated for the entire
+			 * range.
+			 */
+			while (pg_info->table &&
+			       pg_info->va_base + CORE_MMU_PGDIR_SIZE <
+			       va_base) {
+				assert(*pgt);
+				*pgt = SLIST_NEXT(*pgt, link);
+				pg_info->va_base += CORE_MMU_PGDIR_SIZE;
+			}
+
+			assert(*pgt); /* We should have alloced enough */
+
 			pg_info->table = (*pgt)->tbl;
-			pg_info->va_base = core_mmu_idx2va(dir_info, idx);
+			pg_info->va_base = va_base;
 #ifdef CFG_PAGED_USER_TA
 			assert((*pgt)->vabase == pg_info->va_base);
 #endif
 			*pgt = SLIST_NEXT(*pgt, link);
 
+			/*
+			 * Map the entire directory entry with a section or
+			 * block if possible, the table is left unused.
+			 */
+			if (get_block_pa(region, r.va, end, &r.pa)) {
+				r.size = CORE_MMU_PGDIR_SIZE;
+				core_mmu_set_entry(dir_info, idx, r.pa,
+						   r.attr);
+				r.va += r.size;
+				continue;
+			}
+
 			core_mmu_set_entry(dir_info, idx,
 					   virt_to_phys(pg_info->table),
 					   pgt_attr);
@@ -1333,15 +1380,23 @@ static void set_pg_region(struct core_mmu_table_info *dir_info,
 		if (!mobj_is_paged(region->mobj)) {
 			size_t granule = BIT(pg_info->shift);
 			size_t offset = r.va - region->va + region->offset;
+			TEE_Result res;
 
 			r.size = MIN(r.size,
 				     mobj_get_phys_granule(region->mobj));
 			r.size = ROUNDUP(r.size, SMALL_PAGE_SIZE);
 
-			if (mobj_get_pa(region->mobj, offset, granule,
-					&r.pa) != TEE_SUCCESS)
+			res = mobj_get_pa(region->mobj, offset, granule, &r.pa);
+			/*
+			 * Pages of a demand-zero mobj which aren't allocated
+			 * yet are left unmapped, they are mapped by
+			 * tee_mmu_handle_dz_fault() on first access.
+			 */
+			if (res == TEE_SUCCESS)
+				set_region(pg_info, &r);
+			else if (res != TEE_ERROR_NO_DATA ||
+				 !mobj_is_dz(region->mobj))
 				panic("Failed to get PA of unpaged mobj");
-			set_region(pg_info, &r);
 		}
 		r.va += r.size;
 	}
@@ -1541,8 +1596,9 @@ void core_mmu_populate_user_map(struct core_mmu_table_info *dir_info,
 	/*
 	 * Allocate all page tables in advance.
 	 */
-	pgt_alloc(pgt_cache, &utc->ctx, r->va,
-		  r_last->va + r_last->size - 1);
+	if (pgt_alloc(pgt_cache, &utc->ctx, r->va,
+		      r_last->va + r_last->size - 1))
+		utc->vm_info->tlb_stale = true;
 	pgt = SLIST_FIRST(pgt_cache);
 
 	core_mmu_set_info_table(&pg_info, dir_info->level + 1, 0, NULL);
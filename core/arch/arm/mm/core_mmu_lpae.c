@@ -741,8 +741,6 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
-	tlbi_all();
-
 	thread_unmask_exceptions(exceptions);
 }
 
@@ -821,8 +819,6 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		dsb();	/* Make sure the write above is visible */
 	}
 
-	tlbi_all();
-
 	thread_unmask_exceptions(exceptions);
 }
 
@@ -662,8 +662,6 @@ void core_mmu_set_user_map(struct core_mmu_user_map *map)
 		isb();
 	}
 
-	tlbi_all();
-
 	/* Restore interrupts */
 	thread_unmask_exceptions(exceptions);
 }
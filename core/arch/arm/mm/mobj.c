@@ -3,6 +3,7 @@
  * Copyright (c) 2016-2017, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
 #include <keep.h>
 #include <initcall.h>
@@ -17,6 +18,7 @@
 #include <optee_msg.h>
 #include <sm/optee_smc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <tee_api_types.h>
 #include <types_ext.h>
 #include <util.h>
@@ -311,11 +313,70 @@ struct mobj_reg_shm {
 #define MOBJ_REG_SHM_SIZE(nr_pages) \
 	(sizeof(struct mobj_reg_shm) + sizeof(paddr_t) * (nr_pages))
 
-static SLIST_HEAD(reg_shm_head, mobj_reg_shm) reg_shm_list =
-	SLIST_HEAD_INITIALIZER(reg_shm_head);
+/*
+ * Registered shared memory objects are hashed on their cookie since each
+ * OPTEE_MSG_ATTR_TYPE_RMEM parameter needs a lookup. Number of buckets
+ * must be a power of 2.
+ */
+#define REG_SHM_HASH_BITS	6
+
+SLIST_HEAD(reg_shm_head, mobj_reg_shm);
+
+static struct reg_shm_head reg_shm_hash[BIT(REG_SHM_HASH_BITS)];
 
+/* Protects reg_shm_hash and reg_shm_stats */
 static unsigned int reg_shm_slist_lock = SPINLOCK_UNLOCK;
 
+#ifdef CFG_WITH_STATS
+static struct mobj_reg_shm_stats reg_shm_stats;
+
+static inline void update_lookup_stats(size_t probes, uint64_t ticks)
+{
+	reg_shm_stats.lookups++;
+	reg_shm_stats.probes += probes;
+	reg_shm_stats.ticks += ticks;
+	if (ticks > reg_shm_stats.max_ticks)
+		reg_shm_stats.max_ticks = ticks;
+}
+
+void mobj_reg_shm_get_stats(struct mobj_reg_shm_stats *stats)
+{
+	uint32_t exceptions;
+
+	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
+	*stats = reg_shm_stats;
+	memset(&reg_shm_stats, 0, sizeof(reg_shm_stats));
+	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
+}
+
+static inline uint64_t lookup_start(void)
+{
+	return read_cntpct();
+}
+#else /* CFG_WITH_STATS */
+static inline void update_lookup_stats(size_t probes __unused,
+				       uint64_t ticks __unused) { }
+
+void mobj_reg_shm_get_stats(struct mobj_reg_shm_stats *stats)
+{
+	memset(stats, 0, sizeof(struct mobj_reg_shm_stats));
+}
+
+static inline uint64_t lookup_start(void)
+{
+	return 0;
+}
+#endif /* CFG_WITH_STATS */
+
+static struct reg_shm_head *reg_shm_bucket(uint64_t cookie)
+{
+	uint32_t key = (uint32_t)(cookie ^ (cookie >> 32));
+
+	/* Fibonacci hashing, keeps the upper bits of the product */
+	return reg_shm_hash + ((uint32_t)(key * 0x9e3779b1) >>
+			       (32 - REG_SHM_HASH_BITS));
+}
+
 static struct mobj_reg_shm *to_mobj_reg_shm(struct mobj *mobj);
 
 static TEE_Result mobj_reg_shm_get_pa(struct mobj *mobj, size_t offst,
@@ -376,7 +437,7 @@ static void mobj_reg_shm_free(struct mobj *mobj)
 	mobj_reg_shm_unmap(mobj);
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_REMOVE(&reg_shm_list, mobj_reg_shm,
+	SLIST_REMOVE(reg_shm_bucket(mobj_reg_shm->cookie), mobj_reg_shm,
 		     mobj_reg_shm, next);
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
 	free(mobj_reg_shm);
@@ -452,7 +513,7 @@ struct mobj *mobj_reg_shm_alloc(paddr_t *pages, size_t num_pages,
 	}
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_INSERT_HEAD(&reg_shm_list, mobj_reg_shm, next);
+	SLIST_INSERT_HEAD(reg_shm_bucket(cookie), mobj_reg_shm, next);
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
 
 	return &mobj_reg_shm->mobj;
@@ -464,18 +525,22 @@ err:
 struct mobj *mobj_reg_shm_find_by_cookie(uint64_t cookie)
 {
 	struct mobj_reg_shm *mobj_reg_shm;
+	uint64_t start = lookup_start();
+	size_t probes = 0;
 	uint32_t exceptions;
 
 	exceptions = cpu_spin_lock_xsave(&reg_shm_slist_lock);
-	SLIST_FOREACH(mobj_reg_shm, &reg_shm_list, next) {
-		if (mobj_reg_shm->cookie == cookie) {
-			cpu_spin_unlock_xrestore(&reg_shm_slist_lock,
-						 exceptions);
-			return &mobj_reg_shm->mobj;
-		}
+	SLIST_FOREACH(mobj_reg_shm, reg_shm_bucket(cookie), next) {
+		probes++;
+		if (mobj_reg_shm->cookie == cookie)
+			break;
 	}
+	update_lookup_stats(probes, lookup_start() - start);
 	cpu_spin_unlock_xrestore(&reg_shm_slist_lock, exceptions);
-	return NULL;
+
+	if (!mobj_reg_shm)
+		return NULL;
+	return &mobj_reg_shm->mobj;
 }
 
 TEE_Result mobj_reg_shm_map(struct mobj *mobj)
@@ -814,3 +879,193 @@ bool mobj_is_paged(struct mobj *mobj)
 	       mobj->ops == &mobj_seccpy_shm_ops;
 }
 #endif /*CFG_PAGED_USER_TA*/
+
+#ifdef CFG_DEMAND_ZERO_USER_TA
+/*
+ * mobj_dz implementation. Represents TA RAM where the first part is
+ * allocated as a physically contiguous block when the mobj is created
+ * while the remaining pages are allocated one at a time on first access.
+ */
+
+struct mobj_dz {
+	struct mobj mobj;
+	tee_mm_entry_t *mm_init;
+	size_t num_init_pages;
+	size_t num_pages;
+	unsigned int lock;
+	tee_mm_entry_t *pages[];
+};
+
+static struct mobj_dz *to_mobj_dz(struct mobj *mobj);
+
+static tee_mm_entry_t *mobj_dz_find_mm(struct mobj_dz *m, size_t pgidx)
+{
+	tee_mm_entry_t *mm;
+	uint32_t exceptions;
+
+	if (pgidx < m->num_init_pages)
+		return m->mm_init;
+
+	exceptions = cpu_spin_lock_xsave(&m->lock);
+	mm = m->pages[pgidx - m->num_init_pages];
+	cpu_spin_unlock_xrestore(&m->lock, exceptions);
+
+	return mm;
+}
+
+static TEE_Result mobj_dz_get_pa(struct mobj *mobj, size_t offs,
+				 size_t granule, paddr_t *pa)
+{
+	struct mobj_dz *m = to_mobj_dz(mobj);
+	size_t pgidx = offs / SMALL_PAGE_SIZE;
+	tee_mm_entry_t *mm;
+	paddr_t p;
+
+	if (!pa || pgidx >= m->num_pages)
+		return TEE_ERROR_GENERIC;
+	if (granule && granule != SMALL_PAGE_SIZE)
+		return TEE_ERROR_GENERIC;
+
+	mm = mobj_dz_find_mm(m, pgidx);
+	if (!mm)
+		return TEE_ERROR_NO_DATA;
+
+	if (mm == m->mm_init)
+		p = tee_mm_get_smem(mm) + offs;
+	else
+		p = tee_mm_get_smem(mm) + (offs & SMALL_PAGE_MASK);
+
+	if (granule)
+		p &= ~(granule - 1);
+
+	*pa = p;
+	return TEE_SUCCESS;
+}
+KEEP_PAGER(mobj_dz_get_pa);
+
+static TEE_Result mobj_dz_get_cattr(struct mobj *mobj __unused,
+				    uint32_t *cattr)
+{
+	if (!cattr)
+		return TEE_ERROR_GENERIC;
+
+	*cattr = TEE_MATTR_CACHE_CACHED;
+	return TEE_SUCCESS;
+}
+
+static bool mobj_dz_matches(struct mobj *mobj __unused, enum buf_is_attr attr)
+{
+	return attr == CORE_MEM_SEC || attr == CORE_MEM_TA_RAM;
+}
+
+static void release_dz_mm(tee_mm_entry_t *mm)
+{
+	void *va = phys_to_virt(tee_mm_get_smem(mm), MEM_AREA_TA_RAM);
+	size_t size = tee_mm_get_bytes(mm);
+
+	memset(va, 0, size);
+	cache_op_inner(DCACHE_AREA_CLEAN, va, size);
+	tee_mm_free(mm);
+}
+
+static void mobj_dz_free(struct mobj *mobj)
+{
+	struct mobj_dz *m = to_mobj_dz(mobj);
+	size_t n;
+
+	if (m->mm_init)
+		release_dz_mm(m->mm_init);
+	for (n = 0; n < m->num_pages - m->num_init_pages; n++)
+		if (m->pages[n])
+			release_dz_mm(m->pages[n]);
+	free(m);
+}
+
+static const struct mobj_ops mobj_dz_ops __rodata_unpaged = {
+	.get_pa = mobj_dz_get_pa,
+	.get_cattr = mobj_dz_get_cattr,
+	.matches = mobj_dz_matches,
+	.free = mobj_dz_free,
+};
+
+static struct mobj_dz *to_mobj_dz(struct mobj *mobj)
+{
+	assert(mobj->ops == &mobj_dz_ops);
+	return container_of(mobj, struct mobj_dz, mobj);
+}
+
+struct mobj *mobj_dz_alloc(size_t size, size_t init_size)
+{
+	size_t num_pages = ROUNDUP(size, SMALL_PAGE_SIZE) / SMALL_PAGE_SIZE;
+	size_t num_init_pages = ROUNDUP(init_size, SMALL_PAGE_SIZE) /
+				SMALL_PAGE_SIZE;
+	struct mobj_dz *m;
+
+	if (num_init_pages > num_pages)
+		return NULL;
+
+	m = calloc(1, sizeof(*m) +
+		      (num_pages - num_init_pages) * sizeof(tee_mm_entry_t *));
+	if (!m)
+		return NULL;
+
+	if (num_init_pages) {
+		m->mm_init = tee_mm_alloc(&tee_mm_sec_ddr,
+					  num_init_pages * SMALL_PAGE_SIZE);
+		if (!m->mm_init) {
+			free(m);
+			return NULL;
+		}
+	}
+
+	m->num_init_pages = num_init_pages;
+	m->num_pages = num_pages;
+	m->lock = SPINLOCK_UNLOCK;
+	m->mobj.size = size;
+	m->mobj.phys_granule = SMALL_PAGE_SIZE;
+	m->mobj.ops = &mobj_dz_ops;
+
+	return &m->mobj;
+}
+
+TEE_Result mobj_dz_get_page(struct mobj *mobj, size_t offs, paddr_t *pa)
+{
+	struct mobj_dz *m = to_mobj_dz(mobj);
+	size_t pgidx = offs / SMALL_PAGE_SIZE;
+	tee_mm_entry_t *mm;
+	uint32_t exceptions;
+	void *va;
+
+	if (pgidx >= m->num_pages)
+		return TEE_ERROR_GENERIC;
+	if (mobj_dz_find_mm(m, pgidx))
+		return mobj_dz_get_pa(mobj, offs, SMALL_PAGE_SIZE, pa);
+
+	mm = tee_mm_alloc(&tee_mm_sec_ddr, SMALL_PAGE_SIZE);
+	if (!mm)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	va = phys_to_virt(tee_mm_get_smem(mm), MEM_AREA_TA_RAM);
+	memset(va, 0, SMALL_PAGE_SIZE);
+
+	/*
+	 * Another thread may have populated the page while we were
+	 * allocating, in that case keep the already present page.
+	 */
+	exceptions = cpu_spin_lock_xsave(&m->lock);
+	if (!m->pages[pgidx - m->num_init_pages]) {
+		m->pages[pgidx - m->num_init_pages] = mm;
+		mm = NULL;
+	}
+	cpu_spin_unlock_xrestore(&m->lock, exceptions);
+
+	if (mm)
+		tee_mm_free(mm);
+
+	return mobj_dz_get_pa(mobj, offs, SMALL_PAGE_SIZE, pa);
+}
+
+bool mobj_is_dz(struct mobj *mobj)
+{
+	return mobj && mobj->ops == &mobj_dz_ops;
+}
+#endif /*CFG_DEMAND_ZERO_USER_TA*/
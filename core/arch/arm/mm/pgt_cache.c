@@ -10,6 +10,7 @@
 #include <mm/pgt_cache.h>
 #include <mm/tee_pager.h>
 #include <stdlib.h>
+#include <string.h>
 #include <trace.h>
 #include <util.h>
 
@@ -61,6 +62,43 @@ static struct pgt pgt_entries[PGT_CACHE_SIZE];
 static struct mutex pgt_mu = MUTEX_INITIALIZER;
 static struct condvar pgt_cv = CONDVAR_INITIALIZER;
 
+#ifdef CFG_WITH_STATS
+/* Protected by pgt_mu */
+static struct pgt_cache_stats pgt_stats;
+
+static inline void incr_hits(void)
+{
+	pgt_stats.hits++;
+}
+
+static inline void incr_misses(void)
+{
+	pgt_stats.misses++;
+}
+
+static inline void incr_evictions(void)
+{
+	pgt_stats.evictions++;
+}
+
+void pgt_get_stats(struct pgt_cache_stats *stats)
+{
+	mutex_lock(&pgt_mu);
+	*stats = pgt_stats;
+	memset(&pgt_stats, 0, sizeof(pgt_stats));
+	mutex_unlock(&pgt_mu);
+}
+#else /* CFG_WITH_STATS */
+static inline void incr_hits(void) { }
+static inline void incr_misses(void) { }
+static inline void incr_evictions(void) { }
+
+void pgt_get_stats(struct pgt_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(struct pgt_cache_stats));
+}
+#endif /* CFG_WITH_STATS */
+
 #if defined(CFG_WITH_PAGER) && defined(CFG_WITH_LPAE)
 void pgt_init(void)
 {
@@ -258,23 +296,29 @@ static void pgt_free_unlocked(struct pgt_cache *pgt_cache, bool save_ctx)
 	}
 }
 
-static struct pgt *pop_from_some_list(vaddr_t vabase, void *ctx)
+static struct pgt *pop_from_some_list(vaddr_t vabase, void *ctx,
+				      bool *new_tbl)
 {
 	struct pgt *p = pop_from_cache_list(vabase, ctx);
 
-	if (p)
+	if (p) {
+		incr_hits();
 		return p;
+	}
 	p = pop_from_free_list();
 	if (!p) {
 		p = pop_least_used_from_cache_list();
 		if (!p)
 			return NULL;
+		incr_evictions();
 		tee_pager_pgt_save_and_release_entries(p);
 		memset(p->tbl, 0, PGT_SIZE);
 	}
+	incr_misses();
 	assert(!p->num_used_entries);
 	p->ctx = ctx;
 	p->vabase = vabase;
+	*new_tbl = true;
 	return p;
 }
 
@@ -480,15 +524,57 @@ static void pgt_free_unlocked(struct pgt_cache *pgt_cache,
 	}
 }
 
+#if defined(CFG_WITH_PAGER)
+/* Free tables are released to the pager and may be in another page next */
 static struct pgt *pop_from_some_list(vaddr_t vabase __unused,
-				      void *ctx __unused)
+				      void *ctx __unused, bool *new_tbl)
+{
+	struct pgt *p = pop_from_free_list();
+
+	if (p) {
+		incr_misses();
+		*new_tbl = true;
+	}
+	return p;
+}
+#else
+/*
+ * Free tables remember what they were last used for, a table which was
+ * used by the same context at the same address is taken first.
+ */
+static struct pgt *pop_from_some_list(vaddr_t vabase, void *ctx,
+				      bool *new_tbl)
 {
-	return pop_from_free_list();
+	struct pgt *pp = NULL;
+	struct pgt *p;
+
+	SLIST_FOREACH(p, &pgt_free_list, link) {
+		if (p->ctx == ctx && p->vabase == vabase) {
+			if (pp)
+				SLIST_REMOVE_AFTER(pp, link);
+			else
+				SLIST_REMOVE_HEAD(&pgt_free_list, link);
+			memset(p->tbl, 0, PGT_SIZE);
+			incr_misses();
+			return p;
+		}
+		pp = p;
+	}
+
+	p = pop_from_free_list();
+	if (p) {
+		incr_misses();
+		p->ctx = ctx;
+		p->vabase = vabase;
+		*new_tbl = true;
+	}
+	return p;
 }
+#endif
 #endif /*!CFG_PAGED_USER_TA*/
 
 static bool pgt_alloc_unlocked(struct pgt_cache *pgt_cache, void *ctx,
-			       vaddr_t begin, vaddr_t last)
+			       vaddr_t begin, vaddr_t last, bool *new_tbl)
 {
 	const vaddr_t base = ROUNDDOWN(begin, CORE_MMU_PGDIR_SIZE);
 	const size_t num_tbls = ((last - base) >> CORE_MMU_PGDIR_SHIFT) + 1;
@@ -497,7 +583,8 @@ static bool pgt_alloc_unlocked(struct pgt_cache *pgt_cache, void *ctx,
 	struct pgt *pp = NULL;
 
 	while (n < num_tbls) {
-		p = pop_from_some_list(base + n * CORE_MMU_PGDIR_SIZE, ctx);
+		p = pop_from_some_list(base + n * CORE_MMU_PGDIR_SIZE, ctx,
+				       new_tbl);
 		if (!p) {
 			pgt_free_unlocked(pgt_cache, ctx);
 			return false;
@@ -514,22 +601,26 @@ static bool pgt_alloc_unlocked(struct pgt_cache *pgt_cache, void *ctx,
 	return true;
 }
 
-void pgt_alloc(struct pgt_cache *pgt_cache, void *ctx,
+bool pgt_alloc(struct pgt_cache *pgt_cache, void *ctx,
 	       vaddr_t begin, vaddr_t last)
 {
+	bool new_tbl = false;
+
 	if (last <= begin)
-		return;
+		return false;
 
 	mutex_lock(&pgt_mu);
 
 	pgt_free_unlocked(pgt_cache, ctx);
-	while (!pgt_alloc_unlocked(pgt_cache, ctx, begin, last)) {
+	while (!pgt_alloc_unlocked(pgt_cache, ctx, begin, last, &new_tbl)) {
 		DMSG("Waiting for page tables");
 		condvar_broadcast(&pgt_cv);
 		condvar_wait(&pgt_cv, &pgt_mu);
 	}
 
 	mutex_unlock(&pgt_mu);
+
+	return new_tbl;
 }
 
 void pgt_free(struct pgt_cache *pgt_cache, bool save_ctx)
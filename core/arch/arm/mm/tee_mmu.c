@@ -30,6 +30,7 @@
 #include <arm.h>
 #include <assert.h>
 #include <bitstring.h>
+#include <kernel/abort.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_common.h>
@@ -72,20 +73,59 @@
  * mode contexts. This value can be increased but not beyond the maximum
  * ASID, which is architecture dependent (max 255 for ARMv7-A and ARMv8-A
  * Aarch32).
+ *
+ * ASIDs are assigned when a context is activated rather than when it's
+ * created so the number of loaded contexts isn't limited by the number of
+ * ASIDs. When all ASIDs are used up a new generation is started where
+ * only the contexts which are current in some thread keep their ASIDs,
+ * the others are assigned new ones next time they're activated. The TLB
+ * entries of an ASID are invalidated when it's assigned to a context,
+ * see tee_mmu_set_ctx(), so no TLB maintenance is needed when a new
+ * generation is started.
  */
 #define MMU_NUM_ASIDS		64
 
+#if CFG_NUM_THREADS > MMU_NUM_ASIDS
+#error CFG_NUM_THREADS is larger than MMU_NUM_ASIDS
+#endif
+
 static bitstr_t bit_decl(g_asid, MMU_NUM_ASIDS);
+static unsigned int g_asid_gen = 1;
+static TAILQ_HEAD(, vm_info) g_vm_info_head =
+	TAILQ_HEAD_INITIALIZER(g_vm_info_head);
+static uint32_t g_vm_info_id;
 static unsigned int g_asid_spinlock = SPINLOCK_UNLOCK;
 
+/*
+ * Returns true if @reg may be mapped with sections (v7) or blocks (LPAE),
+ * that is, it's large enough and backed by physically contiguous memory,
+ * @pa_offs is updated with the offset of the physical address of @reg
+ * into a section or block.
+ */
+static bool get_block_pa_offs(const struct vm_region *reg, size_t *pa_offs)
+{
+	paddr_t pa;
+
+	if (reg->size < CORE_MMU_PGDIR_SIZE || reg->mobj->phys_granule ||
+	    mobj_is_paged(reg->mobj) || mobj_is_dz(reg->mobj))
+		return false;
+	if (mobj_get_pa(reg->mobj, reg->offset, 0, &pa))
+		return false;
+
+	*pa_offs = pa & CORE_MMU_PGDIR_MASK;
+	return true;
+}
+
 static vaddr_t select_va_in_range(vaddr_t prev_end, uint32_t prev_attr,
 				  vaddr_t next_begin, uint32_t next_attr,
-				  const struct vm_region *reg)
+				  const struct vm_region *reg, bool block)
 {
 	size_t granul;
 	const uint32_t a = TEE_MATTR_EPHEMERAL | TEE_MATTR_PERMANENT;
 	size_t pad;
+	size_t pa_offs;
 	vaddr_t begin_va;
+	vaddr_t block_va;
 	vaddr_t end_va;
 
 	/*
@@ -120,6 +160,20 @@ static vaddr_t select_va_in_range(vaddr_t prev_end, uint32_t prev_attr,
 	if ((next_attr & TEE_MATTR_SECURE) != (reg->attr & TEE_MATTR_SECURE))
 		granul = CORE_MMU_PGDIR_SIZE;
 #endif
+
+	/*
+	 * Prefer a virtual address with the same offset into a section or
+	 * block as the physical address, if there's room for it, so that
+	 * core_mmu_populate_user_map() can use sections or blocks.
+	 */
+	if (block && get_block_pa_offs(reg, &pa_offs)) {
+		block_va = begin_va + ((pa_offs - begin_va) &
+				       CORE_MMU_PGDIR_MASK);
+		end_va = ROUNDUP(block_va + reg->size + pad, granul);
+		if (end_va <= next_begin)
+			return block_va;
+	}
+
 	end_va = ROUNDUP(begin_va + reg->size + pad, granul);
 
 	if (end_va <= next_begin) {
@@ -130,7 +184,8 @@ static vaddr_t select_va_in_range(vaddr_t prev_end, uint32_t prev_attr,
 	return 0;
 }
 
-static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
+static TEE_Result umap_insert_region(struct vm_info *vmi,
+				     struct vm_region *reg, bool block)
 {
 	struct vm_region *r;
 	struct vm_region *prev_r;
@@ -140,20 +195,11 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 
 	core_mmu_get_user_va_range(&va_range_base, &va_range_size);
 
-	/* Check alignment, it has to be at least SMALL_PAGE based */
-	if ((reg->va | reg->size) & SMALL_PAGE_MASK)
-		return TEE_ERROR_ACCESS_CONFLICT;
-
-	/* Check that the mobj is defined for the entire range */
-	if ((reg->offset + reg->size) >
-	     ROUNDUP(reg->mobj->size, SMALL_PAGE_SIZE))
-		return TEE_ERROR_BAD_PARAMETERS;
-
 	prev_r = NULL;
 	TAILQ_FOREACH(r, &vmi->regions, link) {
 		if (TAILQ_FIRST(&vmi->regions) == r) {
 			va = select_va_in_range(va_range_base, 0,
-						r->va, r->attr, reg);
+						r->va, r->attr, reg, block);
 			if (va) {
 				reg->va = va;
 				TAILQ_INSERT_HEAD(&vmi->regions, reg, link);
@@ -162,7 +208,7 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 		} else {
 			va = select_va_in_range(prev_r->va + prev_r->size,
 						prev_r->attr, r->va, r->attr,
-						reg);
+						reg, block);
 			if (va) {
 				reg->va = va;
 				TAILQ_INSERT_BEFORE(r, reg, link);
@@ -175,7 +221,8 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 	r = TAILQ_LAST(&vmi->regions, vm_region_head);
 	if (r) {
 		va = select_va_in_range(r->va + r->size, r->attr,
-					va_range_base + va_range_size, 0, reg);
+					va_range_base + va_range_size, 0, reg,
+					block);
 		if (va) {
 			reg->va = va;
 			TAILQ_INSERT_TAIL(&vmi->regions, reg, link);
@@ -183,7 +230,8 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 		}
 	} else {
 		va = select_va_in_range(va_range_base, 0,
-					va_range_base + va_range_size, 0, reg);
+					va_range_base + va_range_size, 0, reg,
+					block);
 		if (va) {
 			reg->va = va;
 			TAILQ_INSERT_HEAD(&vmi->regions, reg, link);
@@ -194,20 +242,20 @@ static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
 	return TEE_ERROR_ACCESS_CONFLICT;
 }
 
-static size_t get_num_req_pgts(struct user_ta_ctx *utc, vaddr_t *begin,
+static size_t get_num_req_pgts(struct vm_info *vmi, vaddr_t *begin,
 			       vaddr_t *end)
 {
 	vaddr_t b;
 	vaddr_t e;
 
-	if (TAILQ_EMPTY(&utc->vm_info->regions)) {
+	if (TAILQ_EMPTY(&vmi->regions)) {
 		core_mmu_get_user_va_range(&b, NULL);
 		e = b;
 	} else {
 		struct vm_region *r;
 
-		b = TAILQ_FIRST(&utc->vm_info->regions)->va;
-		r = TAILQ_LAST(&utc->vm_info->regions, vm_region_head);
+		b = TAILQ_FIRST(&vmi->regions)->va;
+		r = TAILQ_LAST(&vmi->regions, vm_region_head);
 		e = r->va + r->size;
 		b = ROUNDDOWN(b, CORE_MMU_PGDIR_SIZE);
 		e = ROUNDUP(e, CORE_MMU_PGDIR_SIZE);
@@ -220,6 +268,39 @@ static size_t get_num_req_pgts(struct user_ta_ctx *utc, vaddr_t *begin,
 	return (e - b) >> CORE_MMU_PGDIR_SHIFT;
 }
 
+static TEE_Result umap_add_region(struct vm_info *vmi, struct vm_region *reg)
+{
+	TEE_Result res;
+
+	vmi->tlb_stale = true;
+
+	/* Check alignment, it has to be at least SMALL_PAGE based */
+	if ((reg->va | reg->size) & SMALL_PAGE_MASK)
+		return TEE_ERROR_ACCESS_CONFLICT;
+
+	/* Check that the mobj is defined for the entire range */
+	if ((reg->offset + reg->size) >
+	     ROUNDUP(reg->mobj->size, SMALL_PAGE_SIZE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/*
+	 * Placing the region for sections or blocks may move it far enough
+	 * to need more translation tables than are available, if so place
+	 * it as if it couldn't use sections or blocks.
+	 */
+	if (!reg->va) {
+		res = umap_insert_region(vmi, reg, true);
+		if (res)
+			return res;
+		if (pgt_check_avail(get_num_req_pgts(vmi, NULL, NULL)))
+			return TEE_SUCCESS;
+		TAILQ_REMOVE(&vmi->regions, reg, link);
+		reg->va = 0;
+	}
+
+	return umap_insert_region(vmi, reg, false);
+}
+
 TEE_Result vm_map(struct user_ta_ctx *utc, vaddr_t *va, size_t len,
 		  uint32_t prot, struct mobj *mobj, size_t offs)
 {
@@ -259,7 +340,7 @@ TEE_Result vm_map(struct user_ta_ctx *utc, vaddr_t *va, size_t len,
 	if (res)
 		goto err_free_reg;
 
-	if (!pgt_check_avail(get_num_req_pgts(utc, NULL, NULL))) {
+	if (!pgt_check_avail(get_num_req_pgts(utc->vm_info, NULL, NULL))) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto err_rem_reg;
 	}
@@ -316,6 +397,7 @@ TEE_Result vm_set_prot(struct user_ta_ctx *utc, vaddr_t va, size_t len,
 			}
 			r->attr &= ~TEE_MATTR_PROT_MASK;
 			r->attr |= prot & TEE_MATTR_PROT_MASK;
+			utc->vm_info->tlb_stale = true;
 			return TEE_SUCCESS;
 		}
 	}
@@ -323,37 +405,59 @@ TEE_Result vm_set_prot(struct user_ta_ctx *utc, vaddr_t va, size_t len,
 	return TEE_ERROR_ITEM_NOT_FOUND;
 }
 
-static unsigned int asid_alloc(void)
+static void asid_new_generation(void)
+{
+	struct vm_info *vmi;
+
+	g_asid_gen++;
+	/* Generation 0 means that no ASID has been assigned yet */
+	if (!g_asid_gen)
+		g_asid_gen++;
+
+	bit_nclear(g_asid, 0, MMU_NUM_ASIDS - 1);
+	TAILQ_FOREACH(vmi, &g_vm_info_head, link) {
+		if (vmi->asid_users) {
+			bit_set(g_asid, vmi->asid / 2 - 1);
+			vmi->asid_gen = g_asid_gen;
+		}
+	}
+}
+
+static void asid_get(struct vm_info *vmi)
 {
-	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
-	unsigned int r;
 	int i;
 
-	bit_ffc(g_asid, MMU_NUM_ASIDS, &i);
-	if (i == -1) {
-		r = 0;
-	} else {
+	if (vmi->asid_gen != g_asid_gen) {
+		bit_ffc(g_asid, MMU_NUM_ASIDS, &i);
+		if (i == -1) {
+			asid_new_generation();
+			bit_ffc(g_asid, MMU_NUM_ASIDS, &i);
+			/* At most CFG_NUM_THREADS - 1 ASIDs are kept */
+			if (i == -1)
+				panic();
+		}
 		bit_set(g_asid, i);
-		r = (i + 1) * 2;
+		vmi->asid = (i + 1) * 2;
+		vmi->asid_gen = g_asid_gen;
+		vmi->tlb_stale = true;
 	}
+	vmi->asid_users++;
+}
 
-	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
-	return r;
+static void asid_put(struct vm_info *vmi)
+{
+	assert(vmi->asid_users);
+	vmi->asid_users--;
 }
 
-static void asid_free(unsigned int asid)
+static void asid_switch(struct tee_ta_ctx *prev, struct tee_ta_ctx *next)
 {
 	uint32_t exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
 
-	/* Only even ASIDs are supposed to be allocated */
-	assert(!(asid & 1));
-
-	if (asid) {
-		int i = (asid - 1) / 2;
-
-		assert(i < MMU_NUM_ASIDS && bit_test(g_asid, i));
-		bit_clear(g_asid, i);
-	}
+	if (prev && is_user_ta_ctx(prev))
+		asid_put(to_user_ta_ctx(prev)->vm_info);
+	if (next && is_user_ta_ctx(next))
+		asid_get(to_user_ta_ctx(next)->vm_info);
 
 	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
 }
@@ -385,20 +489,18 @@ static TEE_Result map_kinit(struct user_ta_ctx *utc __maybe_unused)
 TEE_Result vm_info_init(struct user_ta_ctx *utc)
 {
 	TEE_Result res;
-	uint32_t asid = asid_alloc();
-
-	if (!asid) {
-		DMSG("Failed to allocate ASID");
-		return TEE_ERROR_GENERIC;
-	}
+	uint32_t exceptions;
 
 	utc->vm_info = calloc(1, sizeof(*utc->vm_info));
-	if (!utc->vm_info) {
-		asid_free(asid);
+	if (!utc->vm_info)
 		return TEE_ERROR_OUT_OF_MEMORY;
-	}
 	TAILQ_INIT(&utc->vm_info->regions);
-	utc->vm_info->asid = asid;
+
+	exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	g_vm_info_id++;
+	utc->vm_info->id = g_vm_info_id;
+	TAILQ_INSERT_TAIL(&g_vm_info_head, utc->vm_info, link);
+	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
 
 	res = map_kinit(utc);
 	if (res)
@@ -413,7 +515,7 @@ static TEE_Result alloc_pgt(struct user_ta_ctx *utc)
 	vaddr_t e;
 	size_t ntbl;
 
-	ntbl = get_num_req_pgts(utc, &b, &e);
+	ntbl = get_num_req_pgts(utc->vm_info, &b, &e);
 	if (!pgt_check_avail(ntbl)) {
 		EMSG("%zu page tables not available", ntbl);
 		return TEE_ERROR_OUT_OF_MEMORY;
@@ -446,6 +548,7 @@ static void free_pgt(struct user_ta_ctx *utc, vaddr_t base, size_t size)
 
 static void umap_remove_region(struct vm_info *vmi, struct vm_region *reg)
 {
+	vmi->tlb_stale = true;
 	TAILQ_REMOVE(&vmi->regions, reg, link);
 	free(reg);
 }
@@ -473,6 +576,8 @@ static TEE_Result param_mem_to_user_va(struct user_ta_ctx *utc,
 			continue;
 		if (mem->mobj != region->mobj)
 			continue;
+		if (mem->read_only != !(region->attr & TEE_MATTR_UW))
+			continue;
 		if (mem->offs < region->offset)
 			continue;
 		if (mem->offs >= (region->offset + region->size))
@@ -508,6 +613,10 @@ static int cmp_param_mem(const void *a0, const void *a1)
 	if (ret)
 		return ret;
 
+	ret = CMP_TRILEAN(m0->read_only, m1->read_only);
+	if (ret)
+		return ret;
+
 	ret = CMP_TRILEAN(m0->offs, m1->offs);
 	if (ret)
 		return ret;
@@ -535,6 +644,7 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 		phys_offs = mobj_get_phys_offs(param->u[n].mem.mobj,
 					       CORE_MMU_USER_PARAM_SIZE);
 		mem[n].mobj = param->u[n].mem.mobj;
+		mem[n].read_only = param->u[n].mem.read_only;
 		mem[n].offs = ROUNDDOWN(phys_offs + param->u[n].mem.offs,
 					CORE_MMU_USER_PARAM_SIZE);
 		mem[n].size = ROUNDUP(phys_offs + param->u[n].mem.offs -
@@ -544,8 +654,8 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 
 	/*
 	 * Sort arguments so size = 0 is last, secure mobjs first, then by
-	 * mobj pointer value since those entries can't be merged either,
-	 * finally by offset.
+	 * mobj pointer value and permissions since those entries can't be
+	 * merged either, finally by offset.
 	 *
 	 * This should result in a list where all mergeable entries are
 	 * next to each other and unused/invalid entries are at the end.
@@ -554,6 +664,7 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 
 	for (n = 1, m = 0; n < TEE_NUM_PARAMS && mem[n].size; n++) {
 		if (mem[n].mobj == mem[m].mobj &&
+		    mem[n].read_only == mem[m].read_only &&
 		    (mem[n].offs == (mem[m].offs + mem[m].size) ||
 		     core_is_buffer_intersect(mem[m].offs, mem[m].size,
 					      mem[n].offs, mem[n].size))) {
@@ -577,9 +688,12 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 
 	for (n = 0; n < m; n++) {
 		vaddr_t va = 0;
-		const uint32_t prot = TEE_MATTR_PRW | TEE_MATTR_URW |
-				      TEE_MATTR_EPHEMERAL;
+		uint32_t prot = TEE_MATTR_PRW | TEE_MATTR_URW |
+				TEE_MATTR_EPHEMERAL;
 
+		if (mem[n].read_only)
+			prot = TEE_MATTR_PR | TEE_MATTR_UR |
+			       TEE_MATTR_EPHEMERAL;
 		res = vm_map(utc, &va, mem[n].size, prot, mem[n].mobj,
 			     mem[n].offs);
 		if (res)
@@ -652,13 +766,18 @@ void tee_mmu_rem_rwmem(struct user_ta_ctx *utc, struct mobj *mobj, vaddr_t va)
 
 void vm_info_final(struct user_ta_ctx *utc)
 {
+	uint32_t exceptions;
+
 	if (!utc->vm_info)
 		return;
 
-	/* clear MMU entries to avoid clash when asid is reused */
-	tlbi_asid(utc->vm_info->asid);
+	exceptions = cpu_spin_lock_xsave(&g_asid_spinlock);
+	assert(!utc->vm_info->asid_users);
+	if (utc->vm_info->asid_gen == g_asid_gen)
+		bit_clear(g_asid, utc->vm_info->asid / 2 - 1);
+	TAILQ_REMOVE(&g_vm_info_head, utc->vm_info, link);
+	cpu_spin_unlock_xrestore(&g_asid_spinlock, exceptions);
 
-	asid_free(utc->vm_info->asid);
 	while (!TAILQ_EMPTY(&utc->vm_info->regions))
 		umap_remove_region(utc->vm_info,
 				   TAILQ_FIRST(&utc->vm_info->regions));
@@ -805,6 +924,10 @@ TEE_Result tee_mmu_user_pa2va_helper(const struct user_ta_ctx *utc,
 				size = region->size;
 
 			res = mobj_get_pa(region->mobj, ofs, granule, &p);
+			/* Not yet allocated pages of a demand-zero mobj */
+			if (res == TEE_ERROR_NO_DATA &&
+			    mobj_is_dz(region->mobj))
+				continue;
 			if (res != TEE_SUCCESS)
 				return res;
 
@@ -885,12 +1008,27 @@ void tee_mmu_set_ctx(struct tee_ta_ctx *ctx)
 	 * Save translation tables in a cache if it's a user TA.
 	 */
 	pgt_free(&tsd->pgt_cache, tsd->ctx && is_user_ta_ctx(tsd->ctx));
+	asid_switch(tsd->ctx, ctx);
 
 	if (ctx && is_user_ta_ctx(ctx)) {
 		struct core_mmu_user_map map;
 		struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
+		struct vm_info *vmi = utc->vm_info;
 
 		core_mmu_create_user_map(utc, &map);
+		if (vmi->thread_id != thread_get_id()) {
+			vmi->thread_id = thread_get_id();
+			vmi->tlb_stale = true;
+		}
+		/*
+		 * Only the entries of the ASID of the context may be stale,
+		 * global entries and entries of other ASIDs are kept. The
+		 * context isn't active anywhere at this point.
+		 */
+		if (vmi->tlb_stale) {
+			tlbi_asid(vmi->asid);
+			vmi->tlb_stale = false;
+		}
 		core_mmu_set_user_map(&map);
 		tee_pager_assign_uta_tables(utc);
 	}
@@ -902,6 +1040,73 @@ struct tee_ta_ctx *tee_mmu_get_ctx(void)
 	return thread_get_tsd()->ctx;
 }
 
+#ifdef CFG_DEMAND_ZERO_USER_TA
+static struct pgt *find_user_pgt(struct core_mmu_table_info *dir_info,
+				 vaddr_t va)
+{
+	struct pgt *pgt;
+	uint32_t attr;
+	paddr_t pa;
+
+	core_mmu_get_entry(dir_info, core_mmu_va2idx(dir_info, va), &pa,
+			   &attr);
+	if (!(attr & TEE_MATTR_TABLE))
+		return NULL;
+
+	SLIST_FOREACH(pgt, &thread_get_tsd()->pgt_cache, link)
+		if (virt_to_phys(pgt->tbl) == pa)
+			return pgt;
+
+	return NULL;
+}
+
+bool tee_mmu_handle_dz_fault(struct abort_info *ai)
+{
+	struct tee_ta_ctx *ctx = thread_get_tsd()->ctx;
+	vaddr_t page_va = ai->va & ~SMALL_PAGE_MASK;
+	struct core_mmu_table_info dir_info;
+	struct user_ta_ctx *utc;
+	struct vm_region *r;
+	struct pgt *pgt;
+	unsigned int idx;
+	paddr_t pa;
+
+	if (core_mmu_get_fault_type(ai->fault_descr) !=
+	    CORE_MMU_FAULT_TRANSLATION)
+		return false;
+	if (!ctx || !is_user_ta_ctx(ctx))
+		return false;
+	utc = to_user_ta_ctx(ctx);
+
+	TAILQ_FOREACH(r, &utc->vm_info->regions, link)
+		if (core_is_buffer_inside(page_va, 1, r->va, r->size))
+			break;
+	if (!r || !mobj_is_dz(r->mobj))
+		return false;
+
+	core_mmu_get_user_pgdir(&dir_info);
+	pgt = find_user_pgt(&dir_info, page_va);
+	if (!pgt)
+		return false;
+
+	if (mobj_dz_get_page(r->mobj, page_va - r->va + r->offset, &pa)) {
+		EMSG("Failed to allocate page for %#" PRIxVA, page_va);
+		return false;
+	}
+
+	idx = (page_va & CORE_MMU_PGDIR_MASK) >> SMALL_PAGE_SHIFT;
+	core_mmu_set_entry_primitive(pgt->tbl, dir_info.level + 1, idx, pa,
+				     r->attr);
+	/*
+	 * No need to invalidate the TLB since there wasn't a valid mapping
+	 * before, but the update must be visible before returning.
+	 */
+	dsb_ishst();
+
+	return true;
+}
+#endif /*CFG_DEMAND_ZERO_USER_TA*/
+
 void teecore_init_ta_ram(void)
 {
 	vaddr_t s;
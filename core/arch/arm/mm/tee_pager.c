@@ -35,6 +35,7 @@
 #include <keep.h>
 #include <kernel/abort.h>
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/panic.h>
 #include <kernel/spinlock.h>
 #include <kernel/tee_misc.h>
@@ -105,10 +106,16 @@ struct tee_pager_pmem {
 	unsigned pgidx;
 	void *va_alias;
 	struct tee_pager_area *area;
+#ifdef CFG_PAGER_POLICY_LRU
+	uint8_t age;
+#endif
 	TAILQ_ENTRY(tee_pager_pmem) link;
 };
 
-/* The list of physical pages. The first page in the list is the oldest */
+/*
+ * The list of physical pages. The first page in the list is the oldest,
+ * or with CFG_PAGER_POLICY_CLOCK the one under the clock hand.
+ */
 TAILQ_HEAD(tee_pager_pmem_head, tee_pager_pmem);
 
 static struct tee_pager_pmem_head tee_pager_pmem_head =
@@ -127,6 +134,7 @@ static size_t tee_pager_npages;
 
 #ifdef CFG_WITH_STATS
 static struct tee_pager_stats pager_stats;
+static uint64_t pager_stats_cntpct;
 
 static inline void incr_ro_hits(void)
 {
@@ -158,14 +166,65 @@ static inline void set_npages(void)
 	pager_stats.npages = tee_pager_npages;
 }
 
+static inline void incr_faults(void)
+{
+	pager_stats.faults++;
+}
+
+static inline void incr_unlocked_loads(void)
+{
+	pager_stats.unlocked_loads++;
+}
+
+static inline void incr_reserve_refills(void)
+{
+	pager_stats.reserve_refills++;
+}
+
+static inline void incr_fault_around(void)
+{
+	pager_stats.fault_around++;
+}
+
+/* Counter value when the pager lock was taken, protected by the lock */
+static uint64_t pager_lock_cntpct;
+
+static inline uint64_t stat_lock_wait_begin(void)
+{
+	return read_cntpct();
+}
+
+static inline void stat_lock_acquired(uint64_t wait_begin)
+{
+	pager_lock_cntpct = read_cntpct();
+	pager_stats.lock_count++;
+	pager_stats.lock_wait_ticks += pager_lock_cntpct - wait_begin;
+}
+
+static inline void stat_lock_release(void)
+{
+	pager_stats.lock_hold_ticks += read_cntpct() - pager_lock_cntpct;
+}
+
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
+	uint64_t cntpct = read_cntpct();
+
 	*stats = pager_stats;
+	stats->ticks = cntpct - pager_stats_cntpct;
 
 	pager_stats.hidden_hits = 0;
 	pager_stats.ro_hits = 0;
 	pager_stats.rw_hits = 0;
 	pager_stats.zi_released = 0;
+	pager_stats.faults = 0;
+	pager_stats.lock_count = 0;
+	pager_stats.lock_wait_ticks = 0;
+	pager_stats.lock_hold_ticks = 0;
+	pager_stats.unlocked_loads = 0;
+	pager_stats.reserve_refills = 0;
+	pager_stats.fault_around = 0;
+	pager_stats_cntpct = cntpct;
 }
 
 #else /* CFG_WITH_STATS */
@@ -175,6 +234,13 @@ static inline void incr_hidden_hits(void) { }
 static inline void incr_zi_released(void) { }
 static inline void incr_npages_all(void) { }
 static inline void set_npages(void) { }
+static inline void incr_faults(void) { }
+static inline void incr_unlocked_loads(void) { }
+static inline void incr_reserve_refills(void) { }
+static inline void incr_fault_around(void) { }
+static inline uint64_t stat_lock_wait_begin(void) { return 0; }
+static inline void stat_lock_acquired(uint64_t wait_begin __unused) { }
+static inline void stat_lock_release(void) { }
 
 void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
@@ -214,6 +280,7 @@ static uint32_t pager_lock_dldetect(const char *func, const int line,
 				    struct abort_info *ai)
 {
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	uint64_t wait_begin = stat_lock_wait_begin();
 	unsigned int retries = 0;
 	unsigned int reminder = 0;
 
@@ -230,13 +297,20 @@ static uint32_t pager_lock_dldetect(const char *func, const int line,
 				abort_print(ai);
 		}
 	}
+	stat_lock_acquired(wait_begin);
 
 	return exceptions;
 }
 #else
 static uint32_t pager_lock(struct abort_info __unused *ai)
 {
-	return cpu_spin_lock_xsave(&pager_spinlock);
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	uint64_t wait_begin = stat_lock_wait_begin();
+
+	cpu_spin_lock(&pager_spinlock);
+	stat_lock_acquired(wait_begin);
+
+	return exceptions;
 }
 #endif
 
@@ -264,6 +338,7 @@ static uint32_t pager_lock_check_stack(size_t stack_size)
 
 static void pager_unlock(uint32_t exceptions)
 {
+	stat_lock_release();
 	cpu_spin_unlock_xrestore(&pager_spinlock, exceptions);
 }
 
@@ -643,17 +718,22 @@ static paddr_t get_pmem_pa(struct tee_pager_pmem *pmem)
 	return pa;
 }
 
-static bool decrypt_page(struct pager_rw_pstate *rwp, const void *src,
-			void *dst)
+/*
+ * Decrypts the page src saved with the state @state, which is @rwp or a
+ * copy of it. The address of @rwp is part of the IV.
+ */
+static bool decrypt_page(struct pager_rw_pstate *rwp,
+			 const struct pager_rw_pstate *state, const void *src,
+			 void *dst)
 {
 	struct pager_aes_gcm_iv iv = {
-		{ (vaddr_t)rwp, rwp->iv >> 32, rwp->iv }
+		{ (vaddr_t)rwp, state->iv >> 32, state->iv }
 	};
-	size_t tag_len = sizeof(rwp->tag);
+	size_t tag_len = sizeof(state->tag);
 
 	return !internal_aes_gcm_dec(&pager_ae_key, &iv, sizeof(iv),
 				     NULL, 0, src, SMALL_PAGE_SIZE, dst,
-				     rwp->tag, tag_len);
+				     state->tag, tag_len);
 }
 
 static void encrypt_page(struct pager_rw_pstate *rwp, void *src, void *dst)
@@ -678,8 +758,16 @@ static void encrypt_page(struct pager_rw_pstate *rwp, void *src, void *dst)
 		panic("gcm failed");
 }
 
-static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
-			void *va_alias)
+/*
+ * Loads the content of the page at page_va into va_alias. A read-write
+ * page is normally decrypted using the state of the page in the area,
+ * if rwp_copy isn't NULL it's decrypted using that copy of the state
+ * instead and false is returned if the decryption fails. In all other
+ * cases a page which can't be verified is fatal.
+ */
+static bool tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
+				void *va_alias,
+				const struct pager_rw_pstate *rwp_copy)
 {
 	size_t idx = (page_va - area->base) >> SMALL_PAGE_SHIFT;
 	const void *stored_page = area->store + idx * SMALL_PAGE_SIZE;
@@ -687,6 +775,7 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 	uint32_t attr_alias;
 	paddr_t pa_alias;
 	unsigned int idx_alias;
+	bool ret = true;
 
 	/* Insure we are allowed to write to aliased virtual page */
 	ti = find_table_info((vaddr_t)va_alias);
@@ -706,7 +795,6 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 					   idx * TEE_SHA256_HASH_SIZE;
 
 			memcpy(va_alias, stored_page, SMALL_PAGE_SIZE);
-			incr_ro_hits();
 
 			if (hash_sha256_check(hash, va_alias,
 					      SMALL_PAGE_SIZE) != TEE_SUCCESS) {
@@ -720,16 +808,21 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 		tlbi_mva_allasid((vaddr_t)va_alias);
 		break;
 	case AREA_TYPE_RW:
+		if (!rwp_copy)
+			rwp_copy = area->u.rwp + idx;
 		FMSG("Restore %p %#" PRIxVA " iv %#" PRIx64,
-			va_alias, page_va, area->u.rwp[idx].iv);
-		if (!area->u.rwp[idx].iv)
+			va_alias, page_va, rwp_copy->iv);
+		if (!rwp_copy->iv) {
 			memset(va_alias, 0, SMALL_PAGE_SIZE);
-		else if (!decrypt_page(&area->u.rwp[idx], stored_page,
-				       va_alias)) {
+		} else if (!decrypt_page(area->u.rwp + idx, rwp_copy,
+					 stored_page, va_alias)) {
+			if (rwp_copy != area->u.rwp + idx) {
+				ret = false;
+				break;
+			}
 			EMSG("PH 0x%" PRIxVA " failed", page_va);
 			panic();
 		}
-		incr_rw_hits();
 		break;
 	case AREA_TYPE_LOCK:
 		FMSG("Zero init %p %#" PRIxVA, va_alias, page_va);
@@ -739,6 +832,8 @@ static void tee_pager_load_page(struct tee_pager_area *area, vaddr_t page_va,
 		panic();
 	}
 	asan_tag_no_access(va_alias, (uint8_t *)va_alias + SMALL_PAGE_SIZE);
+
+	return ret;
 }
 
 static void tee_pager_save_page(struct tee_pager_pmem *pmem, uint32_t attr)
@@ -764,7 +859,55 @@ static void tee_pager_save_page(struct tee_pager_pmem *pmem, uint32_t attr)
 	}
 }
 
+#if CFG_PAGER_CPU_RESERVE > 0
+/*
+ * Each CPU keeps a reserve of clean pages, unmapped and taken out of
+ * tee_pager_pmem_head, which pages are loaded into without holding the
+ * pager lock. An empty reserve is refilled with a batch of pages evicted
+ * from the global list, the reserves are given back to the global list
+ * when it runs short of pages.
+ */
+struct pager_reserve {
+	struct tee_pager_pmem *pmem[CFG_PAGER_CPU_RESERVE];
+	size_t count;
+	/* Area of the page loaded without holding the lock, or NULL */
+	struct tee_pager_area *loading_area;
+};
+
+static struct pager_reserve pager_reserves[CFG_TEE_CORE_NB_CORE];
+#endif
+
 #ifdef CFG_PAGED_USER_TA
+#if CFG_PAGER_CPU_RESERVE > 0
+/*
+ * Waits until no CPU is loading a page of the area without holding the
+ * lock, called with the lock held. The lock is released while waiting.
+ */
+static uint32_t pager_wait_unlocked_loads(struct tee_pager_area *area,
+					  uint32_t exceptions)
+{
+	size_t n = 0;
+
+	while (n < CFG_TEE_CORE_NB_CORE) {
+		if (pager_reserves[n].loading_area == area) {
+			pager_unlock(exceptions);
+			exceptions = pager_lock(NULL);
+		} else {
+			n++;
+		}
+	}
+
+	return exceptions;
+}
+#else
+static uint32_t pager_wait_unlocked_loads(
+			struct tee_pager_area *area __unused,
+			uint32_t exceptions)
+{
+	return exceptions;
+}
+#endif
+
 static void free_area(struct tee_pager_area *area)
 {
 	tee_mm_free(tee_mm_find(&tee_mm_sec_ddr,
@@ -774,6 +917,16 @@ static void free_area(struct tee_pager_area *area)
 	free(area);
 }
 
+bool tee_pager_init_uta_areas(struct user_ta_ctx *utc)
+{
+	assert(!utc->areas);
+	utc->areas = malloc(sizeof(*utc->areas));
+	if (!utc->areas)
+		return false;
+	TAILQ_INIT(utc->areas);
+	return true;
+}
+
 static bool pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base,
 			       size_t size)
 {
@@ -782,12 +935,8 @@ static bool pager_add_uta_area(struct user_ta_ctx *utc, vaddr_t base,
 	vaddr_t b = base;
 	size_t s = ROUNDUP(size, SMALL_PAGE_SIZE);
 
-	if (!utc->areas) {
-		utc->areas = malloc(sizeof(*utc->areas));
-		if (!utc->areas)
-			return false;
-		TAILQ_INIT(utc->areas);
-	}
+	if (!utc->areas && !tee_pager_init_uta_areas(utc))
+		return false;
 
 	flags = TEE_MATTR_PRW | TEE_MATTR_URWX;
 
@@ -981,6 +1130,7 @@ static void rem_area(struct tee_pager_area_head *area_head,
 	uint32_t exceptions;
 
 	exceptions = pager_lock_check_stack(64);
+	exceptions = pager_wait_unlocked_loads(area, exceptions);
 
 	TAILQ_REMOVE(area_head, area, link);
 
@@ -1105,6 +1255,220 @@ out:
 KEEP_PAGER(tee_pager_set_uta_area_attr);
 #endif /*CFG_PAGED_USER_TA*/
 
+/* Hides a mapped page, returns false if the page isn't mapped */
+static bool pmem_hide(struct tee_pager_pmem *pmem)
+{
+	paddr_t pa;
+	uint32_t attr;
+	uint32_t a;
+
+	/* we cannot hide pages when pmem->area is not defined. */
+	if (!pmem->area)
+		return false;
+
+	area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
+	if (!(attr & TEE_MATTR_VALID_BLOCK))
+		return false;
+
+	assert(pa == get_pmem_pa(pmem));
+	if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
+		a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
+		FMSG("Hide %#" PRIxVA,
+		     area_idx2va(pmem->area, pmem->pgidx));
+	} else
+		a = TEE_MATTR_HIDDEN_BLOCK;
+
+	area_set_entry(pmem->area, pmem->pgidx, pa, a);
+	tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
+	return true;
+}
+
+static bool pmem_is_mapped(struct tee_pager_pmem *pmem)
+{
+	uint32_t attr;
+
+	if (!pmem->area)
+		return false;
+
+	area_get_entry(pmem->area, pmem->pgidx, NULL, &attr);
+	return attr & TEE_MATTR_VALID_BLOCK;
+}
+
+/*
+ * Page replacement policies
+ *
+ * A hidden page is mapped again on the next access to it, which makes
+ * hiding pages the software equivalent of clearing the accessed flag.
+ * Each policy provides:
+ * pager_policy_get_victim()		returns the page to evict next
+ * pager_policy_get_idle_victim()	returns a page to evict which isn't
+ *					mapped, or NULL, without hiding
+ *					pages or moving the clock hand
+ * pager_policy_page_loaded()		a page has just been (re)mapped
+ * pager_policy_page_referenced()	a hidden page has been accessed
+ * pager_policy_fault_done()		a fault has been handled
+ */
+#if defined(CFG_PAGER_POLICY_CLOCK)
+/*
+ * CLOCK, or second chance. The list of pages is the clock face with the
+ * hand at its head. A page which is mapped when the hand passes is
+ * hidden and skipped, a page which still is hidden, or not used at all,
+ * when the hand comes back is evicted. Pages are only hidden when a page
+ * is needed.
+ */
+static struct tee_pager_pmem *pager_policy_get_victim(void)
+{
+	struct tee_pager_pmem *pmem;
+
+	/* Terminates since all pages are hidden after one turn */
+	while ((pmem = TAILQ_FIRST(&tee_pager_pmem_head))) {
+		if (!pmem_hide(pmem))
+			return pmem;
+		TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+		TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	}
+
+	return NULL;
+}
+
+/*
+ * The first page from the hand which is unused or still hidden, it
+ * hasn't been accessed since the hand last passed.
+ */
+static struct tee_pager_pmem *pager_policy_get_idle_victim(void)
+{
+	struct tee_pager_pmem *pmem;
+
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link)
+		if (!pmem_is_mapped(pmem))
+			return pmem;
+
+	return NULL;
+}
+
+static void pager_policy_page_loaded(struct tee_pager_pmem *pmem __unused)
+{
+}
+
+static void pager_policy_page_referenced(struct tee_pager_pmem *pmem __unused)
+{
+}
+
+static void pager_policy_fault_done(void)
+{
+}
+#elif defined(CFG_PAGER_POLICY_LRU)
+/*
+ * LRU approximation by aging. Every PAGER_LRU_SAMPLE_FAULTS faults the
+ * accessed state of all pages is sampled into the most significant bit
+ * of their age and the pages are hidden again. The page with the lowest
+ * age is evicted, the oldest one if there are several.
+ */
+#define PAGER_LRU_SAMPLE_FAULTS	8
+#define PAGER_LRU_REFERENCED	BIT(7)
+
+static size_t pager_lru_nfaults;
+
+static struct tee_pager_pmem *pager_policy_get_victim(void)
+{
+	struct tee_pager_pmem *victim = NULL;
+	struct tee_pager_pmem *pmem;
+
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		if (!pmem->area)
+			return pmem;
+		if (!victim || pmem->age < victim->age)
+			victim = pmem;
+	}
+
+	return victim;
+}
+
+static struct tee_pager_pmem *pager_policy_get_idle_victim(void)
+{
+	struct tee_pager_pmem *victim = NULL;
+	struct tee_pager_pmem *pmem;
+
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		if (!pmem->area)
+			return pmem;
+		if (pmem_is_mapped(pmem))
+			continue;
+		if (!victim || pmem->age < victim->age)
+			victim = pmem;
+	}
+
+	return victim;
+}
+
+static void pager_policy_page_loaded(struct tee_pager_pmem *pmem)
+{
+	pmem->age = PAGER_LRU_REFERENCED;
+}
+
+static void pager_policy_page_referenced(struct tee_pager_pmem *pmem __unused)
+{
+}
+
+static void pager_policy_fault_done(void)
+{
+	struct tee_pager_pmem *pmem;
+
+	pager_lru_nfaults++;
+	if (pager_lru_nfaults % PAGER_LRU_SAMPLE_FAULTS)
+		return;
+
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		pmem->age >>= 1;
+		if (pmem_hide(pmem))
+			pmem->age |= PAGER_LRU_REFERENCED;
+	}
+}
+#else
+/*
+ * FIFO, the oldest page is evicted. After each fault the
+ * TEE_PAGER_NHIDE oldest pages are hidden, a page which is accessed
+ * while hidden is moved to the back of the list.
+ */
+static struct tee_pager_pmem *pager_policy_get_victim(void)
+{
+	return TAILQ_FIRST(&tee_pager_pmem_head);
+}
+
+static struct tee_pager_pmem *pager_policy_get_idle_victim(void)
+{
+	struct tee_pager_pmem *pmem = TAILQ_FIRST(&tee_pager_pmem_head);
+
+	if (pmem && pmem_is_mapped(pmem))
+		return NULL;
+	return pmem;
+}
+
+static void pager_policy_page_loaded(struct tee_pager_pmem *pmem __unused)
+{
+}
+
+static void pager_policy_page_referenced(struct tee_pager_pmem *pmem)
+{
+	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+	TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+}
+
+static void pager_policy_fault_done(void)
+{
+	struct tee_pager_pmem *pmem;
+	size_t n = 0;
+
+	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
+		if (n >= TEE_PAGER_NHIDE)
+			break;
+		n++;
+
+		pmem_hide(pmem);
+	}
+}
+#endif
+
 static bool tee_pager_unhide_page(vaddr_t page_va)
 {
 	struct tee_pager_pmem *pmem;
@@ -1150,8 +1514,7 @@ static bool tee_pager_unhide_page(vaddr_t page_va)
 			 */
 			dsb_ishst();
 
-			TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
-			TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+			pager_policy_page_referenced(pmem);
 			incr_hidden_hits();
 			return true;
 		}
@@ -1160,41 +1523,6 @@ static bool tee_pager_unhide_page(vaddr_t page_va)
 	return false;
 }
 
-static void tee_pager_hide_pages(void)
-{
-	struct tee_pager_pmem *pmem;
-	size_t n = 0;
-
-	TAILQ_FOREACH(pmem, &tee_pager_pmem_head, link) {
-		paddr_t pa;
-		uint32_t attr;
-		uint32_t a;
-
-		if (n >= TEE_PAGER_NHIDE)
-			break;
-		n++;
-
-		/* we cannot hide pages when pmem->area is not defined. */
-		if (!pmem->area)
-			continue;
-
-		area_get_entry(pmem->area, pmem->pgidx, &pa, &attr);
-		if (!(attr & TEE_MATTR_VALID_BLOCK))
-			continue;
-
-		assert(pa == get_pmem_pa(pmem));
-		if (attr & (TEE_MATTR_PW | TEE_MATTR_UW)){
-			a = TEE_MATTR_HIDDEN_DIRTY_BLOCK;
-			FMSG("Hide %#" PRIxVA,
-			     area_idx2va(pmem->area, pmem->pgidx));
-		} else
-			a = TEE_MATTR_HIDDEN_BLOCK;
-
-		area_set_entry(pmem->area, pmem->pgidx, pa, a);
-		tlbi_mva_allasid(area_idx2va(pmem->area, pmem->pgidx));
-	}
-}
-
 /*
  * Find mapped pmem, hide and move to pageble pmem.
  * Return false if page was not mapped, and true if page was mapped.
@@ -1232,16 +1560,9 @@ static bool tee_pager_release_one_phys(struct tee_pager_area *area,
 	return false;
 }
 
-/* Finds the oldest page and unmats it from its old virtual address */
-static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
+/* Unmaps the page from its virtual address, saving it first if needed */
+static void pmem_evict(struct tee_pager_pmem *pmem)
 {
-	struct tee_pager_pmem *pmem;
-
-	pmem = TAILQ_FIRST(&tee_pager_pmem_head);
-	if (!pmem) {
-		EMSG("No pmem entries");
-		return NULL;
-	}
 	if (pmem->pgidx != INVALID_PGIDX) {
 		uint32_t a;
 
@@ -1253,9 +1574,122 @@ static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area)
 		tee_pager_save_page(pmem, a);
 	}
 
-	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
 	pmem->pgidx = INVALID_PGIDX;
 	pmem->area = NULL;
+}
+
+#if CFG_PAGER_CPU_RESERVE > 0
+/*
+ * Reserves aren't refilled when there are fewer pages than this left in
+ * the global list, those pages are needed by the lock areas and the
+ * working set. Below half of that the reserves are given back.
+ */
+#define PAGER_RESERVE_MIN_NPAGES \
+	(4 * CFG_PAGER_CPU_RESERVE * CFG_TEE_CORE_NB_CORE)
+
+/*
+ * Gives the pages of all reserves back to the global list, called with
+ * the lock held. Returns true if any page was given back.
+ */
+static bool pager_reserve_release_all(void)
+{
+	struct pager_reserve *r;
+	bool ret = false;
+	size_t n;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
+		r = pager_reserves + n;
+		while (r->count) {
+			r->count--;
+			TAILQ_INSERT_HEAD(&tee_pager_pmem_head,
+					  r->pmem[r->count], link);
+			tee_pager_npages++;
+			ret = true;
+		}
+	}
+	if (ret)
+		set_npages();
+
+	return ret;
+}
+
+/* Takes a page from the reserve of this CPU, called with the lock held */
+static struct tee_pager_pmem *pager_reserve_get(void)
+{
+	struct pager_reserve *r = pager_reserves + get_core_pos();
+	struct tee_pager_pmem *pmem;
+
+	if (tee_pager_npages < PAGER_RESERVE_MIN_NPAGES / 2) {
+		pager_reserve_release_all();
+		return NULL;
+	}
+
+	if (!r->count) {
+		if (tee_pager_npages < PAGER_RESERVE_MIN_NPAGES)
+			return NULL;
+
+		while (r->count < CFG_PAGER_CPU_RESERVE) {
+			pmem = pager_policy_get_victim();
+			if (!pmem)
+				break;
+			pmem_evict(pmem);
+			TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
+			tee_pager_npages--;
+			r->pmem[r->count] = pmem;
+			r->count++;
+		}
+		set_npages();
+		incr_reserve_refills();
+		if (!r->count)
+			return NULL;
+	}
+
+	r->count--;
+	return r->pmem[r->count];
+}
+
+/* Gives back an unused page to the reserve of this CPU */
+static void pager_reserve_put(struct tee_pager_pmem *pmem)
+{
+	struct pager_reserve *r = pager_reserves + get_core_pos();
+
+	assert(r->count < CFG_PAGER_CPU_RESERVE);
+	r->pmem[r->count] = pmem;
+	r->count++;
+}
+#else
+static bool pager_reserve_release_all(void)
+{
+	return false;
+}
+#endif
+
+/*
+ * Finds the page to evict, according to the replacement policy, and
+ * unmaps it from its old virtual address. If idle_only is true only a
+ * page which isn't mapped is taken, and the state of the other pages is
+ * left untouched, NULL is returned if there's no such page.
+ */
+static struct tee_pager_pmem *tee_pager_get_page(struct tee_pager_area *area,
+						 bool idle_only)
+{
+	struct tee_pager_pmem *pmem;
+
+	if (idle_only)
+		pmem = pager_policy_get_idle_victim();
+	else
+		pmem = pager_policy_get_victim();
+	/* Take the pages of the reserves back before giving up */
+	if (!pmem && !idle_only && pager_reserve_release_all())
+		pmem = pager_policy_get_victim();
+	if (!pmem) {
+		if (!idle_only)
+			EMSG("No pmem entries");
+		return NULL;
+	}
+
+	pmem_evict(pmem);
+	TAILQ_REMOVE(&tee_pager_pmem_head, pmem, link);
 	if (area->type == AREA_TYPE_LOCK) {
 		/* Move page to lock list */
 		if (tee_pager_npages <= 0)
@@ -1377,6 +1811,231 @@ static void stat_handle_fault(void)
 }
 #endif
 
+/* Counts a page loaded to resolve a fault, not a fault-around page */
+static void incr_area_hits(struct tee_pager_area *area)
+{
+	if (area->type == AREA_TYPE_RO)
+		incr_ro_hits();
+	else if (area->type == AREA_TYPE_RW)
+		incr_rw_hits();
+}
+
+/* Maps pmem, already loaded with the content of the page, at page_va */
+static void pager_map_page(struct tee_pager_area *area,
+			   struct tee_pager_pmem *pmem, vaddr_t page_va)
+{
+	uint32_t attr;
+	paddr_t pa;
+
+	pmem->area = area;
+	pmem->pgidx = area_va2idx(area, page_va);
+	attr = get_area_mattr(area->flags) & ~(TEE_MATTR_PW | TEE_MATTR_UW);
+	pa = get_pmem_pa(pmem);
+
+	/*
+	 * We've updated the page using the aliased mapping and
+	 * some cache maintenence is now needed if it's an
+	 * executable page.
+	 *
+	 * Since the d-cache is a Physically-indexed,
+	 * physically-tagged (PIPT) cache we can clean either the
+	 * aliased address or the real virtual address. In this
+	 * case we choose the real virtual address.
+	 *
+	 * The i-cache can also be PIPT, but may be something else
+	 * too like VIPT. The current code requires the caches to
+	 * implement the IVIPT extension, that is:
+	 * "instruction cache maintenance is required only after
+	 * writing new data to a physical address that holds an
+	 * instruction."
+	 *
+	 * To portably invalidate the icache the page has to
+	 * be mapped at the final virtual address but not
+	 * executable.
+	 */
+	if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
+		uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
+				TEE_MATTR_PW | TEE_MATTR_UW;
+
+		/* Set a temporary read-only mapping */
+		area_set_entry(pmem->area, pmem->pgidx, pa, attr & ~mask);
+		tlbi_mva_allasid(page_va);
+
+		/*
+		 * Doing these operations to LoUIS (Level of
+		 * unification, Inner Shareable) would be enough
+		 */
+		cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+		cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
+			       SMALL_PAGE_SIZE);
+
+		/* Set the final mapping */
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		tlbi_mva_allasid(page_va);
+	} else {
+		area_set_entry(area, pmem->pgidx, pa, attr);
+		/*
+		 * No need to flush TLB for this entry, it was
+		 * invalid. We should use a barrier though, to make
+		 * sure that the change is visible.
+		 */
+		dsb_ishst();
+	}
+	pgt_inc_used_entries(area->pgt);
+	pager_policy_page_loaded(pmem);
+
+	FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
+}
+
+#if CFG_PAGER_FAULT_AROUND > 1
+#if CFG_PAGER_FAULT_AROUND & (CFG_PAGER_FAULT_AROUND - 1)
+#error CFG_PAGER_FAULT_AROUND must be a power of 2
+#endif
+
+/* Returns true if the page can be loaded again from its backing store */
+static bool pager_can_read_ahead(struct tee_pager_area *area, vaddr_t va)
+{
+	size_t idx = (va - area->base) >> SMALL_PAGE_SHIFT;
+	uint32_t attr;
+
+	area_get_entry(area, area_va2idx(area, va), NULL, &attr);
+	if (attr & (TEE_MATTR_VALID_BLOCK | TEE_MATTR_HIDDEN_BLOCK |
+		    TEE_MATTR_HIDDEN_DIRTY_BLOCK))
+		return false; /* Already resident */
+
+	switch (area->type) {
+	case AREA_TYPE_RO:
+		return true;
+	case AREA_TYPE_RW:
+		/* A page which never has been saved is a zero page */
+		return area->u.rwp[idx].iv;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Speculatively loads the pages surrounding page_va inside the aligned
+ * window of CFG_PAGER_FAULT_AROUND pages. Only pages which are free or
+ * hidden are used, a mapped page is never evicted to make room for a
+ * page which may not be needed. At most a quarter of the pageable
+ * pages are used for each fault to keep the working set from being
+ * flushed.
+ */
+static void pager_fault_around(struct tee_pager_area *area, vaddr_t page_va)
+{
+	const size_t window_size = CFG_PAGER_FAULT_AROUND * SMALL_PAGE_SIZE;
+	vaddr_t start = MAX(ROUNDDOWN(page_va, window_size), area->base);
+	vaddr_t end = MIN(ROUNDDOWN(page_va, window_size) + window_size,
+			  area->base + area->size);
+	size_t max_pages = MIN((size_t)CFG_PAGER_FAULT_AROUND - 1,
+			       tee_pager_npages / 4);
+	struct tee_pager_pmem *pmem;
+	size_t n = 0;
+	vaddr_t va;
+
+	if (area->type == AREA_TYPE_LOCK)
+		return;
+
+	for (va = start; va < end && n < max_pages; va += SMALL_PAGE_SIZE) {
+		if (va == page_va || !pager_can_read_ahead(area, va))
+			continue;
+
+		pmem = tee_pager_get_page(area, true);
+		if (!pmem)
+			break;
+		tee_pager_load_page(area, va, pmem->va_alias, NULL);
+		pager_map_page(area, pmem, va);
+		incr_fault_around();
+		n++;
+	}
+}
+#else
+static void pager_fault_around(struct tee_pager_area *area __unused,
+			       vaddr_t page_va __unused)
+{
+}
+#endif
+
+#if CFG_PAGER_CPU_RESERVE > 0
+/*
+ * Loads a page into a page from the reserve of this CPU and maps it. The
+ * pager lock is released while the page is copied and its hash checked,
+ * or while it's decrypted, exceptions are kept masked so we stay on this
+ * CPU. The area can't be removed meanwhile, see
+ * pager_wait_unlocked_loads(). Another CPU may have mapped the page in
+ * the meantime in which case the loaded copy is dropped. The stored
+ * content of a read-write page changes each time the page is saved, so
+ * the state of the page is copied before the lock is released and if
+ * the page has been saved again when the lock is taken back the loaded
+ * copy is dropped too. Returns false if the page has to be loaded with
+ * the lock held instead.
+ */
+static bool pager_load_unlocked(struct tee_pager_area *area,
+				vaddr_t page_va, struct abort_info *ai)
+{
+	struct pager_reserve *r = pager_reserves + get_core_pos();
+	struct pager_rw_pstate *rwp = NULL;
+	struct pager_rw_pstate rwp_copy;
+	struct tee_pager_pmem *pmem;
+	uint32_t attr;
+	bool loaded;
+
+	if (area->type != AREA_TYPE_RO && area->type != AREA_TYPE_RW)
+		return false;
+
+	pmem = pager_reserve_get();
+	if (!pmem)
+		return false;
+
+	if (area->type == AREA_TYPE_RW) {
+		rwp = area->u.rwp + ((page_va - area->base) >> SMALL_PAGE_SHIFT);
+		rwp_copy = *rwp;
+	}
+	r->loading_area = area;
+
+	pager_unlock(THREAD_EXCP_ALL);
+	loaded = tee_pager_load_page(area, page_va, pmem->va_alias,
+				     rwp ? &rwp_copy : NULL);
+	pager_lock(ai);
+
+	r->loading_area = NULL;
+
+	area_get_entry(area, area_va2idx(area, page_va), NULL, &attr);
+	if (attr & (TEE_MATTR_VALID_BLOCK | TEE_MATTR_HIDDEN_BLOCK |
+		    TEE_MATTR_HIDDEN_DIRTY_BLOCK)) {
+		pager_reserve_put(pmem);
+		return true;
+	}
+
+	if (rwp && rwp->iv != rwp_copy.iv) {
+		pager_reserve_put(pmem);
+		return false;
+	}
+
+	if (!loaded) {
+		EMSG("PH 0x%" PRIxVA " failed", page_va);
+		panic();
+	}
+
+	TAILQ_INSERT_TAIL(&tee_pager_pmem_head, pmem, link);
+	tee_pager_npages++;
+	set_npages();
+	pager_map_page(area, pmem, page_va);
+	incr_area_hits(area);
+	incr_unlocked_loads();
+	return true;
+}
+#else
+static bool pager_load_unlocked(struct tee_pager_area *area __unused,
+				vaddr_t page_va __unused,
+				struct abort_info *ai __unused)
+{
+	return false;
+}
+#endif
+
 bool tee_pager_handle_fault(struct abort_info *ai)
 {
 	struct tee_pager_area *area;
@@ -1402,6 +2061,7 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 	exceptions = pager_lock(ai);
 
 	stat_handle_fault();
+	incr_faults();
 
 	/* check if the access is valid */
 	if (abort_is_user_exception(ai)) {
@@ -1419,8 +2079,6 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 
 	if (!tee_pager_unhide_page(page_va)) {
 		struct tee_pager_pmem *pmem = NULL;
-		uint32_t attr;
-		paddr_t pa;
 
 		/*
 		 * The page wasn't hidden, but some other core may have
@@ -1436,80 +2094,23 @@ bool tee_pager_handle_fault(struct abort_info *ai)
 			goto out;
 		}
 
-		pmem = tee_pager_get_page(area);
-		if (!pmem) {
-			abort_print(ai);
-			panic();
-		}
-
-		/* load page code & data */
-		tee_pager_load_page(area, page_va, pmem->va_alias);
-
-
-		pmem->area = area;
-		pmem->pgidx = area_va2idx(area, ai->va);
-		attr = get_area_mattr(area->flags) &
-			~(TEE_MATTR_PW | TEE_MATTR_UW);
-		pa = get_pmem_pa(pmem);
-
-		/*
-		 * We've updated the page using the aliased mapping and
-		 * some cache maintenence is now needed if it's an
-		 * executable page.
-		 *
-		 * Since the d-cache is a Physically-indexed,
-		 * physically-tagged (PIPT) cache we can clean either the
-		 * aliased address or the real virtual address. In this
-		 * case we choose the real virtual address.
-		 *
-		 * The i-cache can also be PIPT, but may be something else
-		 * too like VIPT. The current code requires the caches to
-		 * implement the IVIPT extension, that is:
-		 * "instruction cache maintenance is required only after
-		 * writing new data to a physical address that holds an
-		 * instruction."
-		 *
-		 * To portably invalidate the icache the page has to
-		 * be mapped at the final virtual address but not
-		 * executable.
-		 */
-		if (area->flags & (TEE_MATTR_PX | TEE_MATTR_UX)) {
-			uint32_t mask = TEE_MATTR_PX | TEE_MATTR_UX |
-					TEE_MATTR_PW | TEE_MATTR_UW;
-
-			/* Set a temporary read-only mapping */
-			area_set_entry(pmem->area, pmem->pgidx, pa,
-				       attr & ~mask);
-			tlbi_mva_allasid(page_va);
+		if (!pager_load_unlocked(area, page_va, ai)) {
+			pmem = tee_pager_get_page(area, false);
+			if (!pmem) {
+				abort_print(ai);
+				panic();
+			}
 
-			/*
-			 * Doing these operations to LoUIS (Level of
-			 * unification, Inner Shareable) would be enough
-			 */
-			cache_op_inner(DCACHE_AREA_CLEAN, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-			cache_op_inner(ICACHE_AREA_INVALIDATE, (void *)page_va,
-				       SMALL_PAGE_SIZE);
-
-			/* Set the final mapping */
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			tlbi_mva_allasid(page_va);
-		} else {
-			area_set_entry(area, pmem->pgidx, pa, attr);
-			/*
-			 * No need to flush TLB for this entry, it was
-			 * invalid. We should use a barrier though, to make
-			 * sure that the change is visible.
-			 */
-			dsb_ishst();
+			/* load page code & data */
+			tee_pager_load_page(area, page_va, pmem->va_alias,
+					    NULL);
+			pager_map_page(area, pmem, page_va);
+			incr_area_hits(area);
 		}
-		pgt_inc_used_entries(area->pgt);
-
-		FMSG("Mapped 0x%" PRIxVA " -> 0x%" PRIxPA, page_va, pa);
-
+		pager_fault_around(area, page_va);
 	}
 
-	tee_pager_hide_pages();
+	pager_policy_fault_done();
 	ret = true;
 out:
 	pager_unlock(exceptions);
@@ -1568,6 +2169,7 @@ void tee_pager_add_pages(vaddr_t vaddr, size_t npages, bool unmap)
 				       get_area_mattr(pmem->area->flags));
 		}
 
+		pager_policy_page_loaded(pmem);
 		tee_pager_npages++;
 		incr_npages_all();
 		set_npages();
@@ -3,7 +3,10 @@
  * Copyright (c) 2017, Linaro Limited
  */
 
+#include <arm.h>
 #include <assert.h>
+#include <mm/core_memprot.h>
+#include <mm/tee_mm.h>
 #include <string.h>
 #include <tee/fs_htree.h>
 #include <tee/tee_fs_rpc.h>
@@ -20,6 +23,7 @@
 #define TEST_BLOCK_SIZE		144
 
 struct test_aux {
+	const struct tee_fs_htree_storage *stor;
 	uint8_t *data;
 	size_t data_len;
 	size_t data_alloced;
@@ -166,6 +170,15 @@ static const struct tee_fs_htree_storage test_htree_ops = {
 	.rpc_write_final = test_write_final,
 };
 
+static const struct tee_fs_htree_storage test_htree_ops_fan_out4 = {
+	.block_size = TEST_BLOCK_SIZE,
+	.fan_out = 4,
+	.rpc_read_init = test_read_init,
+	.rpc_read_final = test_read_final,
+	.rpc_write_init = test_write_init,
+	.rpc_write_final = test_write_final,
+};
+
 #define CHECK_RES(res, cleanup)						\
 		do {							\
 			TEE_Result _res = (res);			\
@@ -270,7 +283,7 @@ static TEE_Result htree_test_rewrite(struct test_aux *aux, size_t num_blocks,
 	aux->data_len = 0;
 	memset(aux->data, 0xce, aux->data_alloced);
 
-	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(true, hash, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 
 	/*
@@ -319,7 +332,7 @@ static TEE_Result htree_test_rewrite(struct test_aux *aux, size_t num_blocks,
 	 * Close and reopen the hash-tree
 	 */
 	tee_fs_htree_close(&ht);
-	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(false, hash, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 
 	/*
@@ -367,7 +380,7 @@ static TEE_Result htree_test_rewrite(struct test_aux *aux, size_t num_blocks,
 	 * and verify that recent changes indeed was discarded.
 	 */
 	tee_fs_htree_close(&ht);
-	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(false, hash, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 
 	res = do_range(read_block, &ht, 0, num_blocks, salt);
@@ -379,7 +392,7 @@ static TEE_Result htree_test_rewrite(struct test_aux *aux, size_t num_blocks,
 	 * tee_fs_htree_image.
 	 */
 	tee_fs_htree_close(&ht);
-	res = tee_fs_htree_open(false, NULL, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(false, NULL, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 
 	res = do_range(read_block, &ht, 0, num_blocks, salt);
@@ -405,7 +418,8 @@ static void aux_free(struct test_aux *aux)
 	}
 }
 
-static struct test_aux *aux_alloc(size_t num_blocks)
+static struct test_aux *aux_alloc(const struct tee_fs_htree_storage *stor,
+				  size_t num_blocks)
 {
 	struct test_aux *aux;
 	size_t o;
@@ -418,6 +432,7 @@ static struct test_aux *aux_alloc(size_t num_blocks)
 	if (!aux)
 		return NULL;
 
+	aux->stor = stor;
 	aux->data_alloced = o + sz;
 	aux->data = malloc(aux->data_alloced);
 	if (!aux->data)
@@ -434,9 +449,10 @@ err:
 
 }
 
-static TEE_Result test_write_read(size_t num_blocks)
+static TEE_Result test_write_read(const struct tee_fs_htree_storage *stor,
+				  size_t num_blocks)
 {
-	struct test_aux *aux = aux_alloc(num_blocks);
+	struct test_aux *aux = aux_alloc(stor, num_blocks);
 	TEE_Result res;
 	size_t n;
 	size_t m;
@@ -502,8 +518,8 @@ static TEE_Result test_corrupt_type(const TEE_UUID *uuid, uint8_t *hash,
 		 * tee_fs_htree_open() errors in block is detected when
 		 * actually read by do_range(read_block)
 		 */
-		res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops,
-					&aux2, &ht);
+		res = tee_fs_htree_open(false, hash, uuid, aux->stor, &aux2,
+					&ht);
 		if (!res) {
 			res = do_range(read_block, &ht, 0, num_blocks, 1);
 			/*
@@ -556,7 +572,8 @@ out:
 
 
 
-static TEE_Result test_corrupt(size_t num_blocks)
+static TEE_Result test_corrupt(const struct tee_fs_htree_storage *stor,
+			       size_t num_blocks)
 {
 	TEE_Result res;
 	struct tee_fs_htree *ht = NULL;
@@ -571,7 +588,7 @@ static TEE_Result test_corrupt(size_t num_blocks)
 		return res;
 	uuid = &sess->ctx->uuid;
 
-	aux = aux_alloc(num_blocks);
+	aux = aux_alloc(stor, num_blocks);
 	if (!aux) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto out;
@@ -581,7 +598,7 @@ static TEE_Result test_corrupt(size_t num_blocks)
 	memset(aux->data, 0xce, aux->data_alloced);
 
 	/* Write the object and close it */
-	res = tee_fs_htree_open(true, hash, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(true, hash, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 	res = do_range(write_block, &ht, 0, num_blocks, 1);
 	CHECK_RES(res, goto out);
@@ -590,7 +607,7 @@ static TEE_Result test_corrupt(size_t num_blocks)
 	tee_fs_htree_close(&ht);
 
 	/* Verify that the object can be read correctly */
-	res = tee_fs_htree_open(false, hash, uuid, &test_htree_ops, aux, &ht);
+	res = tee_fs_htree_open(false, hash, uuid, aux->stor, aux, &ht);
 	CHECK_RES(res, goto out);
 	res = do_range(read_block, &ht, 0, num_blocks, 1);
 	CHECK_RES(res, goto out);
@@ -624,9 +641,376 @@ TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 	if (nParamTypes)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	res = test_write_read(10);
+	res = test_write_read(&test_htree_ops, 10);
+	if (res)
+		return res;
+
+	res = test_corrupt(&test_htree_ops, 5);
+	if (res)
+		return res;
+
+	res = test_write_read(&test_htree_ops_fan_out4, 10);
 	if (res)
 		return res;
 
-	return test_corrupt(5);
+	return test_corrupt(&test_htree_ops_fan_out4, 5);
+}
+
+/*
+ * Benchmarks
+ *
+ * The objects are sized in blocks of the REE FS. The open latency is
+ * measured with one hash tree node per 4 KiB block. Only the head and the
+ * nodes are stored in that case since data blocks aren't accessed when an
+ * object is opened. The node images of a large object don't fit in the
+ * core heap so the storage is taken from TA RAM instead.
+ *
+ * The read and write throughput is measured with a few different block
+ * sizes and fan-outs, the data blocks are stored in that case.
+ */
+#define BENCH_FS_BLOCK_SIZE	4096
+#define BENCH_SMALL_OBJ_SIZE	(1024 * 1024)
+#define BENCH_LARGE_OBJ_SIZE	(64 * 1024 * 1024)
+#define BENCH_RW_OBJ_SIZE	(1024 * 1024)
+/* Number of blocks written before the object is committed and reopened */
+#define BENCH_CHUNK_BLOCKS	64
+#define BENCH_NUM_OPEN		4
+
+/*
+ * struct bench_aux - storage of the benchmarks
+ * @mm:			TA RAM allocation
+ * @data:		virtual address of @mm, holding the heads, the nodes,
+ *			@buf and the data blocks in that order
+ * @buf:		plain text buffer of one data block
+ * @block_size:		size of the data blocks
+ * @num_nodes:		maximum number of nodes
+ * @store_blocks:	data blocks are stored, else they all share the
+ *			same space
+ */
+struct bench_aux {
+	tee_mm_entry_t *mm;
+	uint8_t *data;
+	uint8_t *buf;
+	size_t block_size;
+	size_t num_nodes;
+	bool store_blocks;
+};
+
+static TEE_Result bench_get_offs_size(struct bench_aux *a,
+				      enum tee_fs_htree_type type,
+				      size_t idx, uint8_t vers, size_t *offs,
+				      size_t *size)
+{
+	const size_t head_size = sizeof(struct tee_fs_htree_image);
+	const size_t node_size = sizeof(struct tee_fs_htree_node_image);
+	size_t blocks_offs = head_size * 2 + node_size * a->num_nodes * 2 +
+			     a->block_size;
+
+	switch (type) {
+	case TEE_FS_HTREE_TYPE_HEAD:
+		*offs = head_size * vers;
+		*size = head_size;
+		return TEE_SUCCESS;
+	case TEE_FS_HTREE_TYPE_NODE:
+		if (idx >= a->num_nodes)
+			return TEE_ERROR_GENERIC;
+		*offs = head_size * 2 + node_size * (idx * 2 + vers);
+		*size = node_size;
+		return TEE_SUCCESS;
+	case TEE_FS_HTREE_TYPE_BLOCK:
+		*offs = blocks_offs;
+		if (a->store_blocks) {
+			if (idx >= a->num_nodes)
+				return TEE_ERROR_GENERIC;
+			*offs += a->block_size * (idx * 2 + vers);
+		}
+		*size = a->block_size;
+		return TEE_SUCCESS;
+	default:
+		return TEE_ERROR_GENERIC;
+	}
+}
+
+static TEE_Result bench_rpc_init(void *aux, struct tee_fs_rpc_operation *op,
+				 enum tee_fs_htree_type type, size_t idx,
+				 uint8_t vers, void **data)
+{
+	TEE_Result res;
+	struct bench_aux *a = aux;
+	size_t offs;
+	size_t sz;
+
+	res = bench_get_offs_size(a, type, idx, vers, &offs, &sz);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	memset(op, 0, sizeof(*op));
+	op->params[0].u.value.a = sz;
+	*data = a->data + offs;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result bench_read_final(struct tee_fs_rpc_operation *op,
+				   size_t *bytes)
+{
+	*bytes = op->params[0].u.value.a;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result bench_write_final(struct tee_fs_rpc_operation *op __unused)
+{
+	return TEE_SUCCESS;
+}
+
+static void bench_set_block_size(void *aux, size_t block_size)
+{
+	struct bench_aux *a = aux;
+
+	assert(block_size == a->block_size);
+}
+
+static const struct tee_fs_htree_storage bench_htree_ops = {
+	.block_size = BENCH_FS_BLOCK_SIZE,
+	.rpc_read_init = bench_rpc_init,
+	.rpc_read_final = bench_read_final,
+	.rpc_write_init = bench_rpc_init,
+	.rpc_write_final = bench_write_final,
+	.set_block_size = bench_set_block_size,
+};
+
+static void bench_aux_free(struct bench_aux *aux)
+{
+	if (aux) {
+		tee_mm_free(aux->mm);
+		free(aux);
+	}
+}
+
+static struct bench_aux *bench_aux_alloc(size_t num_blocks, size_t block_size,
+					 bool store_blocks)
+{
+	struct bench_aux *aux;
+	size_t data_size;
+	size_t o;
+	size_t sz;
+
+	aux = calloc(1, sizeof(*aux));
+	if (!aux)
+		return NULL;
+
+	aux->block_size = block_size;
+	aux->num_nodes = num_blocks;
+	aux->store_blocks = store_blocks;
+
+	if (bench_get_offs_size(aux, TEE_FS_HTREE_TYPE_BLOCK, num_blocks - 1,
+				1, &o, &sz))
+		goto err;
+
+	data_size = ROUNDUP(o + sz, SMALL_PAGE_SIZE);
+	aux->mm = tee_mm_alloc(&tee_mm_sec_ddr, data_size);
+	if (!aux->mm)
+		goto err;
+	aux->data = phys_to_virt(tee_mm_get_smem(aux->mm), MEM_AREA_TA_RAM);
+	memset(aux->data, 0, data_size);
+
+	/* The plain text buffer is just before the first data block */
+	if (bench_get_offs_size(aux, TEE_FS_HTREE_TYPE_BLOCK, 0, 0, &o, &sz))
+		goto err;
+	aux->buf = aux->data + o - block_size;
+
+	return aux;
+err:
+	bench_aux_free(aux);
+	return NULL;
+}
+
+static TEE_Result bench_create(const TEE_UUID *uuid, struct bench_aux *aux,
+			       size_t num_blocks, uint8_t *hash)
+{
+	TEE_Result res;
+	struct tee_fs_htree *ht = NULL;
+	size_t bn;
+
+	res = tee_fs_htree_open(true, hash, uuid, &bench_htree_ops, aux, &ht);
+	CHECK_RES(res, goto out);
+
+	for (bn = 0; bn < num_blocks; bn++) {
+		/*
+		 * Commit and reopen now and then to release the nodes
+		 * which aren't needed any longer.
+		 */
+		if (bn && !(bn % BENCH_CHUNK_BLOCKS)) {
+			res = tee_fs_htree_sync_to_storage(&ht, hash);
+			CHECK_RES(res, goto out);
+			tee_fs_htree_close(&ht);
+			res = tee_fs_htree_open(false, hash, uuid,
+						&bench_htree_ops, aux, &ht);
+			if (res != TEE_SUCCESS)
+				goto out;
+		}
+
+		res = tee_fs_htree_write_block(&ht, bn, aux->buf);
+		CHECK_RES(res, goto out);
+	}
+
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+out:
+	tee_fs_htree_close(&ht);
+	return res;
+}
+
+static TEE_Result bench_open(const TEE_UUID *uuid, size_t obj_size,
+			     uint32_t *usec)
+{
+	TEE_Result res;
+	struct tee_fs_htree *ht = NULL;
+	size_t num_blocks = obj_size / BENCH_FS_BLOCK_SIZE;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	struct bench_aux *aux;
+	uint64_t ticks = 0;
+	uint64_t t;
+	size_t n;
+
+	aux = bench_aux_alloc(num_blocks, BENCH_FS_BLOCK_SIZE, false);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = bench_create(uuid, aux, num_blocks, hash);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	for (n = 0; n < BENCH_NUM_OPEN; n++) {
+		t = read_cntpct();
+		res = tee_fs_htree_open(false, hash, uuid, &bench_htree_ops,
+					aux, &ht);
+		ticks += read_cntpct() - t;
+		tee_fs_htree_close(&ht);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	*usec = ticks * 1000000 / read_cntfrq() / BENCH_NUM_OPEN;
+	IMSG("htree open of %zu KiB object: %" PRIu32 " us",
+	     obj_size / 1024, *usec);
+out:
+	bench_aux_free(aux);
+	return res;
+}
+
+/* Returns the throughput in 1/100 MiB/s */
+static uint64_t bench_rate(size_t bytes, uint64_t ticks)
+{
+	return (uint64_t)bytes * 100 * read_cntfrq() /
+	       (MAX(ticks, 1ULL) * 1024 * 1024);
+}
+
+static TEE_Result bench_rw(const TEE_UUID *uuid, uint8_t block_shift,
+			   uint8_t fan_out)
+{
+	TEE_Result res;
+	struct tee_fs_htree_storage stor = bench_htree_ops;
+	size_t block_size = BENCH_FS_BLOCK_SIZE << block_shift;
+	size_t num_blocks = BENCH_RW_OBJ_SIZE / block_size;
+	uint8_t hash[TEE_FS_HTREE_HASH_SIZE];
+	struct tee_fs_htree *ht = NULL;
+	struct bench_aux *aux;
+	uint64_t wr_ticks;
+	uint64_t rd_ticks;
+	uint64_t wr_rate __maybe_unused;
+	uint64_t rd_rate __maybe_unused;
+	size_t bn;
+
+	stor.block_shift = block_shift;
+	stor.fan_out = fan_out;
+
+	aux = bench_aux_alloc(num_blocks, block_size, true);
+	if (!aux)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memset(aux->buf, 0x5a, block_size);
+
+	wr_ticks = read_cntpct();
+	res = tee_fs_htree_open(true, hash, uuid, &stor, aux, &ht);
+	CHECK_RES(res, goto out);
+	for (bn = 0; bn < num_blocks; bn++) {
+		res = tee_fs_htree_write_block(&ht, bn, aux->buf);
+		CHECK_RES(res, goto out);
+	}
+	res = tee_fs_htree_sync_to_storage(&ht, hash);
+	CHECK_RES(res, goto out);
+	wr_ticks = read_cntpct() - wr_ticks;
+	tee_fs_htree_close(&ht);
+
+	rd_ticks = read_cntpct();
+	res = tee_fs_htree_open(false, hash, uuid, &stor, aux, &ht);
+	CHECK_RES(res, goto out);
+	for (bn = 0; bn < num_blocks; bn++) {
+		res = tee_fs_htree_read_block(&ht, bn, aux->buf);
+		CHECK_RES(res, goto out);
+	}
+	rd_ticks = read_cntpct() - rd_ticks;
+
+	wr_rate = bench_rate(BENCH_RW_OBJ_SIZE, wr_ticks);
+	rd_rate = bench_rate(BENCH_RW_OBJ_SIZE, rd_ticks);
+	IMSG("htree %zu KiB blocks, fan-out %" PRIu8 ": write %" PRIu64
+	     ".%02" PRIu64 " MB/s, read %" PRIu64 ".%02" PRIu64 " MB/s",
+	     block_size / 1024, fan_out, wr_rate / 100, wr_rate % 100,
+	     rd_rate / 100, rd_rate % 100);
+out:
+	tee_fs_htree_close(&ht);
+	bench_aux_free(aux);
+	return res;
+}
+
+TEE_Result core_fs_htree_bench(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	static const struct {
+		uint8_t block_shift;
+		uint8_t fan_out;
+	} geometry[] = { { 0, 2 }, { 2, 2 }, { 4, 2 }, { 2, 4 }, { 4, 8 } };
+	TEE_Result res;
+	struct tee_ta_session *sess;
+	const TEE_UUID *uuid;
+	size_t n;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res)
+		return res;
+	uuid = &sess->ctx->uuid;
+
+	pParams[0].value.a = 0;
+	pParams[0].value.b = 0;
+
+	res = bench_open(uuid, BENCH_SMALL_OBJ_SIZE, &pParams[0].value.a);
+	if (res)
+		return res;
+
+	/*
+	 * Without CFG_FS_HTREE_LAZY_VERIFY the complete tree of the large
+	 * object has to fit in the core heap, report 0 if it doesn't.
+	 */
+	res = bench_open(uuid, BENCH_LARGE_OBJ_SIZE, &pParams[0].value.b);
+	if (res == TEE_ERROR_OUT_OF_MEMORY) {
+		IMSG("htree open of %u KiB object: out of memory",
+		     BENCH_LARGE_OBJ_SIZE / 1024);
+		res = TEE_SUCCESS;
+	}
+	if (res)
+		return res;
+
+	for (n = 0; n < ARRAY_SIZE(geometry); n++) {
+		res = bench_rw(uuid, geometry[n].block_shift,
+			       geometry[n].fan_out);
+		if (res)
+			return res;
+	}
+
+	return TEE_SUCCESS;
 }
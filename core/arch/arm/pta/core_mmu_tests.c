@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <kernel/tee_ta_manager.h>
+#include <kernel/user_ta.h>
+#include <mm/pgt_cache.h>
+#include <mm/tee_mmu.h>
+#include <mm/tee_mmu_types.h>
+#include <mm/tee_pager.h>
+#include <stdlib.h>
+#include <trace.h>
+
+#include "core_self_tests.h"
+
+#define BENCH_NUM_SWITCHES	1024
+
+/* More than the number of ASIDs in a generation, see tee_mmu.c */
+#define ROLLOVER_MAX_CTX	256
+
+/*
+ * Returns a user TA context with nothing but the kernel parts of a user
+ * mode mapping. @ops are the ops of a loaded user TA, which makes it a
+ * user TA context for tee_mmu_set_ctx().
+ */
+static struct user_ta_ctx *test_ctx_alloc(const struct tee_ta_ops *ops)
+{
+	struct user_ta_ctx *utc = calloc(1, sizeof(*utc));
+
+	if (!utc)
+		return NULL;
+	utc->ctx.ops = ops;
+	if (!tee_pager_init_uta_areas(utc)) {
+		free(utc);
+		return NULL;
+	}
+	if (vm_info_init(utc)) {
+		tee_pager_rem_uta_areas(utc);
+		free(utc);
+		return NULL;
+	}
+
+	return utc;
+}
+
+/* The context must not be active */
+static void test_ctx_free(struct user_ta_ctx *utc)
+{
+	if (!utc)
+		return;
+	pgt_flush_ctx(&utc->ctx);
+	vm_info_final(utc);
+	tee_pager_rem_uta_areas(utc);
+	free(utc);
+}
+
+TEE_Result core_mmu_switch_bench(uint32_t nParamTypes,
+				 TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	struct tee_ta_session *s = tee_ta_get_calling_session();
+	struct tee_ta_ctx *ctx = tee_mmu_get_ctx();
+	struct user_ta_ctx *utc;
+	uint64_t ticks;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/*
+	 * Switches between the calling user TA, which is the current
+	 * context, and a second user TA context.
+	 */
+	if (!s || !is_user_ta_ctx(s->ctx) || ctx != s->ctx)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	utc = test_ctx_alloc(ctx->ops);
+	if (!utc)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	t = read_cntpct();
+	for (n = 0; n < BENCH_NUM_SWITCHES; n++) {
+		tee_mmu_set_ctx(&utc->ctx);
+		tee_mmu_set_ctx(ctx);
+	}
+	ticks = (read_cntpct() - t) / (2 * BENCH_NUM_SWITCHES);
+
+	test_ctx_free(utc);
+
+	pParams[0].value.a = ticks;
+	pParams[0].value.b = ticks * 1000000000ULL / read_cntfrq();
+	IMSG("MMU context switch: %" PRIu64 " ticks, %" PRIu32 " ns",
+	     ticks, pParams[0].value.b);
+
+	return TEE_SUCCESS;
+}
+
+static bool asid_is_valid(struct user_ta_ctx *utc)
+{
+	/* ASID 0 and 1 are reserved, the kernel mode ASID is even */
+	return utc->vm_info->asid >= 2 && !(utc->vm_info->asid & 1);
+}
+
+/*
+ * Activates new contexts until all ASIDs are used up and a new generation
+ * is started, then checks that a context with an ASID of the previous
+ * generation is assigned a new one when it's activated again.
+ */
+static TEE_Result asid_rollover_test(const struct tee_ta_ops *ops)
+{
+	struct user_ta_ctx **utcs;
+	struct user_ta_ctx *last = NULL;
+	TEE_Result res = TEE_ERROR_GENERIC;
+	unsigned int first_gen = 0;
+	size_t n;
+
+	utcs = calloc(ROLLOVER_MAX_CTX, sizeof(*utcs));
+	if (!utcs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < ROLLOVER_MAX_CTX; n++) {
+		utcs[n] = test_ctx_alloc(ops);
+		if (!utcs[n]) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto out;
+		}
+		last = utcs[n];
+		tee_mmu_set_ctx(&last->ctx);
+		if (!asid_is_valid(last)) {
+			EMSG("Invalid ASID %u", last->vm_info->asid);
+			goto out;
+		}
+		if (!n)
+			first_gen = last->vm_info->asid_gen;
+		else if (last->vm_info->asid_gen != first_gen)
+			break;
+	}
+	if (n == ROLLOVER_MAX_CTX) {
+		EMSG("No new ASID generation after %zu contexts", n);
+		goto out;
+	}
+	DMSG("New ASID generation after %zu contexts", n);
+
+	tee_mmu_set_ctx(&utcs[0]->ctx);
+	if (utcs[0]->vm_info->asid_gen == first_gen ||
+	    !asid_is_valid(utcs[0])) {
+		EMSG("Stale ASID %u kept", utcs[0]->vm_info->asid);
+		goto out;
+	}
+	if (utcs[0]->vm_info->asid_gen == last->vm_info->asid_gen &&
+	    utcs[0]->vm_info->asid == last->vm_info->asid) {
+		EMSG("ASID %u assigned twice", last->vm_info->asid);
+		goto out;
+	}
+
+	res = TEE_SUCCESS;
+out:
+	tee_mmu_set_ctx(NULL);
+	for (n = 0; n < ROLLOVER_MAX_CTX; n++)
+		test_ctx_free(utcs[n]);
+	free(utcs);
+	return res;
+}
+
+TEE_Result core_mmu_asid_tests(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS] __unused)
+{
+	struct tee_ta_ctx *ctx = tee_mmu_get_ctx();
+	TEE_Result res;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* The test contexts borrow the ops of the calling user TA */
+	if (!ctx || !is_user_ta_ctx(ctx))
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	res = asid_rollover_test(ctx->ops);
+	tee_mmu_set_ctx(ctx);
+
+	return res;
+}
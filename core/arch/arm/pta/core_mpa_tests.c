@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <arm.h>
+#include <crypto/crypto.h>
+#include <malloc.h>
+#include <mpa.h>
+#include <string.h>
+#include <tee_api_defines.h>
+#include <trace.h>
+
+#include "core_self_tests.h"
+
+#ifdef CFG_CRYPTO_RSA
+#define BENCH_RSA_DEFAULT_BITS	2048
+#define BENCH_RSA_NUM_SIGN	16
+#define BENCH_RSA_NUM_VERIFY	64
+#define BENCH_RSA_KEYGEN_TRIES	4
+#define BENCH_RSA_ALGO		TEE_ALG_RSASSA_PKCS1_V1_5_SHA256
+
+static void free_rsa_keypair(struct rsa_keypair *key)
+{
+	crypto_bignum_free(key->e);
+	crypto_bignum_free(key->d);
+	crypto_bignum_free(key->n);
+	crypto_bignum_free(key->p);
+	crypto_bignum_free(key->q);
+	crypto_bignum_free(key->qp);
+	crypto_bignum_free(key->dp);
+	crypto_bignum_free(key->dq);
+}
+
+static TEE_Result gen_rsa_key(struct rsa_keypair *key, size_t bits)
+{
+	static const uint8_t e[] = { 0x01, 0x00, 0x01 };
+	TEE_Result res;
+	size_t n;
+
+	res = crypto_acipher_alloc_rsa_keypair(key, bits);
+	if (res)
+		return res;
+
+	res = crypto_bignum_bin2bn(e, sizeof(e), key->e);
+	if (res)
+		goto out;
+
+	/* Key generation fails if the modulus doesn't get exactly @bits */
+	for (n = 0; n < BENCH_RSA_KEYGEN_TRIES; n++) {
+		res = crypto_acipher_gen_rsa_key(key, bits);
+		if (res != TEE_ERROR_BAD_PARAMETERS)
+			break;
+	}
+out:
+	if (res)
+		free_rsa_keypair(key);
+	return res;
+}
+
+static uint32_t ops_per_sec(size_t num_ops, uint64_t ticks)
+{
+	if (!ticks)
+		return 0;
+	return num_ops * (uint64_t)read_cntfrq() / ticks;
+}
+
+/*
+ * Signs and verifies a SHA-256 digest with a freshly generated RSA key
+ * to measure the big number arithmetic, mostly mpa_exp_mod().
+ */
+TEE_Result core_mpa_rsa_bench(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	struct rsa_keypair key;
+	struct rsa_public_key pub;
+	uint8_t digest[32];
+	uint64_t sign_ticks;
+	uint64_t verify_ticks;
+	uint8_t *sig = NULL;
+	size_t sig_len = 0;
+	TEE_Result res;
+	size_t bits;
+	uint64_t t;
+	size_t n;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					   TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	bits = pParams[0].value.a;
+	if (!bits)
+		bits = BENCH_RSA_DEFAULT_BITS;
+	if (bits > CFG_CORE_BIGNUM_MAX_BITS || bits % 8)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = gen_rsa_key(&key, bits);
+	if (res)
+		return res;
+	pub.e = key.e;
+	pub.n = key.n;
+
+	sig = malloc(bits / 8);
+	if (!sig) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	memset(digest, 0xa5, sizeof(digest));
+
+	t = read_cntpct();
+	for (n = 0; n < BENCH_RSA_NUM_SIGN; n++) {
+		sig_len = bits / 8;
+		res = crypto_acipher_rsassa_sign(BENCH_RSA_ALGO, &key, -1,
+						 digest, sizeof(digest),
+						 sig, &sig_len);
+		if (res)
+			goto out;
+	}
+	sign_ticks = read_cntpct() - t;
+
+	t = read_cntpct();
+	for (n = 0; n < BENCH_RSA_NUM_VERIFY; n++) {
+		res = crypto_acipher_rsassa_verify(BENCH_RSA_ALGO, &pub, -1,
+						   digest, sizeof(digest),
+						   sig, sig_len);
+		if (res)
+			goto out;
+	}
+	verify_ticks = read_cntpct() - t;
+
+	pParams[1].value.a = ops_per_sec(BENCH_RSA_NUM_SIGN, sign_ticks);
+	pParams[1].value.b = ops_per_sec(BENCH_RSA_NUM_VERIFY, verify_ticks);
+	IMSG("RSA-%zu: %" PRIu32 " sign/s, %" PRIu32 " verify/s",
+	     bits, pParams[1].value.a, pParams[1].value.b);
+out:
+	free(sig);
+	free_rsa_keypair(&key);
+	return res;
+}
+#endif /*CFG_CRYPTO_RSA*/
+
+/*
+ * Known-answer tests of the word level Montgomery kernels used by
+ * __mpa_montgomery_mul() and __mpa_montgomery_sqr(). They're compared
+ * with a reference which first computes the whole product and then
+ * reduces it, for moduli and operands at the edges: all ones words,
+ * moduli just above and below a power of two and single words.
+ */
+#define KAT_MAX_WORDS	(CFG_CORE_BIGNUM_MAX_BITS / MPA_WORD_SIZE)
+
+static const size_t kat_lens[] = {
+	1, 2, 3, 4, 5, 6, 7, 8, 10, 17, 32, 33, 34, 63, 64, KAT_MAX_WORDS
+};
+
+enum kat_modulus {
+	KAT_N_ALL_ONES,		/* 2^k - 1 */
+	KAT_N_POW2_PLUS_ONE,	/* 2^(k - 1) + 1 */
+	KAT_N_RANDOM,
+	KAT_N_COUNT
+};
+
+enum kat_operand {
+	KAT_OP_ZERO,
+	KAT_OP_ONE,
+	KAT_OP_N_MINUS_ONE,
+	KAT_OP_ONE_WORD,
+	KAT_OP_RANDOM,
+	KAT_OP_COUNT
+};
+
+struct kat_bufs {
+	mpa_word_t n[KAT_MAX_WORDS];
+	mpa_word_t a[KAT_MAX_WORDS];
+	mpa_word_t b[KAT_MAX_WORDS];
+	mpa_word_t t1[2 * KAT_MAX_WORDS + 1];
+	mpa_word_t t2[2 * KAT_MAX_WORDS + 1];
+};
+
+static mpa_word_t kat_rand(uint32_t *state)
+{
+	/* xorshift32, the tests only need reproducible numbers */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/* Returns -1/n[0] mod 2^32, n[0] must be odd */
+static mpa_word_t kat_n_inv(const mpa_word_t *n)
+{
+	mpa_word_t inv = n[0];
+	size_t i;
+
+	/* Each step doubles the number of correct bits, from 3 */
+	for (i = 0; i < 4; i++)
+		inv *= 2 - n[0] * inv;
+	return -inv;
+}
+
+static void kat_gen_modulus(mpa_word_t *n, size_t len, enum kat_modulus kind,
+			    uint32_t *state)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		switch (kind) {
+		case KAT_N_ALL_ONES:
+			n[i] = ~(mpa_word_t)0;
+			break;
+		case KAT_N_POW2_PLUS_ONE:
+			n[i] = 0;
+			break;
+		default:
+			n[i] = kat_rand(state);
+			break;
+		}
+	}
+	n[0] |= 1;
+	n[len - 1] |= (mpa_word_t)1 << (MPA_WORD_SIZE - 1);
+}
+
+/* Sets op to an operand less than n, returns the number of words used */
+static size_t kat_gen_operand(mpa_word_t *op, const mpa_word_t *n, size_t len,
+			      enum kat_operand kind, uint32_t *state)
+{
+	size_t i;
+
+	memset(op, 0, len * sizeof(mpa_word_t));
+	switch (kind) {
+	case KAT_OP_ZERO:
+		return len;
+	case KAT_OP_ONE:
+		op[0] = 1;
+		return len;
+	case KAT_OP_N_MINUS_ONE:
+		memcpy(op, n, len * sizeof(mpa_word_t));
+		op[0]--;
+		return len;
+	case KAT_OP_ONE_WORD:
+		op[0] = kat_rand(state) | 1;
+		if (len == 1)
+			op[0] %= n[0];
+		return 1;
+	default:
+		for (i = 0; i < len; i++)
+			op[i] = kat_rand(state);
+		op[len - 1] %= n[len - 1];
+		return len;
+	}
+}
+
+/*
+ * Reference for the kernels: t = a * b with schoolbook multiplication,
+ * then t = (t + m * n) / 2^(MPA_WORD_SIZE * len) one word of m at a time.
+ * m is the only value below 2^(MPA_WORD_SIZE * len) that makes the
+ * division exact, so the kernels must give exactly the same len + 1
+ * words, left in t[len] to t[2 * len].
+ */
+static void kat_ref(mpa_word_t *t, const mpa_word_t *a, const mpa_word_t *b,
+		    const mpa_word_t *n, size_t len, mpa_word_t n_inv)
+{
+	uint64_t p;
+	mpa_word_t cc = 0;
+	mpa_word_t c;
+	mpa_word_t m;
+	size_t i;
+	size_t j;
+
+	memset(t, 0, (2 * len + 1) * sizeof(mpa_word_t));
+	for (i = 0; i < len; i++) {
+		c = 0;
+		for (j = 0; j < len; j++) {
+			p = (uint64_t)a[i] * b[j] + t[i + j] + c;
+			t[i + j] = p;
+			c = p >> MPA_WORD_SIZE;
+		}
+		t[i + len] = c;
+	}
+
+	for (i = 0; i < len; i++) {
+		m = t[i] * n_inv;
+		c = 0;
+		for (j = 0; j < len; j++) {
+			p = (uint64_t)m * n[j] + t[i + j] + c;
+			t[i + j] = p;
+			c = p >> MPA_WORD_SIZE;
+		}
+		p = (uint64_t)t[i + len] + c + cc;
+		t[i + len] = p;
+		cc = p >> MPA_WORD_SIZE;
+	}
+	t[2 * len] = cc;
+}
+
+/* Compares the kernel with the reference for the operands in kb */
+static bool kat_mul_one(struct kat_bufs *kb, size_t len, size_t a_len,
+			mpa_word_t n_inv)
+{
+	size_t sz = (len + 1) * sizeof(mpa_word_t);
+
+	memset(kb->t1, 0, sz);
+	__mpa_montgomery_mul_words(kb->t1, kb->a, a_len, kb->b, kb->n, len,
+				   n_inv);
+	/* Words of a from a_len and up are zero already */
+	kat_ref(kb->t2, kb->a, kb->b, kb->n, len, n_inv);
+
+	return !memcmp(kb->t1, kb->t2 + len, sz);
+}
+
+static bool kat_mul(struct kat_bufs *kb, size_t len)
+{
+	uint32_t state = 0x2545f491 + len;
+	mpa_word_t n_inv;
+	size_t a_len;
+	int n_kind;
+	int a_kind;
+	int b_kind;
+
+	for (n_kind = 0; n_kind < KAT_N_COUNT; n_kind++) {
+		kat_gen_modulus(kb->n, len, n_kind, &state);
+		n_inv = kat_n_inv(kb->n);
+		for (a_kind = 0; a_kind < KAT_OP_COUNT; a_kind++) {
+			for (b_kind = 0; b_kind < KAT_OP_COUNT; b_kind++) {
+				a_len = kat_gen_operand(kb->a, kb->n, len,
+							a_kind, &state);
+				kat_gen_operand(kb->b, kb->n, len, b_kind,
+						&state);
+				if (!kat_mul_one(kb, len, a_len, n_inv)) {
+					EMSG("mul len %zu n %d a %d b %d",
+					     len, n_kind, a_kind, b_kind);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Compares the squaring kernel with the reference and with the
+ * multiplication kernel. All three must give the same len + 1 words, the
+ * square is left in the upper half of the buffer.
+ */
+static bool kat_sqr_one(struct kat_bufs *kb, size_t len, mpa_word_t n_inv)
+{
+	size_t sz = (2 * len + 1) * sizeof(mpa_word_t);
+	size_t res_sz = (len + 1) * sizeof(mpa_word_t);
+
+	memset(kb->t1, 0, sz);
+	__mpa_montgomery_sqr_words(kb->t1, kb->a, kb->n, len, n_inv);
+	kat_ref(kb->t2, kb->a, kb->a, kb->n, len, n_inv);
+	if (memcmp(kb->t1 + len, kb->t2 + len, res_sz))
+		return false;
+
+	memset(kb->t2, 0, sz);
+	__mpa_montgomery_mul_words(kb->t2, kb->a, len, kb->a, kb->n, len,
+				   n_inv);
+	return !memcmp(kb->t1 + len, kb->t2, res_sz);
+}
+
+static bool kat_sqr(struct kat_bufs *kb, size_t len)
+{
+	uint32_t state = 0x9e3779b9 + len;
+	mpa_word_t n_inv;
+	int n_kind;
+	int a_kind;
+
+	for (n_kind = 0; n_kind < KAT_N_COUNT; n_kind++) {
+		kat_gen_modulus(kb->n, len, n_kind, &state);
+		n_inv = kat_n_inv(kb->n);
+		for (a_kind = 0; a_kind < KAT_OP_COUNT; a_kind++) {
+			/* The squaring kernels take all len words of a */
+			kat_gen_operand(kb->a, kb->n, len, a_kind, &state);
+			if (!kat_sqr_one(kb, len, n_inv)) {
+				EMSG("sqr len %zu n %d a %d",
+				     len, n_kind, a_kind);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+TEE_Result core_mpa_montgomery_tests(uint32_t nParamTypes,
+				     TEE_Param pParams[TEE_NUM_PARAMS] __unused)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct kat_bufs *kb;
+	size_t n;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE,
+					   TEE_PARAM_TYPE_NONE))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	kb = malloc(sizeof(*kb));
+	if (!kb)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < ARRAY_SIZE(kat_lens); n++) {
+		if (kat_lens[n] > KAT_MAX_WORDS)
+			continue;
+		if (!kat_mul(kb, kat_lens[n]) || !kat_sqr(kb, kat_lens[n])) {
+			res = TEE_ERROR_GENERIC;
+			break;
+		}
+	}
+
+	free(kb);
+	return res;
+}
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_pobj.h>
+#include <trace.h>
+#include <util.h>
+
+#include "core_self_tests.h"
+
+#define BENCH_NUM_FILES		16
+
+/*
+ * The files are created in the storage of this UUID, which no TA uses, to
+ * keep the benchmark away from the objects of the calling TA.
+ */
+static const TEE_UUID bench_uuid = {
+	0x6d7c8f40, 0x2a1b, 0x4c3e,
+	{ 0x9f, 0x51, 0x0b, 0x7a, 0xe2, 0x64, 0xd3, 0x18 }
+};
+
+enum bench_op {
+	BENCH_CREATE,
+	BENCH_OPEN,
+	BENCH_RENAME,
+	BENCH_REMOVE,
+	BENCH_NUM_OPS
+};
+
+static const char * const bench_op_name[BENCH_NUM_OPS] = {
+	[BENCH_CREATE] = "create",
+	[BENCH_OPEN] = "open",
+	[BENCH_RENAME] = "rename",
+	[BENCH_REMOVE] = "remove",
+};
+
+static void bench_init_pobj(struct tee_pobj *po, const TEE_UUID *uuid,
+			    uint32_t *id)
+{
+	memset(po, 0, sizeof(*po));
+	po->uuid = *uuid;
+	po->obj_id = id;
+	po->obj_id_len = sizeof(*id);
+	po->fops = &rpmb_fs_ops;
+}
+
+/*
+ * File n is created as object n and renamed to object
+ * n + BENCH_NUM_FILES.
+ */
+static TEE_Result bench_op(enum bench_op op, const TEE_UUID *uuid, uint32_t n)
+{
+	static const uint8_t data[32];
+	struct tee_file_handle *fh = NULL;
+	struct tee_pobj po;
+	struct tee_pobj new_po;
+	uint32_t id = n;
+	uint32_t new_id = n + BENCH_NUM_FILES;
+	TEE_Result res;
+
+	bench_init_pobj(&po, uuid, &id);
+	bench_init_pobj(&new_po, uuid, &new_id);
+
+	switch (op) {
+	case BENCH_CREATE:
+		po.temporary = true;
+		res = rpmb_fs_ops.create(&po, true, NULL, 0, NULL, 0, data,
+					 sizeof(data), &fh);
+		break;
+	case BENCH_OPEN:
+		res = rpmb_fs_ops.open(&po, NULL, &fh);
+		break;
+	case BENCH_RENAME:
+		return rpmb_fs_ops.rename(&po, &new_po, true);
+	case BENCH_REMOVE:
+		return rpmb_fs_ops.remove(&new_po);
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	if (!res)
+		rpmb_fs_ops.close(&fh);
+	return res;
+}
+
+/* Returns true if any of the files the benchmark uses exists */
+static bool bench_files_exist(const TEE_UUID *uuid)
+{
+	struct tee_file_handle *fh = NULL;
+	struct tee_pobj po;
+	TEE_Result res;
+	uint32_t id;
+
+	bench_init_pobj(&po, uuid, &id);
+	for (id = 0; id < BENCH_NUM_FILES * 2; id++) {
+		res = rpmb_fs_ops.open(&po, NULL, &fh);
+		if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+			if (fh)
+				rpmb_fs_ops.close(&fh);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Only called once bench_files_exist() has found none of the files */
+static void bench_cleanup(const TEE_UUID *uuid)
+{
+	struct tee_pobj po;
+	uint32_t id;
+
+	bench_init_pobj(&po, uuid, &id);
+	for (id = 0; id < BENCH_NUM_FILES * 2; id++)
+		rpmb_fs_ops.remove(&po);
+}
+
+TEE_Result core_rpmb_fs_bench(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	struct tee_rpmb_fs_stats stats;
+	const TEE_UUID *uuid = &bench_uuid;
+	TEE_Result res;
+	size_t op;
+	size_t n;
+
+	if (nParamTypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_VALUE_OUTPUT,
+					   TEE_PARAM_TYPE_VALUE_OUTPUT))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/*
+	 * Files left by an interrupted run aren't removed, nothing is
+	 * deleted which this run didn't create. This also sets up the file
+	 * system before anything is counted.
+	 */
+	if (bench_files_exist(uuid)) {
+		EMSG("RPMB FS benchmark files already exist");
+		return TEE_ERROR_ACCESS_CONFLICT;
+	}
+	tee_rpmb_fs_get_stats(&stats);
+
+	for (op = 0; op < BENCH_NUM_OPS; op++) {
+		for (n = 0; n < BENCH_NUM_FILES; n++) {
+			res = bench_op(op, uuid, n);
+			if (res) {
+				EMSG("RPMB FS %s of file %zu: 0x%" PRIx32,
+				     bench_op_name[op], n, res);
+				bench_cleanup(uuid);
+				return res;
+			}
+		}
+
+		tee_rpmb_fs_get_stats(&stats);
+		pParams[op].value.a = stats.requests;
+		pParams[op].value.b = stats.frames;
+		IMSG("RPMB FS %s per file: %zu requests, %zu frames",
+		     bench_op_name[op], stats.requests / BENCH_NUM_FILES,
+		     stats.frames / BENCH_NUM_FILES);
+	}
+
+	return TEE_SUCCESS;
+}
@@ -38,6 +38,24 @@ TEE_Result core_self_tests(uint32_t nParamTypes,
 TEE_Result core_fs_htree_tests(uint32_t nParamTypes,
 			       TEE_Param pParams[TEE_NUM_PARAMS]);
 
+TEE_Result core_fs_htree_bench(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_rpmb_fs_bench(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mmu_switch_bench(uint32_t nParamTypes,
+				 TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mmu_asid_tests(uint32_t nParamTypes,
+			       TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mpa_rsa_bench(uint32_t nParamTypes,
+			      TEE_Param pParams[TEE_NUM_PARAMS]);
+
+TEE_Result core_mpa_montgomery_tests(uint32_t nParamTypes,
+				     TEE_Param pParams[TEE_NUM_PARAMS]);
+
 TEE_Result core_mutex_tests(uint32_t nParamTypes,
 			    TEE_Param pParams[TEE_NUM_PARAMS]);
 
@@ -428,7 +428,23 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 #if defined(CFG_WITH_USER_TA)
 	case PTA_INVOKE_TESTS_CMD_FS_HTREE:
 		return core_fs_htree_tests(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_FS_HTREE_BENCH:
+		return core_fs_htree_bench(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MMU_SWITCH_BENCH:
+		return core_mmu_switch_bench(nParamTypes, pParams);
+	case PTA_INVOKE_TESTS_CMD_MMU_ASID:
+		return core_mmu_asid_tests(nParamTypes, pParams);
 #endif
+#if defined(CFG_RPMB_FS) && defined(CFG_WITH_STATS)
+	case PTA_INVOKE_TESTS_CMD_RPMB_FS_BENCH:
+		return core_rpmb_fs_bench(nParamTypes, pParams);
+#endif
+#if defined(CFG_CRYPTO_RSA)
+	case PTA_INVOKE_TESTS_CMD_RSA_BENCH:
+		return core_mpa_rsa_bench(nParamTypes, pParams);
+#endif
+	case PTA_INVOKE_TESTS_CMD_MPA_MONTGOMERY:
+		return core_mpa_montgomery_tests(nParamTypes, pParams);
 	case PTA_INVOKE_TESTS_CMD_MUTEX:
 		return core_mutex_tests(nParamTypes, pParams);
 	default:
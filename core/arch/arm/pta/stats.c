@@ -2,14 +2,22 @@
 /*
  * Copyright (c) 2015, Linaro Limited
  */
+#include <arm.h>
 #include <compiler.h>
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/tee_ta_manager.h>
+#include <kernel/thread.h>
+#include <mm/mobj.h>
+#include <mm/pgt_cache.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
 #include <string.h>
 #include <string_ext.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_fs_rpc.h>
+#include <tee/tee_svc.h>
 #include <malloc.h>
 
 #define TA_NAME		"stats.ta"
@@ -20,6 +28,15 @@
 
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
+#define STATS_CMD_TA_MGR_STATS		2
+#define STATS_CMD_REG_SHM_STATS		3
+#define STATS_CMD_FS_RPC_CACHE_STATS	4
+#define STATS_CMD_REE_FS_CACHE_STATS	5
+#define STATS_CMD_RPMB_FS_STATS		6
+#define STATS_CMD_PAGER_LOCK_STATS	7
+#define STATS_CMD_THREAD_STATS		8
+#define STATS_CMD_PGT_CACHE_STATS	9
+#define STATS_CMD_TA_PARAM_STATS	10
 
 #define STATS_NB_POOLS			3
 
@@ -95,12 +112,22 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 {
 	struct tee_pager_stats stats;
+	uint64_t freq = read_cntfrq();
 
+	/*
+	 * The optional p[3] reports the fault rate:
+	 * p[3].value.a = number of faults handled by the pager
+	 * p[3].value.b = faults per second since the stats were last read
+	 */
 	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
 			    TEE_PARAM_TYPE_VALUE_OUTPUT,
-			    TEE_PARAM_TYPE_NONE) != type) {
-		EMSG("expect 3 output values as argument");
+			    TEE_PARAM_TYPE_NONE) != type &&
+	    TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		EMSG("expect 3 or 4 output values as argument");
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
 
@@ -112,6 +139,304 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	p[2].value.a = stats.hidden_hits;
 	p[2].value.b = stats.zi_released;
 
+	if (TEE_PARAM_TYPE_GET(type, 3) == TEE_PARAM_TYPE_VALUE_OUTPUT) {
+		p[3].value.a = stats.faults;
+		p[3].value.b = stats.ticks ? stats.faults * freq / stats.ticks :
+					     0;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_pager_lock_stats(uint32_t type,
+				       TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_pager_stats stats;
+	size_t nfaults;
+
+	/*
+	 * Counted since the pager stats were last read:
+	 * p[0].value.a = number of faults handled by the pager
+	 * p[0].value.b = number of times the pager lock was taken
+	 * p[1].value.a = average counter ticks per fault waiting for the lock
+	 * p[1].value.b = average counter ticks per fault holding the lock
+	 * p[2].value.a = number of pages loaded without holding the lock
+	 * p[2].value.b = number of refills of the per-CPU page reserves
+	 * The optional p[3] reports the pages loaded by fault-around, which
+	 * aren't counted as hits:
+	 * p[3].value.a = number of pages loaded by fault-around
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type &&
+	    TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type) {
+		EMSG("expect 3 or 4 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_pager_get_stats(&stats);
+	nfaults = MAX(stats.faults, 1U);
+	p[0].value.a = stats.faults;
+	p[0].value.b = stats.lock_count;
+	p[1].value.a = stats.lock_wait_ticks / nfaults;
+	p[1].value.b = stats.lock_hold_ticks / nfaults;
+	p[2].value.a = stats.unlocked_loads;
+	p[2].value.b = stats.reserve_refills;
+
+	if (TEE_PARAM_TYPE_GET(type, 3) == TEE_PARAM_TYPE_VALUE_OUTPUT) {
+		p[3].value.a = stats.fault_around;
+		p[3].value.b = 0;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_ta_mgr_stats(uint32_t type,
+				   TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_ta_mgr_stats stats;
+
+	/*
+	 * p[0].value.a = number of session lookups
+	 * p[0].value.b = number of sessions compared during those lookups
+	 * p[1].value.a = number of TA context lookups
+	 * p[1].value.b = number of contexts compared during those lookups
+	 * p[2].value.a = number of sessions opened on a lingering context,
+	 *		  only if a third output value is supplied
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type &&
+	    TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 or 3 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_ta_get_mgr_stats(&stats);
+	p[0].value.a = stats.sess_lookups;
+	p[0].value.b = stats.sess_probes;
+	p[1].value.a = stats.ctx_lookups;
+	p[1].value.b = stats.ctx_probes;
+	if (TEE_PARAM_TYPE_GET(type, 2) == TEE_PARAM_TYPE_VALUE_OUTPUT) {
+		p[2].value.a = stats.ctx_linger_hits;
+		p[2].value.b = 0;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_reg_shm_stats(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct mobj_reg_shm_stats stats;
+
+	/*
+	 * p[0].value.a = number of lookups by cookie
+	 * p[0].value.b = number of objects compared during those lookups
+	 * p[1].value.a = average lookup time in counter ticks
+	 * p[1].value.b = longest lookup time in counter ticks
+	 * p[2].value.a = counter frequency in Hz
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 3 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	mobj_reg_shm_get_stats(&stats);
+	p[0].value.a = stats.lookups;
+	p[0].value.b = stats.probes;
+	p[1].value.a = stats.lookups ? stats.ticks / stats.lookups : 0;
+	p[1].value.b = stats.max_ticks;
+	p[2].value.a = read_cntfrq();
+	p[2].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_fs_rpc_cache_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_fs_rpc_cache_stats stats;
+
+	/*
+	 * p[0].value.a = number of requests served from the cache
+	 * p[0].value.b = number of requests needing a new payload buffer
+	 * p[1].value.a = number of cached buffers evicted for a larger one
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_fs_rpc_cache_get_stats(&stats);
+	p[0].value.a = stats.hits;
+	p[0].value.b = stats.misses;
+	p[1].value.a = stats.evictions;
+	p[1].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_ree_fs_cache_stats(uint32_t type,
+					 TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_ree_fs_cache_stats stats;
+
+	/*
+	 * p[0].value.a = number of blocks found in the cache
+	 * p[0].value.b = number of blocks read from storage into the cache
+	 * p[1].value.a = number of block writes merged into an earlier one
+	 * p[1].value.b = number of blocks evicted from the cache
+	 * p[2].value.a = bytes not decrypted/encrypted, lower 32 bits
+	 * p[2].value.b = bytes not decrypted/encrypted, upper 32 bits
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 3 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_ree_fs_get_cache_stats(&stats);
+	p[0].value.a = stats.hits;
+	p[0].value.b = stats.misses;
+	p[1].value.a = stats.coalesced;
+	p[1].value.b = stats.evictions;
+	p[2].value.a = stats.bytes_saved;
+	p[2].value.b = stats.bytes_saved >> 32;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_rpmb_fs_stats(uint32_t type,
+				    TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_rpmb_fs_stats stats;
+
+	/*
+	 * p[0].value.a = number of RPMB requests sent to normal world
+	 * p[0].value.b = number of data frames sent and received
+	 * p[1].value.a = number of times the FAT was read into the FAT cache
+	 * p[1].value.b = number of files found with the FAT cache index
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_rpmb_fs_get_stats(&stats);
+	p[0].value.a = stats.requests;
+	p[0].value.b = stats.frames;
+	p[1].value.a = stats.fat_loads;
+	p[1].value.b = stats.fat_hits;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_thread_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct thread_stats stats;
+
+	/*
+	 * p[0].value.a = number of threads
+	 * p[0].value.b = number of threads which have a stack
+	 * p[1].value.a = number of threads currently allocated
+	 * p[1].value.b = highest number of threads allocated since last read
+	 * p[2].value.a = number of calls rejected since last read because
+	 *		  no thread was available
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 3 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	thread_get_stats(&stats);
+	p[0].value.a = stats.max_threads;
+	p[0].value.b = stats.stacks;
+	p[1].value.a = stats.active;
+	p[1].value.b = stats.max_active;
+	p[2].value.a = stats.limit_hits;
+	p[2].value.b = 0;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_pgt_cache_stats(uint32_t type,
+				      TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct pgt_cache_stats stats;
+
+	/*
+	 * p[0].value.a = number of translation tables in the pool
+	 * p[0].value.b = number of tables found cached with their content
+	 * p[1].value.a = number of tables which had to be populated again
+	 * p[1].value.b = number of cached tables taken over by another
+	 *		  context or address range
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	pgt_get_stats(&stats);
+	p[0].value.a = PGT_CACHE_SIZE;
+	p[0].value.b = stats.hits;
+	p[1].value.a = stats.misses;
+	p[1].value.b = stats.evictions;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_ta_param_stats(uint32_t type,
+				     TEE_Param p[TEE_NUM_PARAMS])
+{
+	struct tee_svc_param_stats stats;
+
+	/*
+	 * Memrefs passed from a user TA to another user TA:
+	 * p[0].value.a = number of memrefs copied, in either direction
+	 * p[0].value.b = number of bytes copied
+	 * p[1].value.a = number of memrefs mapped into the called TA
+	 * p[1].value.b = number of bytes mapped
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type) {
+		EMSG("expect 2 output values as argument");
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	tee_svc_get_param_stats(&stats);
+	p[0].value.a = stats.copied_memrefs;
+	p[0].value.b = stats.copied_bytes;
+	p[1].value.a = stats.mapped_memrefs;
+	p[1].value.b = stats.mapped_bytes;
+
 	return TEE_SUCCESS;
 }
 
@@ -128,6 +453,24 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_pager_stats(ptypes, params);
 	case STATS_CMD_ALLOC_STATS:
 		return get_alloc_stats(ptypes, params);
+	case STATS_CMD_TA_MGR_STATS:
+		return get_ta_mgr_stats(ptypes, params);
+	case STATS_CMD_REG_SHM_STATS:
+		return get_reg_shm_stats(ptypes, params);
+	case STATS_CMD_FS_RPC_CACHE_STATS:
+		return get_fs_rpc_cache_stats(ptypes, params);
+	case STATS_CMD_REE_FS_CACHE_STATS:
+		return get_ree_fs_cache_stats(ptypes, params);
+	case STATS_CMD_RPMB_FS_STATS:
+		return get_rpmb_fs_stats(ptypes, params);
+	case STATS_CMD_PAGER_LOCK_STATS:
+		return get_pager_lock_stats(ptypes, params);
+	case STATS_CMD_THREAD_STATS:
+		return get_thread_stats(ptypes, params);
+	case STATS_CMD_PGT_CACHE_STATS:
+		return get_pgt_cache_stats(ptypes, params);
+	case STATS_CMD_TA_PARAM_STATS:
+		return get_ta_param_stats(ptypes, params);
 	default:
 		break;
 	}
@@ -5,6 +5,11 @@ srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mutex_tests.c
 ifeq ($(CFG_WITH_USER_TA),y)
 srcs-$(CFG_SECSTOR_TA_MGMT_PTA) += secstor_ta_mgmt.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_fs_htree_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mmu_tests.c
+endif
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_mpa_tests.c
+ifeq ($(CFG_RPMB_FS)-$(CFG_WITH_STATS),y-y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_rpmb_fs_tests.c
 endif
 srcs-$(CFG_WITH_STATS) += stats.c
 srcs-$(CFG_TA_GPROF_SUPPORT) += gprof.c
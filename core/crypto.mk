@@ -32,6 +32,11 @@ CFG_CRYPTO_DSA ?= y
 CFG_CRYPTO_RSA ?= y
 CFG_CRYPTO_DH ?= y
 CFG_CRYPTO_ECC ?= y
+# Fixed-base comb tables for the generator of the NIST P-256, P-384 and
+# P-521 curves, built on first use. Speeds up ECC key generation and ECDSA
+# signing. Only the table lookup is constant time, the point addition and
+# doubling formulas branch on their operands, hence disabled by default.
+CFG_CRYPTO_ECC_COMB ?= n
 
 # Authenticated encryption
 CFG_CRYPTO_CCM ?= y
@@ -46,6 +46,8 @@
 
 TAILQ_HEAD(tee_ta_session_head, tee_ta_session);
 TAILQ_HEAD(tee_ta_ctx_head, tee_ta_ctx);
+LIST_HEAD(tee_ta_session_bucket, tee_ta_session);
+LIST_HEAD(tee_ta_ctx_bucket, tee_ta_ctx);
 
 struct mobj;
 
@@ -58,6 +60,7 @@ struct param_mem {
 	struct mobj *mobj;
 	size_t size;
 	size_t offs;
+	bool read_only;		/* Map read-only into the called user TA */
 };
 
 struct tee_ta_param {
@@ -103,16 +106,24 @@ struct tee_ta_ctx {
 	const struct tee_ta_ops *ops;
 	uint32_t flags;		/* TA_FLAGS from TA header */
 	TAILQ_ENTRY(tee_ta_ctx) link;
+	LIST_ENTRY(tee_ta_ctx) hlink;	/* Link in UUID hash bucket */
 	uint32_t panicked;	/* True if TA has panicked, written from asm */
 	uint32_t panic_code;	/* Code supplied for panic */
 	uint32_t ref_count;	/* Reference counter for multi session TA */
 	bool busy;		/* context is busy and cannot be entered */
 	struct condvar busy_cv;	/* CV used when context is busy */
+#if CFG_TA_LINGER_CTX_NUM > 0
+	bool lingering;		/* Kept loaded without any session */
+	TAILQ_ENTRY(tee_ta_ctx) linger_link;
+#endif
 };
 
 struct tee_ta_session {
 	TAILQ_ENTRY(tee_ta_session) link;
 	TAILQ_ENTRY(tee_ta_session) link_tsd;
+	LIST_ENTRY(tee_ta_session) hlink; /* Link in session id hash bucket */
+	/* List of open sessions this session is linked into */
+	struct tee_ta_session_head *open_sessions;
 	struct tee_ta_ctx *ctx;	/* TA context */
 	TEE_Identity clnt_id;	/* Identify of client */
 	bool cancel;		/* True if TAF is cancelled */
@@ -134,6 +145,29 @@ extern struct tee_ta_ctx_head tee_ctxes;
 
 extern struct mutex tee_ta_mutex;
 
+/*
+ * Statistics on session and context lookups. The probe counters hold the
+ * number of entries compared while looking up, the ratio probes/lookups
+ * is the average cost of a lookup.
+ */
+struct tee_ta_mgr_stats {
+	size_t sess_lookups;
+	size_t sess_probes;
+	size_t ctx_lookups;
+	size_t ctx_probes;
+	size_t ctx_linger_hits;	/* Sessions opened on a lingering context */
+};
+
+void tee_ta_get_mgr_stats(struct tee_ta_mgr_stats *stats);
+
+/*
+ * tee_ta_register_ctx() - Make a newly loaded TA context visible
+ * @ctx:	TA context with a valid UUID
+ *
+ * Must be called with tee_ta_mutex held.
+ */
+void tee_ta_register_ctx(struct tee_ta_ctx *ctx);
+
 TEE_Result tee_ta_open_session(TEE_ErrorOrigin *err,
 			       struct tee_ta_session **sess,
 			       struct tee_ta_session_head *open_sessions,
@@ -32,6 +32,8 @@
 #include <kernel/tee_ta_manager.h>
 #include <kernel/user_ta.h>
 
+struct abort_info;
+
 /*-----------------------------------------------------------------------------
  * Allocate context resources like ASID and MMU table information
  *---------------------------------------------------------------------------*/
@@ -117,6 +119,22 @@ TEE_Result tee_mmu_check_access_rights(const struct user_ta_ctx *utc,
 void tee_mmu_set_ctx(struct tee_ta_ctx *ctx);
 struct tee_ta_ctx *tee_mmu_get_ctx(void);
 
+/*
+ * tee_mmu_handle_dz_fault() - Handle a translation fault on a not yet
+ * allocated page of a demand-zero user TA mapping of the current context
+ * @ai:		abort info
+ *
+ * Returns true if the page has been allocated and mapped, else false.
+ */
+#ifdef CFG_DEMAND_ZERO_USER_TA
+bool tee_mmu_handle_dz_fault(struct abort_info *ai);
+#else
+static inline bool tee_mmu_handle_dz_fault(struct abort_info *ai __unused)
+{
+	return false;
+}
+#endif
+
 /* Returns virtual address to which TA is loaded */
 uintptr_t tee_mmu_get_load_addr(const struct tee_ta_ctx *const ctx);
 
@@ -105,9 +105,28 @@ struct vm_region {
 
 TAILQ_HEAD(vm_region_head, vm_region);
 
+/*
+ * @asid is only valid while @asid_gen matches the current ASID generation,
+ * it's (re)assigned when the context is activated by tee_mmu_set_ctx().
+ * @asid_users counts the threads which have the context as current, those
+ * keep their ASID when a new generation is started.
+ * @tlb_stale is set when the TLB may hold stale entries for @asid, that is
+ * when @asid is (re)assigned or the translation tables of the context
+ * have changed. The entries are invalidated, and @tlb_stale cleared, by
+ * the next tee_mmu_set_ctx() of the context.
+ * @thread_id is the thread the context was last activated in, each thread
+ * has its own user translation table directory.
+ * @id is a unique and stable identifier of the context.
+ */
 struct vm_info {
 	struct vm_region_head regions;
 	unsigned int asid;
+	unsigned int asid_gen;
+	unsigned int asid_users;
+	bool tlb_stale;
+	int thread_id;
+	uint32_t id;
+	TAILQ_ENTRY(vm_info) link;
 };
 
 static inline void mattr_perm_to_str(char *str, size_t size, uint32_t attr)
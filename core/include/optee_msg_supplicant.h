@@ -6,6 +6,8 @@
 #ifndef __OPTEE_MSG_SUPPLICANT_H
 #define __OPTEE_MSG_SUPPLICANT_H
 
+#include <stdint.h>
+
 /*
  * Load a TA into memory
  */
@@ -133,6 +135,43 @@
  */
 #define OPTEE_MRF_READDIR		10
 
+/*
+ * Read several extents of a file
+ *
+ * [in]     param[0].u.value.a	OPTEE_MRF_READV
+ * [in]     param[0].u.value.b	file descriptor of open file
+ * [in]     param[0].u.value.c	number of extents
+ * [in/out] param[1].u.tmem	array of struct optee_mrf_extent followed
+ *				by room for the data of each extent, back to
+ *				back in the same order as the array. The
+ *				@len of each extent is updated with the
+ *				number of bytes read.
+ */
+#define OPTEE_MRF_READV			11
+
+/*
+ * Write several extents of a file, the extents are written in order
+ *
+ * [in]     param[0].u.value.a	OPTEE_MRF_WRITEV
+ * [in]     param[0].u.value.b	file descriptor of open file
+ * [in]     param[0].u.value.c	number of extents
+ * [in]     param[1].u.tmem	array of struct optee_mrf_extent followed
+ *				by the data of each extent, back to back in
+ *				the same order as the array
+ */
+#define OPTEE_MRF_WRITEV		12
+
+/*
+ * struct optee_mrf_extent - extent of a file used by OPTEE_MRF_READV and
+ * OPTEE_MRF_WRITEV
+ * @offs:	offset into file
+ * @len:	number of bytes at @offs
+ */
+struct optee_mrf_extent {
+	uint64_t offs;
+	uint64_t len;
+};
+
 /*
  * End of definitions for messages with .cmd == OPTEE_MSG_RPC_CMD_FS
  */
@@ -24,6 +24,10 @@
 #define TEE_FS_HTREE_FEK_SIZE		16
 #define TEE_FS_HTREE_TAG_SIZE		16
 
+/* Data blocks are at most stor->block_size << TEE_FS_HTREE_MAX_BLOCK_SHIFT */
+#define TEE_FS_HTREE_MAX_BLOCK_SHIFT	4
+#define TEE_FS_HTREE_MAX_FAN_OUT	8
+
 /* Internal struct provided to let the rpc callbacks know the size if needed */
 struct tee_fs_htree_node_image {
 	/* Note that calc_node_hash() depends on hash first in struct */
@@ -45,6 +49,14 @@ struct tee_fs_htree_meta {
 struct tee_fs_htree_imeta {
 	struct tee_fs_htree_meta meta;
 	uint32_t max_node_id;
+	/*
+	 * Geometry of the hash tree, see struct tee_fs_htree_storage.
+	 * Hash trees created before these fields were added have zeroes
+	 * here, which means a block shift of 0 and a fan-out of 2.
+	 */
+	uint8_t block_shift;
+	uint8_t fan_out;
+	uint16_t reserved;
 };
 
 /* Internal struct provided to let the rpc callbacks know the size if needed */
@@ -70,14 +82,44 @@ enum tee_fs_htree_type {
 
 struct tee_fs_rpc_operation;
 
+/**
+ * struct tee_fs_htree_extent - element of a vectored read or write
+ * @type:	type of element
+ * @idx:	index of element
+ * @vers:	version of element, 0 or 1
+ * @data:	plain (secure memory) buffer with the element
+ * @len:	size of @data
+ */
+struct tee_fs_htree_extent {
+	enum tee_fs_htree_type type;
+	size_t idx;
+	uint8_t vers;
+	void *data;
+	size_t len;
+};
+
 /**
  * struct tee_fs_htree_storage - storage description supplied by user of
  * this interface
- * @block_size:		size of data blocks
+ * @block_size:		size of data blocks with a block shift of 0
+ * @block_shift:	data blocks of new hash trees are
+ *			@block_size << @block_shift bytes
+ * @fan_out:		number of children of each node in new hash trees,
+ *			0 means 2
  * @rpc_read_init:	initialize a struct tee_fs_rpc_operation for an RPC read
  *			operation
  * @rpc_write_init:	initialize a struct tee_fs_rpc_operation for an RPC
  *			write operation
+ * @rpc_read_vec:	optional, reads several elements with a single RPC
+ * @rpc_write_vec:	optional, writes several elements in order with a
+ *			single RPC
+ * @set_block_size:	optional, tells the size of the data blocks of the
+ *			hash tree being opened or created. Called before any
+ *			element other than the head and the root node is
+ *			accessed.
+ *
+ * The block shift and fan-out are recorded in the head of each hash tree
+ * when it's created, a hash tree keeps its geometry for its life time.
  *
  * The @idx arguments starts counting from 0. The @vers arguments are either
  * 0 or 1. The @data arguments is a pointer to a buffer in non-secure shared
@@ -85,6 +127,8 @@ struct tee_fs_rpc_operation;
  */
 struct tee_fs_htree_storage {
 	size_t block_size;
+	uint8_t block_shift;
+	uint8_t fan_out;
 	TEE_Result (*rpc_read_init)(void *aux, struct tee_fs_rpc_operation *op,
 				    enum tee_fs_htree_type type, size_t idx,
 				    uint8_t vers, void **data);
@@ -94,6 +138,13 @@ struct tee_fs_htree_storage {
 				     enum tee_fs_htree_type type, size_t idx,
 				     uint8_t vers, void **data);
 	TEE_Result (*rpc_write_final)(struct tee_fs_rpc_operation *op);
+	TEE_Result (*rpc_read_vec)(void *aux,
+				   const struct tee_fs_htree_extent *ext,
+				   size_t num_ext);
+	TEE_Result (*rpc_write_vec)(void *aux,
+				    const struct tee_fs_htree_extent *ext,
+				    size_t num_ext);
+	void (*set_block_size)(void *aux, size_t block_size);
 };
 
 struct tee_fs_htree;
@@ -125,6 +176,12 @@ void tee_fs_htree_close(struct tee_fs_htree **ht);
  */
 struct tee_fs_htree_meta *tee_fs_htree_get_meta(struct tee_fs_htree *ht);
 
+/**
+ * tee_fs_htree_get_block_size() - get the size of the data blocks
+ * @ht:		hash tree
+ */
+size_t tee_fs_htree_get_block_size(struct tee_fs_htree *ht);
+
 /**
  * tee_fs_htree_meta_set_dirty() - tell hash tree that meta were modified
  */
@@ -153,7 +210,7 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht, size_t block_num);
  * tee_fs_htree_write_block() - encrypt and write a data block to storage
  * @ht:		hash tree
  * @block_num:	block number
- * @block:	pointer to a block of stor->block_size size
+ * @block:	pointer to a block of tee_fs_htree_get_block_size() size
  *
  * Frees the hash tree and sets *ht to NULL on failure and returns an error code
  */
@@ -163,7 +220,7 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht, size_t block_num,
  * tee_fs_htree_write_block() - read and decrypt a data block from storage
  * @ht:		hash tree
  * @block_num:	block number
- * @block:	pointer to a block of stor->block_size size
+ * @block:	pointer to a block of tee_fs_htree_get_block_size() size
  *
  * Frees the hash tree and sets *ht to NULL on failure and returns an error code
  */
@@ -76,6 +76,26 @@ struct tee_file_operations {
 #ifdef CFG_REE_FS
 extern const struct tee_file_operations ree_fs_ops;
 #endif
+
+/* Statistics on the REE FS block cache */
+struct tee_ree_fs_cache_stats {
+	size_t hits;		/* Blocks found in the cache */
+	size_t misses;		/* Blocks read from storage into the cache */
+	size_t coalesced;	/* Block writes merged into an earlier one */
+	size_t evictions;	/* Blocks evicted to make room */
+	uint64_t bytes_saved;	/* Bytes not decrypted/encrypted and sent */
+};
+
+#if defined(CFG_REE_FS_BLOCK_CACHE) && defined(CFG_WITH_STATS)
+void tee_ree_fs_get_cache_stats(struct tee_ree_fs_cache_stats *stats);
+#else
+static inline void tee_ree_fs_get_cache_stats(
+			struct tee_ree_fs_cache_stats *stats)
+{
+	*stats = (struct tee_ree_fs_cache_stats){ 0 };
+}
+#endif
+
 #ifdef CFG_RPMB_FS
 extern const struct tee_file_operations rpmb_fs_ops;
 
@@ -83,4 +103,21 @@ TEE_Result tee_rpmb_fs_raw_open(const char *fname, bool create,
 				struct tee_file_handle **fh);
 #endif
 
+/* Statistics on the RPMB FS */
+struct tee_rpmb_fs_stats {
+	size_t requests;	/* RPMB requests sent to normal world */
+	size_t frames;		/* Data frames sent and received */
+	size_t fat_loads;	/* FAT read from RPMB into the FAT cache */
+	size_t fat_hits;	/* Files found with the FAT cache index */
+};
+
+#if defined(CFG_RPMB_FS) && defined(CFG_WITH_STATS)
+void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats);
+#else
+static inline void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats)
+{
+	*stats = (struct tee_rpmb_fs_stats){ 0 };
+}
+#endif
+
 #endif /*TEE_FS_H*/
@@ -12,6 +12,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 #include <tee_api_types.h>
 #include <tee/tee_fs.h>
 #include <kernel/thread.h>
@@ -44,6 +45,28 @@ TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op,
 				 size_t data_len, void **data);
 TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op);
 
+/*
+ * struct tee_fs_rpc_iovec - one extent of a vectored read or write
+ * @offs:	offset into file
+ * @data:	data to write or buffer to receive the data read
+ * @len:	length of @data
+ */
+struct tee_fs_rpc_iovec {
+	tee_fs_off_t offs;
+	void *data;
+	size_t len;
+};
+
+/*
+ * Reads or writes several extents of a file with a single request to
+ * tee-supplicant, requires a tee-supplicant supporting OPTEE_MRF_READV
+ * and OPTEE_MRF_WRITEV.
+ */
+TEE_Result tee_fs_rpc_readv(uint32_t id, int fd,
+			    const struct tee_fs_rpc_iovec *iov, size_t num_iov);
+TEE_Result tee_fs_rpc_writev(uint32_t id, int fd,
+			     const struct tee_fs_rpc_iovec *iov,
+			     size_t num_iov);
 
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len);
 TEE_Result tee_fs_rpc_remove(uint32_t id, struct tee_pobj *po);
@@ -58,21 +81,36 @@ TEE_Result tee_fs_rpc_closedir(uint32_t id, struct tee_fs_dir *d);
 TEE_Result tee_fs_rpc_readdir(uint32_t id, struct tee_fs_dir *d,
 			      struct tee_fs_dirent **ent);
 
+/* Statistics on the FS RPC payload cache */
+struct tee_fs_rpc_cache_stats {
+	size_t hits;		/* Requests served by a cached buffer */
+	size_t misses;		/* Requests needing a new buffer */
+	size_t evictions;	/* Cached buffers freed for a larger one */
+};
+
 struct thread_specific_data;
 #if defined(CFG_WITH_USER_TA) && (defined(CFG_REE_FS) || defined(CFG_RPMB_FS))
 /* Frees the cache of allocated FS RPC memory */
 void tee_fs_rpc_cache_clear(struct thread_specific_data *tsd);
+void tee_fs_rpc_cache_get_stats(struct tee_fs_rpc_cache_stats *stats);
 #else
 static inline void tee_fs_rpc_cache_clear(
 			struct thread_specific_data *tsd __unused)
 {
 }
+
+static inline void tee_fs_rpc_cache_get_stats(
+			struct tee_fs_rpc_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
 #endif
 
 /*
  * Returns a pointer to the cached FS RPC memory. Each thread has a unique
- * cache. The pointer is guaranteed to point to a large enough area or to
- * be NULL.
+ * cache with one buffer per size class, so a buffer stays valid until
+ * the next call requesting a size in the same class. The pointer is
+ * guaranteed to point to a large enough area or to be NULL.
  */
 void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie);
 
@@ -91,6 +91,23 @@ TEE_Result syscall_check_access_rights(unsigned long flags, const void *buf,
 TEE_Result tee_svc_copy_from_user(void *kaddr, const void *uaddr, size_t len);
 TEE_Result tee_svc_copy_to_user(void *uaddr, const void *kaddr, size_t len);
 
+/*
+ * Memory references passed between user TAs, either copied via a
+ * temporary buffer or mapped directly into the called TA
+ */
+struct tee_svc_param_stats {
+	size_t copied_memrefs;
+	size_t copied_bytes;
+	size_t mapped_memrefs;
+	size_t mapped_bytes;
+};
+
+/*
+ * tee_svc_get_param_stats() - Get and reset the memref statistics
+ * @stats:	Receives the counters accumulated since last call
+ */
+void tee_svc_get_param_stats(struct tee_svc_param_stats *stats);
+
 TEE_Result tee_svc_copy_kaddr_to_uref(uint32_t *uref, void *kaddr);
 
 static inline uint32_t tee_svc_kaddr_to_uref(void *kaddr)
@@ -54,10 +54,177 @@
 #include <utee_types.h>
 #include <util.h>
 
-/* This mutex protects the critical section in tee_ta_init_session */
+/*
+ * This mutex protects the critical section in tee_ta_init_session, the
+ * lists of open sessions and contexts and the hash tables below.
+ */
 struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+/*
+ * Sessions are hashed on their id and contexts on their UUID so that
+ * the lookup done for each invoke command or open session doesn't have
+ * to walk all the sessions or contexts. Number of buckets must be a
+ * power of 2.
+ */
+#define SESS_HASH_BITS		6
+#define CTX_HASH_BITS		4
+
+static struct tee_ta_session_bucket sess_hash[BIT(SESS_HASH_BITS)];
+static struct tee_ta_ctx_bucket ctx_hash[BIT(CTX_HASH_BITS)];
+
+#ifdef CFG_WITH_STATS
+static struct tee_ta_mgr_stats mgr_stats;
+
+static inline void incr_sess_lookups(void)
+{
+	mgr_stats.sess_lookups++;
+}
+
+static inline void incr_sess_probes(void)
+{
+	mgr_stats.sess_probes++;
+}
+
+static inline void incr_ctx_lookups(void)
+{
+	mgr_stats.ctx_lookups++;
+}
+
+static inline void incr_ctx_probes(void)
+{
+	mgr_stats.ctx_probes++;
+}
+
+static inline void incr_ctx_linger_hits(void)
+{
+	mgr_stats.ctx_linger_hits++;
+}
+
+void tee_ta_get_mgr_stats(struct tee_ta_mgr_stats *stats)
+{
+	mutex_lock(&tee_ta_mutex);
+	*stats = mgr_stats;
+	memset(&mgr_stats, 0, sizeof(mgr_stats));
+	mutex_unlock(&tee_ta_mutex);
+}
+#else /* CFG_WITH_STATS */
+static inline void incr_sess_lookups(void) { }
+static inline void incr_sess_probes(void) { }
+static inline void incr_ctx_lookups(void) { }
+static inline void incr_ctx_probes(void) { }
+static inline void incr_ctx_linger_hits(void) { }
+
+void tee_ta_get_mgr_stats(struct tee_ta_mgr_stats *stats)
+{
+	memset(stats, 0, sizeof(struct tee_ta_mgr_stats));
+}
+#endif /* CFG_WITH_STATS */
+
+/* Fibonacci hashing, keeps the upper bits of the product */
+static size_t hash32(uint32_t key, unsigned int bits)
+{
+	return (uint32_t)(key * 0x9e3779b1) >> (32 - bits);
+}
+
+static struct tee_ta_session_bucket *sess_bucket(uint32_t id)
+{
+	return sess_hash + hash32(id, SESS_HASH_BITS);
+}
+
+static struct tee_ta_ctx_bucket *ctx_bucket(const TEE_UUID *uuid)
+{
+	uint32_t key = uuid->timeLow ^
+		       ((uint32_t)uuid->timeMid << 16 | uuid->timeHiAndVersion);
+	size_t n;
+
+	for (n = 0; n < sizeof(uuid->clockSeqAndNode); n++)
+		key ^= (uint32_t)uuid->clockSeqAndNode[n] << (8 * (n % 4));
+
+	return ctx_hash + hash32(key, CTX_HASH_BITS);
+}
+
+static void link_session(struct tee_ta_session *s,
+			 struct tee_ta_session_head *open_sessions)
+{
+	s->open_sessions = open_sessions;
+	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	LIST_INSERT_HEAD(sess_bucket((vaddr_t)s), s, hlink);
+}
+
+static void unlink_session(struct tee_ta_session *s)
+{
+	LIST_REMOVE(s, hlink);
+	TAILQ_REMOVE(s->open_sessions, s, link);
+	s->open_sessions = NULL;
+}
+
+void tee_ta_register_ctx(struct tee_ta_ctx *ctx)
+{
+	TAILQ_INSERT_TAIL(&tee_ctxes, ctx, link);
+	LIST_INSERT_HEAD(ctx_bucket(&ctx->uuid), ctx, hlink);
+}
+
+static void unregister_ctx(struct tee_ta_ctx *ctx)
+{
+	LIST_REMOVE(ctx, hlink);
+	TAILQ_REMOVE(&tee_ctxes, ctx, link);
+}
+
+#if CFG_TA_LINGER_CTX_NUM > 0
+/*
+ * Single instance TA contexts with TA_FLAG_INSTANCE_LINGER without any
+ * session which are kept loaded, least recently closed first. Protected
+ * by tee_ta_mutex.
+ */
+static struct tee_ta_ctx_head linger_ctxes =
+	TAILQ_HEAD_INITIALIZER(linger_ctxes);
+static size_t linger_ctx_count;
+
+static bool unlinger_ctx(struct tee_ta_ctx *ctx)
+{
+	if (!ctx->lingering)
+		return false;
+
+	TAILQ_REMOVE(&linger_ctxes, ctx, linger_link);
+	ctx->lingering = false;
+	linger_ctx_count--;
+	return true;
+}
+
+/*
+ * Keeps @ctx loaded if possible, returns the context which is to be
+ * destroyed instead, if any.
+ */
+static struct tee_ta_ctx *linger_ctx(struct tee_ta_ctx *ctx)
+{
+	const uint32_t f = TA_FLAG_SINGLE_INSTANCE | TA_FLAG_INSTANCE_LINGER;
+
+	if (!is_user_ta_ctx(ctx) || (ctx->flags & f) != f || ctx->panicked)
+		return ctx;
+
+	TAILQ_INSERT_TAIL(&linger_ctxes, ctx, linger_link);
+	ctx->lingering = true;
+	linger_ctx_count++;
+	if (linger_ctx_count <= CFG_TA_LINGER_CTX_NUM)
+		return NULL;
+
+	ctx = TAILQ_FIRST(&linger_ctxes);
+	unlinger_ctx(ctx);
+	return ctx;
+}
+#else
+static bool unlinger_ctx(struct tee_ta_ctx *ctx __unused)
+{
+	return false;
+}
+
+static struct tee_ta_ctx *linger_ctx(struct tee_ta_ctx *ctx)
+{
+	return ctx;
+}
+#endif
+
 #ifndef CFG_CONCURRENT_SINGLE_INSTANCE_TA
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static int tee_ta_single_instance_thread = THREAD_ID_INVALID;
@@ -201,8 +368,10 @@ static struct tee_ta_session *find_session(uint32_t id,
 {
 	struct tee_ta_session *s;
 
-	TAILQ_FOREACH(s, open_sessions, link) {
-		if ((vaddr_t)s == id)
+	incr_sess_lookups();
+	LIST_FOREACH(s, sess_bucket(id), hlink) {
+		incr_sess_probes();
+		if ((vaddr_t)s == id && s->open_sessions == open_sessions)
 			return s;
 	}
 	return NULL;
@@ -247,7 +416,7 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 }
 
 static void tee_ta_unlink_session(struct tee_ta_session *s,
-			struct tee_ta_session_head *open_sessions)
+		struct tee_ta_session_head *open_sessions __maybe_unused)
 {
 	mutex_lock(&tee_ta_mutex);
 
@@ -261,20 +430,23 @@ static void tee_ta_unlink_session(struct tee_ta_session *s,
 	while (s->ref_count != 1)
 		condvar_wait(&s->refc_cv, &tee_ta_mutex);
 
-	TAILQ_REMOVE(open_sessions, s, link);
+	assert(s->open_sessions == open_sessions);
+	unlink_session(s);
 
 	mutex_unlock(&tee_ta_mutex);
 }
 
 /*
- * tee_ta_context_find - Find TA in session list based on a UUID (input)
+ * tee_ta_context_find - Find TA in context hash based on a UUID (input)
  * Returns a pointer to the session
  */
 static struct tee_ta_ctx *tee_ta_context_find(const TEE_UUID *uuid)
 {
 	struct tee_ta_ctx *ctx;
 
-	TAILQ_FOREACH(ctx, &tee_ctxes, link) {
+	incr_ctx_lookups();
+	LIST_FOREACH(ctx, ctx_bucket(uuid), hlink) {
+		incr_ctx_probes();
 		if (memcmp(&ctx->uuid, uuid, sizeof(TEE_UUID)) == 0)
 			return ctx;
 	}
@@ -444,10 +616,15 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 	ctx->ref_count--;
 	keep_alive = (ctx->flags & TA_FLAG_INSTANCE_KEEP_ALIVE) &&
 			(ctx->flags & TA_FLAG_SINGLE_INSTANCE);
-	if (!ctx->ref_count && !keep_alive) {
+	if (!ctx->ref_count && !keep_alive)
+		ctx = linger_ctx(ctx);
+	else
+		ctx = NULL;
+
+	if (ctx) {
 		DMSG("Destroy TA ctx");
 
-		TAILQ_REMOVE(&tee_ctxes, ctx, link);
+		unregister_ctx(ctx);
 		mutex_unlock(&tee_ta_mutex);
 
 		condvar_destroy(&ctx->busy_cv);
@@ -481,6 +658,8 @@ static TEE_Result tee_ta_init_session_with_context(struct tee_ta_ctx *ctx,
 
 	DMSG("Re-open TA %pUl", (void *)&ctx->uuid);
 
+	if (unlinger_ctx(ctx))
+		incr_ctx_linger_hits();
 	ctx->ref_count++;
 	s->ctx = ctx;
 	return TEE_SUCCESS;
@@ -515,7 +694,7 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 
 
 	mutex_lock(&tee_ta_mutex);
-	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	link_session(s, open_sessions);
 
 	/* Look for already loaded TA */
 	ctx = tee_ta_context_find(uuid);
@@ -537,7 +716,7 @@ out:
 	if (res == TEE_SUCCESS) {
 		*sess = s;
 	} else {
-		TAILQ_REMOVE(open_sessions, s, link);
+		unlink_session(s);
 		free(s);
 	}
 	mutex_unlock(&tee_ta_mutex);
@@ -36,4 +36,13 @@ extern mpa_scratch_mem external_mem_pool;
 
 void init_mpa_tomcrypt(mpa_scratch_mem pool);
 
+/*
+ * Keeps the Montgomery context of the key modulus n between exptmod
+ * operations until n is modified (tee_ltc_mont_cache_invalidate()) or
+ * freed (tee_ltc_mont_cache_del()).
+ */
+void tee_ltc_mont_cache_add(void *n);
+void tee_ltc_mont_cache_del(void *n);
+void tee_ltc_mont_cache_invalidate(void *n);
+
 #endif /* TOMCRYPT_MPA_H_ */
@@ -353,6 +353,12 @@ void ltc_ecc_fp_tablelock(int lock);
 /* R = kG */
 int ltc_ecc_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map);
 
+#ifdef CFG_CRYPTO_ECC_COMB
+/* R = kG with G the generator of dp, using a fixed-base comb table */
+int ltc_ecc_mulmod_base(void *k, const ltc_ecc_set_type *dp, ecc_point *G,
+                        ecc_point *R, void *modulus, int map);
+#endif
+
 #ifdef LTC_ECC_SHAMIR
 /* kA*A + kB*B = C */
 int ltc_ecc_mul2add(ecc_point *A, void *kA,
@@ -27,7 +27,11 @@
  */
 
 #include "tomcrypt_mpa.h"
+#include <atomic.h>
+#include <kernel/mutex.h>
 #include <mpa.h>
+#include <string.h>
+#include <sys/queue.h>
 
 mpa_scratch_mem external_mem_pool;
 
@@ -36,6 +40,179 @@ void init_mpa_tomcrypt(const mpa_scratch_mem pool)
 	external_mem_pool = pool;
 }
 
+/*
+ * Montgomery contexts of key moduli, kept between operations since
+ * computing R^2 mod n costs a full modular reduction of a number twice the
+ * size of the modulus. The context is recomputed if the modulus doesn't
+ * match the value it was computed for.
+ */
+struct mont_cache {
+	const void *n;
+	mpa_fmm_context ctx;	/* NULL until the first exptmod */
+	mpanum n_val;		/* value of n when ctx was computed */
+	size_t size;		/* size of the ctx allocation in bytes */
+	SLIST_ENTRY(mont_cache) link;
+};
+
+#define MONT_CACHE_BUCKETS	32
+
+SLIST_HEAD(mont_cache_head, mont_cache);
+
+/* The entries are hashed on the address of the modulus */
+static struct mont_cache_head mont_cache_heads[MONT_CACHE_BUCKETS];
+static struct mutex mont_cache_mu = MUTEX_INITIALIZER;
+
+/*
+ * Number of entries in each bucket, updated with mont_cache_mu held but
+ * read without it so that a bignum which hashes to an empty bucket, that
+ * is almost every bignum, doesn't take the mutex when it's freed or
+ * updated. A modulus is only added and removed by the owner of the key,
+ * so its bucket can't be seen empty while it's in the cache.
+ */
+static unsigned int mont_cache_count[MONT_CACHE_BUCKETS];
+
+static size_t mont_cache_hash(const void *n)
+{
+	/* The low bits of heap addresses carry no information */
+	return ((vaddr_t)n >> 4) % MONT_CACHE_BUCKETS;
+}
+
+static bool mont_cache_may_hold(const void *n)
+{
+	return atomic_load_uint(mont_cache_count + mont_cache_hash(n));
+}
+
+static struct mont_cache *mont_cache_find(const void *n)
+{
+	struct mont_cache *mc;
+
+	SLIST_FOREACH(mc, mont_cache_heads + mont_cache_hash(n), link)
+		if (mc->n == n)
+			return mc;
+	return NULL;
+}
+
+/* R mod p reveals p so the contexts of private moduli are wiped */
+static void mont_cache_free_ctx(struct mont_cache *mc)
+{
+	if (mc->ctx)
+		memset(mc->ctx, 0, mc->size);
+	free(mc->ctx);
+	mc->ctx = NULL;
+	mc->n_val = NULL;
+	mc->size = 0;
+}
+
+void tee_ltc_mont_cache_add(void *n)
+{
+	size_t h = mont_cache_hash(n);
+	struct mont_cache *mc;
+
+	mutex_lock(&mont_cache_mu);
+	if (!mont_cache_find(n)) {
+		mc = calloc(1, sizeof(*mc));
+		if (mc) {
+			mc->n = n;
+			SLIST_INSERT_HEAD(mont_cache_heads + h, mc, link);
+			atomic_store_uint(mont_cache_count + h,
+					  mont_cache_count[h] + 1);
+		}
+	}
+	mutex_unlock(&mont_cache_mu);
+}
+
+void tee_ltc_mont_cache_del(void *n)
+{
+	size_t h = mont_cache_hash(n);
+	struct mont_cache *mc;
+
+	if (!mont_cache_may_hold(n))
+		return;
+
+	mutex_lock(&mont_cache_mu);
+	mc = mont_cache_find(n);
+	if (mc) {
+		SLIST_REMOVE(mont_cache_heads + h, mc, mont_cache, link);
+		atomic_store_uint(mont_cache_count + h,
+				  mont_cache_count[h] - 1);
+		mont_cache_free_ctx(mc);
+		free(mc);
+	}
+	mutex_unlock(&mont_cache_mu);
+}
+
+void tee_ltc_mont_cache_invalidate(void *n)
+{
+	struct mont_cache *mc;
+
+	if (!mont_cache_may_hold(n))
+		return;
+
+	mutex_lock(&mont_cache_mu);
+	mc = mont_cache_find(n);
+	if (mc)
+		mont_cache_free_ctx(mc);
+	mutex_unlock(&mont_cache_mu);
+}
+
+/* Copies the cached context of n into ctx, returns false on a miss */
+static bool mont_cache_get(const mpanum n, mpa_fmm_context ctx)
+{
+	struct mont_cache *mc;
+	bool hit = false;
+
+	if (!mont_cache_may_hold(n))
+		return false;
+
+	mutex_lock(&mont_cache_mu);
+	mc = mont_cache_find(n);
+	if (mc && mc->ctx && !mpa_cmp(mc->n_val, n)) {
+		mpa_copy(ctx->r_ptr, mc->ctx->r_ptr);
+		mpa_copy(ctx->r2_ptr, mc->ctx->r2_ptr);
+		ctx->n_inv = mc->ctx->n_inv;
+		hit = true;
+	}
+	mutex_unlock(&mont_cache_mu);
+
+	return hit;
+}
+
+/* Stores ctx of size len words if n is a registered key modulus */
+static void mont_cache_put(const mpanum n, const mpa_fmm_context ctx,
+			   mpa_word_t len)
+{
+	size_t n_len = mpa_StaticVarSizeInU32(mpa_highest_bit_index(n) + 1);
+	struct mont_cache *mc;
+	mpa_fmm_context c;
+
+	if (!mont_cache_may_hold(n))
+		return;
+
+	mutex_lock(&mont_cache_mu);
+	mc = mont_cache_find(n);
+	if (!mc)
+		goto out;
+
+	mont_cache_free_ctx(mc);
+	mc->size = (len + n_len) * sizeof(mpa_word_t);
+	c = malloc(mc->size);
+	if (!c) {
+		mc->size = 0;
+		goto out;
+	}
+	mpa_init_static_fmm_context(c, len);
+	mpa_copy(c->r_ptr, ctx->r_ptr);
+	mpa_copy(c->r2_ptr, ctx->r2_ptr);
+	c->n_inv = ctx->n_inv;
+
+	mc->n_val = (mpanum)((mpa_word_t *)c + len);
+	mpa_init_static(mc->n_val, n_len);
+	mpa_copy(mc->n_val, n);
+	mc->ctx = c;
+out:
+	mutex_unlock(&mont_cache_mu);
+}
+
 static int init_mpanum(mpanum *a)
 {
 	LTC_ARGCHK(a != NULL);
@@ -481,7 +658,10 @@ static int montgomery_setup(void *a, void **b)
 	}
 	mpa_fmm_context_base * b_tmp = (mpa_fmm_context_base *) *b;
 	mpa_init_static_fmm_context(b_tmp, len);
+	if (mont_cache_get(a, b_tmp))
+		return CRYPT_OK;
 	mpa_compute_fmm_context((const mpanum) a, b_tmp->r_ptr, b_tmp->r2_ptr, &(b_tmp->n_inv), external_mem_pool);
+	mont_cache_put(a, b_tmp, len);
 	return CRYPT_OK;
 }
 
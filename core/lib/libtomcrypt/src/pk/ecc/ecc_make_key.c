@@ -132,7 +132,11 @@ int ecc_make_key_ex(prng_state *prng, int wprng, ecc_key *key, const ltc_ecc_set
        if((err = mp_mod(key->k, order, key->k)) != CRYPT_OK)                                    { goto errkey; }
    }
    /* make the public key */
+#ifdef CFG_CRYPTO_ECC_COMB
+   if ((err = ltc_ecc_mulmod_base(key->k, dp, base, &key->pubkey, prime, 1)) != CRYPT_OK)       { goto errkey; }
+#else
    if ((err = ltc_mp.ecc_ptmul(key->k, base, &key->pubkey, prime, 1)) != CRYPT_OK)              { goto errkey; }
+#endif
    key->type = PK_PRIVATE;
 
    /* free up ram */
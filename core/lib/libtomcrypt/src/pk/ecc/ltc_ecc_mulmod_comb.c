@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Copyright (c) 2018, Linaro Limited
+ */
+
+#include <kernel/mutex.h>
+#include <mpalib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tomcrypt.h>
+#include <util.h>
+
+/*
+ * Fixed-base comb multiplication of the generator of the NIST curves
+ * (HAC algorithm 14.117). The scalar is split into COMB_WIDTH rows of
+ * d bits; column i of the comb selects the sum of the generator multiples
+ * 2^(j * d) * G for the rows j with bit i set. That is d doublings and d
+ * additions instead of the one doubling and one addition per bit of the
+ * Montgomery ladder.
+ */
+#define COMB_WIDTH	5
+#define COMB_ENTRIES	(1 << COMB_WIDTH)
+
+/*
+ * Affine points in Montgomery form, x followed by y, "words" words each.
+ * Entry 0 would be the point at infinity, it holds G instead so that the
+ * dummy addition done for an all zero column has a valid operand.
+ */
+struct comb_table {
+	size_t words;
+	size_t spacing;
+	mpa_word_t pts[];
+};
+
+static const char *const comb_curves[] = { "ECC-256", "ECC-384", "ECC-521" };
+static struct comb_table *comb_tables[ARRAY_SIZE(comb_curves)];
+static struct mutex comb_mu = MUTEX_INITIALIZER;
+
+static mpa_word_t *comb_entry(struct comb_table *t, size_t idx)
+{
+	return t->pts + idx * 2 * t->words;
+}
+
+static void store_num(mpa_word_t *dst, void *src, size_t words)
+{
+	mpanum n = src;
+
+	memset(dst, 0, words * sizeof(mpa_word_t));
+	memcpy(dst, n->d, n->size * sizeof(mpa_word_t));
+}
+
+static void set_size(mpanum n, size_t words)
+{
+	n->size = words;
+	while (n->size > 0 && n->d[n->size - 1] == 0)
+		n->size--;
+}
+
+/* Reads entry idx while accessing all entries */
+static void load_entry(struct comb_table *t, size_t idx, ecc_point *q)
+{
+	mpanum x = q->x;
+	mpanum y = q->y;
+	mpa_word_t mask;
+	mpa_word_t *e;
+	size_t n;
+	size_t i;
+
+	memset(x->d, 0, t->words * sizeof(mpa_word_t));
+	memset(y->d, 0, t->words * sizeof(mpa_word_t));
+	for (n = 0; n < COMB_ENTRIES; n++) {
+		/* All ones if n == idx, both are less than 2^31 */
+		mask = 0 - ((mpa_word_t)((n ^ idx) - 1) >> 31);
+		e = comb_entry(t, n);
+		for (i = 0; i < t->words; i++) {
+			x->d[i] |= e[i] & mask;
+			y->d[i] |= e[t->words + i] & mask;
+		}
+	}
+	set_size(x, t->words);
+	set_size(y, t->words);
+}
+
+/* dst = mask ? src : dst */
+static void cond_copy(void *dst, void *src, mpa_word_t mask, size_t words)
+{
+	mpanum d = dst;
+	mpanum s = src;
+	size_t i;
+
+	for (i = 0; i < words; i++)
+		d->d[i] = (d->d[i] & ~mask) | (s->d[i] & mask);
+	d->size = (d->size & ~mask) | (s->size & mask);
+}
+
+static void cond_copy_point(ecc_point *dst, ecc_point *src, void *src_z,
+			    mpa_word_t mask, size_t words)
+{
+	cond_copy(dst->x, src->x, mask, words);
+	cond_copy(dst->y, src->y, mask, words);
+	cond_copy(dst->z, src_z, mask, words);
+}
+
+/* Sets P = Q in Montgomery form */
+static int to_montgomery(ecc_point *P, ecc_point *Q, void *modulus, void *mu)
+{
+	int err;
+
+	err = mp_mulmod(Q->x, mu, modulus, P->x);
+	if (err == CRYPT_OK)
+		err = mp_mulmod(Q->y, mu, modulus, P->y);
+	if (err == CRYPT_OK)
+		err = mp_copy(mu, P->z);
+	return err;
+}
+
+/*
+ * Builds the table from the generator G. This is done once per curve and
+ * only involves public values, so it doesn't need to be constant time.
+ */
+static struct comb_table *comb_build(ecc_point *G, void *modulus, void *mp,
+				     void *mu)
+{
+	size_t words = mp_get_digit_count(modulus);
+	size_t spacing = (mp_count_bits(modulus) + COMB_WIDTH - 1) / COMB_WIDTH;
+	ecc_point *pts[COMB_ENTRIES] = { NULL };
+	struct comb_table *t;
+	size_t i;
+	size_t j;
+	int err;
+
+	t = calloc(1, sizeof(*t) +
+		      COMB_ENTRIES * 2 * words * sizeof(mpa_word_t));
+	if (!t)
+		return NULL;
+	t->words = words;
+	t->spacing = spacing;
+
+	for (i = 0; i < COMB_ENTRIES; i++) {
+		pts[i] = ltc_ecc_new_point();
+		if (!pts[i])
+			goto err;
+	}
+
+	/* pts[2^j] = 2^(j * spacing) * G */
+	err = to_montgomery(pts[1], G, modulus, mu);
+	if (err != CRYPT_OK)
+		goto err;
+	for (j = 1; j < COMB_WIDTH; j++) {
+		err = ltc_mp.ecc_ptdbl(pts[1 << (j - 1)], pts[1 << j],
+				       modulus, mp);
+		for (i = 1; i < spacing && err == CRYPT_OK; i++)
+			err = ltc_mp.ecc_ptdbl(pts[1 << j], pts[1 << j],
+					       modulus, mp);
+		if (err != CRYPT_OK)
+			goto err;
+	}
+
+	/* pts[i] = pts[i - 2^j] + pts[2^j] with 2^j the top bit of i */
+	for (j = 1; j < COMB_WIDTH; j++) {
+		for (i = (1 << j) + 1; i < (1U << (j + 1)); i++) {
+			err = ltc_mp.ecc_ptadd(pts[i - (1 << j)], pts[1 << j],
+					       pts[i], modulus, mp);
+			if (err != CRYPT_OK)
+				goto err;
+		}
+	}
+
+	for (i = 1; i < COMB_ENTRIES; i++) {
+		err = ltc_ecc_map(pts[i], modulus, mp);
+		if (err == CRYPT_OK)
+			err = to_montgomery(pts[i], pts[i], modulus, mu);
+		if (err != CRYPT_OK)
+			goto err;
+		store_num(comb_entry(t, i), pts[i]->x, words);
+		store_num(comb_entry(t, i) + words, pts[i]->y, words);
+	}
+	memcpy(comb_entry(t, 0), comb_entry(t, 1),
+	       2 * words * sizeof(mpa_word_t));
+
+	for (i = 0; i < COMB_ENTRIES; i++)
+		ltc_ecc_del_point(pts[i]);
+	return t;
+err:
+	for (i = 0; i < COMB_ENTRIES; i++)
+		if (pts[i])
+			ltc_ecc_del_point(pts[i]);
+	free(t);
+	return NULL;
+}
+
+static struct comb_table *comb_get_table(const ltc_ecc_set_type *dp,
+					 ecc_point *G, void *modulus,
+					 void *mp, void *mu)
+{
+	struct comb_table *t = NULL;
+	size_t n;
+
+	for (n = 0; n < ARRAY_SIZE(comb_curves); n++)
+		if (!strcmp(dp->name, comb_curves[n]))
+			break;
+	if (n == ARRAY_SIZE(comb_curves))
+		return NULL;
+
+	mutex_lock(&comb_mu);
+	if (!comb_tables[n])
+		comb_tables[n] = comb_build(G, modulus, mp, mu);
+	t = comb_tables[n];
+	mutex_unlock(&comb_mu);
+
+	return t;
+}
+
+static size_t comb_column(const mpa_word_t *k, size_t spacing, size_t col)
+{
+	size_t idx = 0;
+	size_t bit;
+	size_t j;
+
+	for (j = 0; j < COMB_WIDTH; j++) {
+		bit = j * spacing + col;
+		idx |= ((k[bit / MPA_WORD_SIZE] >> (bit % MPA_WORD_SIZE)) &
+			1) << j;
+	}
+
+	return idx;
+}
+
+static int comb_mulmod(void *k, struct comb_table *t, ecc_point *R,
+		       void *modulus, void *mp, void *mu)
+{
+	size_t kwords = (COMB_WIDTH * t->spacing + MPA_WORD_SIZE - 1) /
+			MPA_WORD_SIZE;
+	mpa_word_t *kbuf;
+	mpa_word_t is_inf = ~(mpa_word_t)0;
+	mpa_word_t mask;
+	ecc_point *acc;
+	ecc_point *sum;
+	ecc_point *q;
+	void *q_z;
+	size_t idx;
+	size_t col;
+	int err = CRYPT_MEM;
+
+	if (mp_get_digit_count(k) > (int)kwords)
+		return CRYPT_INVALID_ARG;
+
+	kbuf = calloc(kwords, sizeof(mpa_word_t));
+	acc = ltc_ecc_new_point();
+	sum = ltc_ecc_new_point();
+	q = ltc_ecc_new_point();
+	if (!kbuf || !acc || !sum || !q)
+		goto out;
+	memcpy(kbuf, ((mpanum)k)->d,
+	       mp_get_digit_count(k) * sizeof(mpa_word_t));
+
+	/* Table entries are affine, which saves a few multiplications */
+	q_z = q->z;
+	q->z = NULL;
+
+	/* acc starts as the point at infinity */
+	mp_copy(mu, acc->x);
+	mp_copy(mu, acc->y);
+	mp_set(acc->z, 0);
+
+	/*
+	 * Every column does the same doubling, table scan and addition. The
+	 * result of the addition is discarded for an all zero column and
+	 * replaced by the table entry as long as acc is the point at
+	 * infinity, using masks instead of branches. This only keeps the
+	 * table access and the sequence of point operations independent of
+	 * k: ltc_mp.ecc_ptdbl() and ltc_mp.ecc_ptadd() still branch on
+	 * their operands (point at infinity, equal points) and the bignum
+	 * arithmetic below them isn't constant time either.
+	 */
+	col = t->spacing;
+	while (col--) {
+		err = ltc_mp.ecc_ptdbl(acc, acc, modulus, mp);
+		if (err != CRYPT_OK)
+			break;
+		idx = comb_column(kbuf, t->spacing, col);
+		load_entry(t, idx, q);
+		err = ltc_mp.ecc_ptadd(acc, q, sum, modulus, mp);
+		if (err != CRYPT_OK)
+			break;
+
+		/* All ones if idx != 0 */
+		mask = 0 - (mpa_word_t)((idx | (0 - idx)) >>
+					(sizeof(idx) * 8 - 1));
+		cond_copy_point(acc, sum, sum->z, mask & ~is_inf, t->words);
+		cond_copy_point(acc, q, mu, mask & is_inf, t->words);
+		is_inf &= ~mask;
+	}
+
+	q->z = q_z;
+	if (err == CRYPT_OK)
+		err = mp_copy(acc->x, R->x);
+	if (err == CRYPT_OK)
+		err = mp_copy(acc->y, R->y);
+	if (err == CRYPT_OK)
+		err = mp_copy(acc->z, R->z);
+out:
+	if (kbuf) {
+		memset(kbuf, 0, kwords * sizeof(mpa_word_t));
+		free(kbuf);
+	}
+	ltc_ecc_del_point(acc);
+	ltc_ecc_del_point(sum);
+	ltc_ecc_del_point(q);
+	return err;
+}
+
+/*
+ * R = k * G where G is the generator of the curve dp. Uses a comb table
+ * for the NIST P-256, P-384 and P-521 curves and ltc_mp.ecc_ptmul()
+ * for other curves or if the table can't be allocated.
+ */
+int ltc_ecc_mulmod_base(void *k, const ltc_ecc_set_type *dp, ecc_point *G,
+			ecc_point *R, void *modulus, int map)
+{
+	struct comb_table *t;
+	void *mu = NULL;
+	void *mp = NULL;
+	int err;
+
+	LTC_ARGCHK(k       != NULL);
+	LTC_ARGCHK(dp      != NULL);
+	LTC_ARGCHK(G       != NULL);
+	LTC_ARGCHK(R       != NULL);
+	LTC_ARGCHK(modulus != NULL);
+
+	err = mp_montgomery_setup(modulus, &mp);
+	if (err != CRYPT_OK)
+		return err;
+	err = mp_init(&mu);
+	if (err != CRYPT_OK)
+		goto out;
+	err = mp_montgomery_normalization(mu, modulus);
+	if (err != CRYPT_OK)
+		goto out;
+
+	t = comb_get_table(dp, G, modulus, mp, mu);
+	if (t)
+		err = comb_mulmod(k, t, R, modulus, mp, mu);
+	if (!t || err == CRYPT_INVALID_ARG) {
+		err = ltc_mp.ecc_ptmul(k, G, R, modulus, map);
+		goto out;
+	}
+
+	if (err == CRYPT_OK && map)
+		err = ltc_ecc_map(R, modulus, mp);
+out:
+	if (mu)
+		mp_clear(mu);
+	mp_montgomery_free(mp);
+	return err;
+}
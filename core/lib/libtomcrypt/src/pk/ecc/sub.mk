@@ -8,6 +8,7 @@ srcs-y += ltc_ecc_is_valid_idx.c
 srcs-y += ltc_ecc_map.c
 srcs-y += ltc_ecc_mulmod.c
 srcs-y += ltc_ecc_mulmod_timing.c
+srcs-$(CFG_CRYPTO_ECC_COMB) += ltc_ecc_mulmod_comb.c
 srcs-y += ltc_ecc_mul2add.c
 srcs-y += ltc_ecc_points.c
 srcs-y += ltc_ecc_projective_add_point.c
@@ -534,9 +534,10 @@ static void tee_ltc_alloc_mpa(void)
 	/*
 	 * The default size (bits) of a big number that will be required it
 	 * equals the max size of the computation (for example 4096 bits),
-	 * multiplied by 2 to allow overflow in computation
+	 * multiplied by 2 to allow overflow in computation, plus one word
+	 * for the Montgomery squaring
 	 */
-	mem.bn_bits = CFG_CORE_BIGNUM_MAX_BITS * 2;
+	mem.bn_bits = mpa_StaticTempVarSizeInBits(CFG_CORE_BIGNUM_MAX_BITS);
 	mem.pool = get_mpa_scratch_memory_pool();
 	if (!mem.pool)
 		panic();
@@ -567,6 +568,7 @@ void crypto_bignum_bn2bin(const struct bignum *from, uint8_t *to)
 TEE_Result crypto_bignum_bin2bn(const uint8_t *from, size_t fromsize,
 			 struct bignum *to)
 {
+	tee_ltc_mont_cache_invalidate(to);
 	if (mp_read_unsigned_bin(to, (uint8_t *)from, fromsize) != CRYPT_OK)
 		return TEE_ERROR_BAD_PARAMETERS;
 	return TEE_SUCCESS;
@@ -574,6 +576,7 @@ TEE_Result crypto_bignum_bin2bn(const uint8_t *from, size_t fromsize,
 
 void crypto_bignum_copy(struct bignum *to, const struct bignum *from)
 {
+	tee_ltc_mont_cache_invalidate(to);
 	mp_copy((void *)from, to);
 }
 
@@ -590,6 +593,7 @@ struct bignum *crypto_bignum_allocate(size_t size_bits)
 
 void crypto_bignum_free(struct bignum *s)
 {
+	tee_ltc_mont_cache_del(s);
 	free(s);
 }
 
@@ -597,6 +601,7 @@ void crypto_bignum_clear(struct bignum *s)
 {
 	struct mpa_numbase_struct *bn = (struct mpa_numbase_struct *)s;
 
+	tee_ltc_mont_cache_invalidate(s);
 	/* despite mpa_numbase_struct description, 'alloc' field a byte size */
 	memset(bn->d, 0, bn->alloc);
 }
@@ -650,6 +655,11 @@ TEE_Result crypto_acipher_alloc_rsa_keypair(struct rsa_keypair *s,
 	if (!bn_alloc_max(&s->dq))
 		goto err;
 
+	/* Signing uses all three moduli, with and without CRT */
+	tee_ltc_mont_cache_add(s->n);
+	tee_ltc_mont_cache_add(s->p);
+	tee_ltc_mont_cache_add(s->q);
+
 	return TEE_SUCCESS;
 err:
 	crypto_bignum_free(s->e);
@@ -672,6 +682,7 @@ TEE_Result crypto_acipher_alloc_rsa_public_key(struct rsa_public_key *s,
 	}
 	if (!bn_alloc_max(&s->n))
 		goto err;
+	tee_ltc_mont_cache_add(s->n);
 	return TEE_SUCCESS;
 err:
 	crypto_bignum_free(s->e);
@@ -1150,6 +1161,7 @@ TEE_Result crypto_acipher_alloc_dsa_keypair(struct dsa_keypair *s,
 		goto err;
 	if (!bn_alloc_max(&s->x))
 		goto err;
+	tee_ltc_mont_cache_add(s->p);
 	return TEE_SUCCESS;
 err:
 	crypto_bignum_free(s->g);
@@ -1173,6 +1185,7 @@ TEE_Result crypto_acipher_alloc_dsa_public_key(struct dsa_public_key *s,
 		goto err;
 	if (!bn_alloc_max(&s->y))
 		goto err;
+	tee_ltc_mont_cache_add(s->p);
 	return TEE_SUCCESS;
 err:
 	crypto_bignum_free(s->g);
@@ -1348,6 +1361,7 @@ TEE_Result crypto_acipher_alloc_dh_keypair(struct dh_keypair *s,
 		goto err;
 	if (!bn_alloc_max(&s->q))
 		goto err;
+	tee_ltc_mont_cache_add(s->p);
 	return TEE_SUCCESS;
 err:
 	crypto_bignum_free(s->g);
@@ -31,10 +31,18 @@
 
 #define NODE_ID_TO_BLOCK_NUM(id)	((id) - 1)
 
+/* Maximum number of elements read or written with one vectored RPC */
+#define HTREE_MAX_BATCH			64
+
+/* Node ids are 32-bit and each level at least doubles the number of nodes */
+#define HTREE_MAX_LEVELS		32
+
 /*
- * The hash tree is implemented as a binary tree with the purpose to ensure
- * integrity of the data in the nodes. The data in the nodes their turn
- * provides both integrity and confidentiality of the data blocks.
+ * The hash tree is implemented as a tree where each node has up to
+ * TEE_FS_HTREE_MAX_FAN_OUT children (a binary tree unless otherwise
+ * configured) with the purpose to ensure integrity of the data in the
+ * nodes. The data in the nodes their turn provides both integrity and
+ * confidentiality of the data blocks.
  *
  * The hash tree is saved in a file as:
  * +----------------------------+
@@ -67,30 +75,42 @@
  * the header.
  *
  * Note that nodes start counting at 1 while blocks at 0, this means that
- * block 0 is represented by node 1.
+ * block 0 is represented by node 1. Nodes are numbered level by level so
+ * with a fan-out of F the children of node N are node (N - 1) * F + 2 and
+ * the following F - 1 nodes. With F = 2 that's node 2 * N and 2 * N + 1.
+ *
+ * The size of the data blocks and the fan-out are chosen when the hash
+ * tree is created and are stored in the encrypted part of the header.
  *
  * Where different elements are stored in the file is managed by the file
  * system.
  */
 
 #define HTREE_NODE_COMMITTED_BLOCK	BIT32(0)
-/* n is 0 or 1 */
+/* n is less than TEE_FS_HTREE_MAX_FAN_OUT */
 #define HTREE_NODE_COMMITTED_CHILD(n)	BIT32(1 + (n))
 
 struct htree_node {
 	size_t id;
 	bool dirty;
 	bool block_updated;
+	bool verified;
 	struct tee_fs_htree_node_image node;
 	struct htree_node *parent;
-	struct htree_node *child[2];
+	/* Array of tee_fs_htree::fan_out children */
+	struct htree_node **child;
 };
 
 struct tee_fs_htree {
 	struct htree_node root;
+	struct htree_node *root_child[TEE_FS_HTREE_MAX_FAN_OUT];
 	struct tee_fs_htree_image head;
 	uint8_t fek[TEE_FS_HTREE_FEK_SIZE];
 	struct tee_fs_htree_imeta imeta;
+	/* Nodes with larger id than this haven't been stored yet */
+	size_t disk_max_node_id;
+	size_t block_size;
+	size_t fan_out;
 	bool dirty;
 	const TEE_UUID *uuid;
 	const struct tee_fs_htree_storage *stor;
@@ -106,6 +126,21 @@ struct traverse_arg {
 	void *arg;
 };
 
+/*
+ * Elements collected to be transferred with as few RPCs as possible, see
+ * struct tee_fs_htree_storage.
+ */
+struct htree_batch {
+	struct tee_fs_htree *ht;
+	size_t num_ext;
+	struct tee_fs_htree_extent ext[HTREE_MAX_BATCH];
+};
+
+struct sync_arg {
+	void *hash_ctx;
+	struct htree_batch *batch;
+};
+
 static TEE_Result rpc_read(struct tee_fs_htree *ht, enum tee_fs_htree_type type,
 			   size_t idx, size_t vers, void *data, size_t dlen)
 {
@@ -167,18 +202,131 @@ static TEE_Result rpc_write_head(struct tee_fs_htree *ht, size_t vers,
 			 head, sizeof(*head));
 }
 
-static TEE_Result rpc_write_node(struct tee_fs_htree *ht, size_t node_id,
-				 size_t vers,
-				 const struct tee_fs_htree_node_image *node)
+static TEE_Result rpc_read_vec(struct tee_fs_htree *ht,
+			       const struct tee_fs_htree_extent *ext,
+			       size_t num_ext)
 {
-	return rpc_write(ht, TEE_FS_HTREE_TYPE_NODE, node_id - 1, vers,
-			 node, sizeof(*node));
+	TEE_Result res;
+	size_t n;
+
+	if (ht->stor->rpc_read_vec)
+		return ht->stor->rpc_read_vec(ht->stor_aux, ext, num_ext);
+
+	for (n = 0; n < num_ext; n++) {
+		res = rpc_read(ht, ext[n].type, ext[n].idx, ext[n].vers,
+			       ext[n].data, ext[n].len);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result rpc_write_vec(struct tee_fs_htree *ht,
+				const struct tee_fs_htree_extent *ext,
+				size_t num_ext)
+{
+	TEE_Result res;
+	size_t n;
+
+	if (ht->stor->rpc_write_vec)
+		return ht->stor->rpc_write_vec(ht->stor_aux, ext, num_ext);
+
+	for (n = 0; n < num_ext; n++) {
+		res = rpc_write(ht, ext[n].type, ext[n].idx, ext[n].vers,
+				ext[n].data, ext[n].len);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static struct htree_batch *batch_alloc(struct tee_fs_htree *ht)
+{
+	struct htree_batch *b = malloc(sizeof(*b));
+
+	if (b) {
+		b->ht = ht;
+		b->num_ext = 0;
+	}
+	return b;
+}
+
+static TEE_Result batch_flush(struct htree_batch *b)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (b->num_ext)
+		res = rpc_write_vec(b->ht, b->ext, b->num_ext);
+	b->num_ext = 0;
+	return res;
+}
+
+static TEE_Result batch_add_write(struct htree_batch *b,
+				  enum tee_fs_htree_type type, size_t idx,
+				  uint8_t vers, void *data, size_t len)
+{
+	TEE_Result res;
+
+	if (b->num_ext == HTREE_MAX_BATCH) {
+		res = batch_flush(b);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	b->ext[b->num_ext].type = type;
+	b->ext[b->num_ext].idx = idx;
+	b->ext[b->num_ext].vers = vers;
+	b->ext[b->num_ext].data = data;
+	b->ext[b->num_ext].len = len;
+	b->num_ext++;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result calc_node_hash(struct tee_fs_htree *ht,
+				 struct htree_node *node,
+				 struct tee_fs_htree_meta *meta, void *ctx,
+				 uint8_t *digest)
+{
+	TEE_Result res;
+	uint32_t alg = TEE_FS_HTREE_HASH_ALG;
+	uint8_t *ndata = (uint8_t *)&node->node + sizeof(node->node.hash);
+	size_t nsize = sizeof(node->node) - sizeof(node->node.hash);
+	size_t n;
+
+	res = crypto_hash_init(ctx, alg);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = crypto_hash_update(ctx, alg, ndata, nsize);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (meta) {
+		res = crypto_hash_update(ctx, alg, (void *)meta, sizeof(meta));
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	for (n = 0; n < ht->fan_out; n++) {
+		if (!node->child[n])
+			continue;
+		res = crypto_hash_update(ctx, alg, node->child[n]->node.hash,
+					 sizeof(node->child[n]->node.hash));
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return crypto_hash_final(ctx, alg, digest, TEE_FS_HTREE_HASH_SIZE);
 }
 
 static TEE_Result traverse_post_order(struct traverse_arg *targ,
 				      struct htree_node *node)
 {
 	TEE_Result res;
+	size_t n;
 
 	/*
 	 * This function is recursing but not very deep, only with Log(N)
@@ -188,13 +336,11 @@ static TEE_Result traverse_post_order(struct traverse_arg *targ,
 	if (!node)
 		return TEE_SUCCESS;
 
-	res = traverse_post_order(targ, node->child[0]);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	res = traverse_post_order(targ, node->child[1]);
-	if (res != TEE_SUCCESS)
-		return res;
+	for (n = 0; n < targ->ht->fan_out; n++) {
+		res = traverse_post_order(targ, node->child[n]);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
 
 	return targ->cb(targ, node);
 }
@@ -207,34 +353,55 @@ static TEE_Result htree_traverse_post_order(struct tee_fs_htree *ht,
 	return traverse_post_order(&targ, &ht->root);
 }
 
-static size_t node_id_to_level(size_t node_id)
+static struct htree_node *alloc_node(struct tee_fs_htree *ht)
+{
+	struct htree_node *node;
+
+	/* The array of children is allocated together with the node */
+	node = calloc(1, sizeof(*node) + ht->fan_out * sizeof(*node->child));
+	if (node)
+		node->child = (struct htree_node **)(node + 1);
+	return node;
+}
+
+static size_t parent_id(struct tee_fs_htree *ht, size_t node_id)
+{
+	assert(node_id > 1);
+	return (node_id - 2) / ht->fan_out + 1;
+}
+
+static size_t child_id(struct tee_fs_htree *ht, size_t node_id, size_t n)
 {
-	assert(node_id && node_id < UINT_MAX);
-	/* Calculate level of the node, root node (1) has level 1 */
-	return sizeof(unsigned int) * 8 - __builtin_clz(node_id);
+	return (node_id - 1) * ht->fan_out + 2 + n;
+}
+
+/* Returns the index of the node in the child array of its parent */
+static size_t child_idx(struct tee_fs_htree *ht, size_t node_id)
+{
+	assert(node_id > 1);
+	return (node_id - 2) % ht->fan_out;
 }
 
 static struct htree_node *find_closest_node(struct tee_fs_htree *ht,
 					    size_t node_id)
 {
 	struct htree_node *node = &ht->root;
-	size_t level = node_id_to_level(node_id);
-	size_t n;
+	size_t path[HTREE_MAX_LEVELS];
+	size_t level = 0;
+	size_t id;
+
+	/* Collect the path from node_id up to, but not including, the root */
+	for (id = node_id; id > 1; id = parent_id(ht, id)) {
+		assert(level < ARRAY_SIZE(path));
+		path[level] = id;
+		level++;
+	}
 
-	/* n = 1 because root node is level 1 */
-	for (n = 1; n < level; n++) {
+	while (level) {
 		struct htree_node *child;
-		size_t bit_idx;
 
-		/*
-		 * The difference between levels of the current node and
-		 * the node we're looking for tells which bit decides
-		 * direction in the tree.
-		 *
-		 * As the first bit has index 0 we'll subtract 1
-		 */
-		bit_idx = level - n - 1;
-		child = node->child[((node_id >> bit_idx) & 1)];
+		level--;
+		child = node->child[child_idx(ht, path[level])];
 		if (!child)
 			return node;
 		node = child;
@@ -243,25 +410,127 @@ static struct htree_node *find_closest_node(struct tee_fs_htree *ht,
 	return node;
 }
 
-static struct htree_node *find_node(struct tee_fs_htree *ht, size_t node_id)
+#ifdef CFG_FS_HTREE_LAZY_VERIFY
+/*
+ * Reads the stored children of a node which isn't verified yet and checks
+ * the hash of the node. The hash of the node itself has already been
+ * verified as part of the parent (or the head for the root node), so once
+ * this returns successfully the node and the hashes of its children can
+ * be trusted. The children are verified in turn when they're accessed.
+ */
+static TEE_Result verify_node_lazy(struct tee_fs_htree *ht,
+				   struct htree_node *node)
+{
+	TEE_Result res;
+	struct tee_fs_htree_node_image images[TEE_FS_HTREE_MAX_FAN_OUT];
+	struct tee_fs_htree_extent ext[TEE_FS_HTREE_MAX_FAN_OUT];
+	uint8_t digest[TEE_FS_HTREE_HASH_SIZE];
+	size_t max_id = MIN(ht->disk_max_node_id, ht->imeta.max_node_id);
+	struct tee_fs_htree_meta *meta = NULL;
+	struct htree_node *nc;
+	size_t num = 0;
+	size_t id;
+	size_t n;
+	void *ctx;
+
+	for (n = 0; n < ht->fan_out; n++) {
+		id = child_id(ht, node->id, n);
+		if (id > max_id || node->child[n])
+			continue;
+		ext[num].type = TEE_FS_HTREE_TYPE_NODE;
+		ext[num].idx = id - 1;
+		ext[num].vers = !!(node->node.flags &
+				   HTREE_NODE_COMMITTED_CHILD(n));
+		ext[num].data = images + num;
+		ext[num].len = sizeof(*images);
+		num++;
+	}
+
+	if (num) {
+		res = rpc_read_vec(ht, ext, num);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	for (n = 0; n < num; n++) {
+		nc = alloc_node(ht);
+		if (!nc)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		nc->id = ext[n].idx + 1;
+		nc->parent = node;
+		nc->node = images[n];
+		node->child[child_idx(ht, nc->id)] = nc;
+	}
+
+	res = crypto_hash_alloc_ctx(&ctx, TEE_FS_HTREE_HASH_ALG);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!node->parent)
+		meta = &ht->imeta.meta;
+	res = calc_node_hash(ht, node, meta, ctx, digest);
+	crypto_hash_free_ctx(ctx, TEE_FS_HTREE_HASH_ALG);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (buf_compare_ct(digest, node->node.hash, sizeof(digest)))
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	node->verified = true;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Like find_closest_node() but also loads and verifies the nodes on the
+ * path to node_id which are stored but not yet in memory.
+ */
+static TEE_Result load_closest_node(struct tee_fs_htree *ht, size_t node_id,
+				    struct htree_node **node_ret)
+{
+	TEE_Result res;
+	struct htree_node *node;
+
+	/*
+	 * A node which isn't verified has no children in memory so the
+	 * closest node is either the requested node or a node which
+	 * doesn't have the next node on the path stored.
+	 */
+	while (true) {
+		node = find_closest_node(ht, node_id);
+		if (node->verified)
+			break;
+		res = verify_node_lazy(ht, node);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	*node_ret = node;
+	return TEE_SUCCESS;
+}
+#else
+static TEE_Result load_closest_node(struct tee_fs_htree *ht, size_t node_id,
+				    struct htree_node **node_ret)
 {
 	struct htree_node *node = find_closest_node(ht, node_id);
 
-	if (node && node->id == node_id)
-		return node;
-	return NULL;
+	if (!node)
+		return TEE_ERROR_GENERIC;
+	*node_ret = node;
+	return TEE_SUCCESS;
 }
+#endif
 
 static TEE_Result get_node(struct tee_fs_htree *ht, bool create,
 			   size_t node_id, struct htree_node **node_ret)
 {
+	TEE_Result res;
 	struct htree_node *node;
 	struct htree_node *nc;
 	size_t n;
 
-	node = find_closest_node(ht, node_id);
-	if (!node)
-		return TEE_ERROR_GENERIC;
+	res = load_closest_node(ht, node_id, &node);
+	if (res != TEE_SUCCESS)
+		return res;
 	if (node->id == node_id)
 		goto ret_node;
 
@@ -277,19 +546,23 @@ static TEE_Result get_node(struct tee_fs_htree *ht, bool create,
 	 * processed the range all nodes up to node_id will be in the tree.
 	 */
 	for (n = node->id + 1; n <= node_id; n++) {
-		node = find_closest_node(ht, n);
+		res = load_closest_node(ht, n, &node);
+		if (res != TEE_SUCCESS)
+			return res;
 		if (node->id == n)
 			continue;
 		/* Node id n should be a child of node */
-		assert((n >> 1) == node->id);
-		assert(!node->child[n & 1]);
+		assert(parent_id(ht, n) == node->id);
+		assert(!node->child[child_idx(ht, n)]);
 
-		nc = calloc(1, sizeof(*nc));
+		nc = alloc_node(ht);
 		if (!nc)
 			return TEE_ERROR_OUT_OF_MEMORY;
 		nc->id = n;
 		nc->parent = node;
-		node->child[n & 1] = nc;
+		/* There's nothing stored to verify a new node against */
+		nc->verified = true;
+		node->child[child_idx(ht, n)] = nc;
 		node = nc;
 	}
 
@@ -343,12 +616,18 @@ static TEE_Result init_head_from_data(struct tee_fs_htree *ht,
 		}
 	} else {
 		struct tee_fs_htree_image head[2];
+		struct tee_fs_htree_extent ext[2];
 
 		for (idx = 0; idx < 2; idx++) {
-			res = rpc_read_head(ht, idx, head + idx);
-			if (res != TEE_SUCCESS)
-				return res;
+			ext[idx].type = TEE_FS_HTREE_TYPE_HEAD;
+			ext[idx].idx = 0;
+			ext[idx].vers = idx;
+			ext[idx].data = head + idx;
+			ext[idx].len = sizeof(*head);
 		}
+		res = rpc_read_vec(ht, ext, 2);
+		if (res != TEE_SUCCESS)
+			return res;
 
 		idx = get_idx_from_counter(head[0].counter, head[1].counter);
 		if (idx < 0)
@@ -366,77 +645,6 @@ static TEE_Result init_head_from_data(struct tee_fs_htree *ht,
 	return TEE_SUCCESS;
 }
 
-static TEE_Result init_tree_from_data(struct tee_fs_htree *ht)
-{
-	TEE_Result res;
-	struct tee_fs_htree_node_image node_image;
-	struct htree_node *node;
-	struct htree_node *nc;
-	size_t committed_version;
-	size_t node_id = 2;
-
-	while (node_id <= ht->imeta.max_node_id) {
-		node = find_node(ht, node_id >> 1);
-		if (!node)
-			return TEE_ERROR_GENERIC;
-		committed_version = !!(node->node.flags &
-				    HTREE_NODE_COMMITTED_CHILD(node_id & 1));
-
-		res = rpc_read_node(ht, node_id, committed_version,
-				    &node_image);
-		if (res != TEE_SUCCESS)
-			return res;
-
-		res = get_node(ht, true, node_id, &nc);
-		if (res != TEE_SUCCESS)
-			return res;
-		nc->node = node_image;
-		node_id++;
-	}
-
-	return TEE_SUCCESS;
-}
-
-static TEE_Result calc_node_hash(struct htree_node *node,
-				 struct tee_fs_htree_meta *meta, void *ctx,
-				 uint8_t *digest)
-{
-	TEE_Result res;
-	uint32_t alg = TEE_FS_HTREE_HASH_ALG;
-	uint8_t *ndata = (uint8_t *)&node->node + sizeof(node->node.hash);
-	size_t nsize = sizeof(node->node) - sizeof(node->node.hash);
-
-	res = crypto_hash_init(ctx, alg);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	res = crypto_hash_update(ctx, alg, ndata, nsize);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	if (meta) {
-		res = crypto_hash_update(ctx, alg, (void *)meta, sizeof(meta));
-		if (res != TEE_SUCCESS)
-			return res;
-	}
-
-	if (node->child[0]) {
-		res = crypto_hash_update(ctx, alg, node->child[0]->node.hash,
-					 sizeof(node->child[0]->node.hash));
-		if (res != TEE_SUCCESS)
-			return res;
-	}
-
-	if (node->child[1]) {
-		res = crypto_hash_update(ctx, alg, node->child[1]->node.hash,
-					 sizeof(node->child[1]->node.hash));
-		if (res != TEE_SUCCESS)
-			return res;
-	}
-
-	return crypto_hash_final(ctx, alg, digest, TEE_FS_HTREE_HASH_SIZE);
-}
-
 static TEE_Result authenc_init(void **ctx_ret, TEE_OperationMode mode,
 			       struct tee_fs_htree *ht,
 			       struct tee_fs_htree_node_image *ni,
@@ -566,6 +774,95 @@ static TEE_Result verify_root(struct tee_fs_htree *ht)
 				     sizeof(ht->imeta), &ht->imeta);
 }
 
+#ifdef CFG_FS_HTREE_LAZY_VERIFY
+/*
+ * Only the root node is loaded here, the rest of the tree is loaded and
+ * verified one node at a time as the nodes are accessed. This keeps the
+ * time needed to open an object independent of its size.
+ */
+static TEE_Result init_tree(struct tee_fs_htree *ht)
+{
+	ht->disk_max_node_id = ht->imeta.max_node_id;
+	return verify_node_lazy(ht, &ht->root);
+}
+#else
+static struct htree_node *find_node(struct tee_fs_htree *ht, size_t node_id)
+{
+	struct htree_node *node = find_closest_node(ht, node_id);
+
+	if (node && node->id == node_id)
+		return node;
+	return NULL;
+}
+
+static TEE_Result init_tree_from_data(struct tee_fs_htree *ht)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_fs_htree_node_image *images;
+	struct tee_fs_htree_extent *ext;
+	struct htree_batch *b;
+	struct htree_node *node;
+	struct htree_node *nc;
+	size_t node_id = 2;
+	uint32_t f;
+	size_t num;
+	size_t id;
+	size_t n;
+
+	b = batch_alloc(ht);
+	images = calloc(HTREE_MAX_BATCH, sizeof(*images));
+	if (!b || !images) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	ext = b->ext;
+
+	while (node_id <= ht->imeta.max_node_id) {
+		/*
+		 * Which version of a node to read is recorded in the parent
+		 * so a batch can only hold nodes whose parent is already
+		 * loaded, that is up to the node before the first child of
+		 * node_id.
+		 */
+		num = child_id(ht, node_id, 0) - node_id;
+		num = MIN(num, (size_t)HTREE_MAX_BATCH);
+		num = MIN(num, ht->imeta.max_node_id - node_id + 1);
+
+		for (n = 0; n < num; n++) {
+			id = node_id + n;
+			node = find_node(ht, parent_id(ht, id));
+			if (!node) {
+				res = TEE_ERROR_GENERIC;
+				goto out;
+			}
+			ext[n].type = TEE_FS_HTREE_TYPE_NODE;
+			ext[n].idx = id - 1;
+			f = HTREE_NODE_COMMITTED_CHILD(child_idx(ht, id));
+			ext[n].vers = !!(node->node.flags & f);
+			ext[n].data = images + n;
+			ext[n].len = sizeof(*images);
+		}
+
+		res = rpc_read_vec(ht, ext, num);
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		for (n = 0; n < num; n++) {
+			res = get_node(ht, true, node_id + n, &nc);
+			if (res != TEE_SUCCESS)
+				goto out;
+			nc->node = images[n];
+			nc->verified = false;
+		}
+		node_id += num;
+	}
+
+out:
+	free(images);
+	free(b);
+	return res;
+}
+
 static TEE_Result verify_node(struct traverse_arg *targ,
 			      struct htree_node *node)
 {
@@ -574,14 +871,18 @@ static TEE_Result verify_node(struct traverse_arg *targ,
 	uint8_t digest[TEE_FS_HTREE_HASH_SIZE];
 
 	if (node->parent)
-		res = calc_node_hash(node, NULL, ctx, digest);
+		res = calc_node_hash(targ->ht, node, NULL, ctx, digest);
 	else
-		res = calc_node_hash(node, &targ->ht->imeta.meta, ctx, digest);
-	if (res == TEE_SUCCESS &&
-	    buf_compare_ct(digest, node->node.hash, sizeof(digest)))
+		res = calc_node_hash(targ->ht, node, &targ->ht->imeta.meta, ctx,
+				     digest);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (buf_compare_ct(digest, node->node.hash, sizeof(digest)))
 		return TEE_ERROR_CORRUPT_OBJECT;
 
-	return res;
+	node->verified = true;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result verify_tree(struct tee_fs_htree *ht)
@@ -599,6 +900,39 @@ static TEE_Result verify_tree(struct tee_fs_htree *ht)
 	return res;
 }
 
+static TEE_Result init_tree(struct tee_fs_htree *ht)
+{
+	TEE_Result res;
+
+	ht->disk_max_node_id = ht->imeta.max_node_id;
+	res = init_tree_from_data(ht);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return verify_tree(ht);
+}
+#endif
+
+static TEE_Result init_geometry(struct tee_fs_htree *ht)
+{
+	size_t fan_out = ht->imeta.fan_out;
+
+	/* Hash trees created before the fan-out was recorded are binary */
+	if (!fan_out)
+		fan_out = 2;
+
+	if (fan_out < 2 || fan_out > TEE_FS_HTREE_MAX_FAN_OUT ||
+	    ht->imeta.block_shift > TEE_FS_HTREE_MAX_BLOCK_SHIFT)
+		return TEE_ERROR_NOT_SUPPORTED;
+
+	ht->fan_out = fan_out;
+	ht->block_size = ht->stor->block_size << ht->imeta.block_shift;
+	if (ht->stor->set_block_size)
+		ht->stor->set_block_size(ht->stor_aux, ht->block_size);
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result init_root_node(struct tee_fs_htree *ht)
 {
 	TEE_Result res;
@@ -610,8 +944,9 @@ static TEE_Result init_root_node(struct tee_fs_htree *ht)
 
 	ht->root.id = 1;
 	ht->root.dirty = true;
+	ht->root.verified = true;
 
-	res = calc_node_hash(&ht->root, &ht->imeta.meta, ctx,
+	res = calc_node_hash(ht, &ht->root, &ht->imeta.meta, ctx,
 			     ht->root.node.hash);
 	crypto_hash_free_ctx(ctx, TEE_FS_HTREE_HASH_ALG);
 
@@ -631,6 +966,7 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 	ht->uuid = uuid;
 	ht->stor = stor;
 	ht->stor_aux = stor_aux;
+	ht->root.child = ht->root_child;
 
 	if (create) {
 		const struct tee_fs_htree_image dummy_head = { .counter = 0 };
@@ -644,6 +980,12 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 		if (res != TEE_SUCCESS)
 			goto out;
 
+		ht->imeta.block_shift = stor->block_shift;
+		ht->imeta.fan_out = stor->fan_out;
+		res = init_geometry(ht);
+		if (res != TEE_SUCCESS)
+			goto out;
+
 		res = init_root_node(ht);
 		if (res != TEE_SUCCESS)
 			goto out;
@@ -662,11 +1004,11 @@ TEE_Result tee_fs_htree_open(bool create, uint8_t *hash, const TEE_UUID *uuid,
 		if (res != TEE_SUCCESS)
 			goto out;
 
-		res = init_tree_from_data(ht);
+		res = init_geometry(ht);
 		if (res != TEE_SUCCESS)
 			goto out;
 
-		res = verify_tree(ht);
+		res = init_tree(ht);
 	}
 out:
 	if (res == TEE_SUCCESS)
@@ -681,6 +1023,11 @@ struct tee_fs_htree_meta *tee_fs_htree_get_meta(struct tee_fs_htree *ht)
 	return &ht->imeta.meta;
 }
 
+size_t tee_fs_htree_get_block_size(struct tee_fs_htree *ht)
+{
+	return ht->block_size;
+}
+
 void tee_fs_htree_meta_set_dirty(struct tee_fs_htree *ht)
 {
 	ht->dirty = true;
@@ -710,6 +1057,7 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 	TEE_Result res;
 	uint8_t vers;
 	struct tee_fs_htree_meta *meta = NULL;
+	struct sync_arg *sarg = targ->arg;
 
 	/*
 	 * The node can be dirty while the block isn't updated due to
@@ -722,7 +1070,9 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 		return TEE_SUCCESS;
 
 	if (node->parent) {
-		uint32_t f = HTREE_NODE_COMMITTED_CHILD(node->id & 1);
+		uint32_t f;
+
+		f = HTREE_NODE_COMMITTED_CHILD(child_idx(targ->ht, node->id));
 
 		node->parent->dirty = true;
 		node->parent->node.flags ^= f;
@@ -736,14 +1086,21 @@ static TEE_Result htree_sync_node_to_storage(struct traverse_arg *targ,
 		meta = &targ->ht->imeta.meta;
 	}
 
-	res = calc_node_hash(node, meta, targ->arg, node->node.hash);
+	res = calc_node_hash(targ->ht, node, meta, sarg->hash_ctx,
+			     node->node.hash);
 	if (res != TEE_SUCCESS)
 		return res;
 
 	node->dirty = false;
 	node->block_updated = false;
 
-	return rpc_write_node(targ->ht, node->id, vers, &node->node);
+	/*
+	 * The node image isn't updated again during this traversal, so
+	 * it's safe to let the batch refer to it until it's flushed.
+	 */
+	return batch_add_write(sarg->batch, TEE_FS_HTREE_TYPE_NODE,
+			       node->id - 1, vers, &node->node,
+			       sizeof(node->node));
 }
 
 static TEE_Result update_root(struct tee_fs_htree *ht)
@@ -766,7 +1123,7 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 {
 	TEE_Result res;
 	struct tee_fs_htree *ht = *ht_arg;
-	void *ctx;
+	struct sync_arg sarg = { NULL, NULL };
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
@@ -774,11 +1131,26 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 	if (!ht->dirty)
 		return TEE_SUCCESS;
 
-	res = crypto_hash_alloc_ctx(&ctx, TEE_FS_HTREE_HASH_ALG);
-	if (res != TEE_SUCCESS)
+	sarg.batch = batch_alloc(ht);
+	if (!sarg.batch)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = crypto_hash_alloc_ctx(&sarg.hash_ctx, TEE_FS_HTREE_HASH_ALG);
+	if (res != TEE_SUCCESS) {
+		free(sarg.batch);
 		return res;
+	}
 
-	res = htree_traverse_post_order(ht, htree_sync_node_to_storage, ctx);
+	/*
+	 * All dirty nodes are collected in the batch and written with as
+	 * few RPCs as possible. The header is written with a separate RPC
+	 * once the nodes are stored since that's what commits the update.
+	 */
+	res = htree_traverse_post_order(ht, htree_sync_node_to_storage, &sarg);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = batch_flush(sarg.batch);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -792,10 +1164,12 @@ TEE_Result tee_fs_htree_sync_to_storage(struct tee_fs_htree **ht_arg,
 		goto out;
 
 	ht->dirty = false;
+	ht->disk_max_node_id = ht->imeta.max_node_id;
 	if (hash)
 		memcpy(hash, ht->root.node.hash, sizeof(ht->root.node.hash));
 out:
-	crypto_hash_free_ctx(ctx, TEE_FS_HTREE_HASH_ALG);
+	crypto_hash_free_ctx(sarg.hash_ctx, TEE_FS_HTREE_HASH_ALG);
+	free(sarg.batch);
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
 	return res;
@@ -843,11 +1217,11 @@ TEE_Result tee_fs_htree_write_block(struct tee_fs_htree **ht_arg,
 		goto out;
 
 	res = authenc_init(&ctx, TEE_MODE_ENCRYPT, ht, &node->node,
-			   ht->stor->block_size);
+			   ht->block_size);
 	if (res != TEE_SUCCESS)
 		goto out;
 	res = authenc_encrypt_final(ctx, node->node.tag, block,
-				    ht->stor->block_size, enc_block);
+				    ht->block_size, enc_block);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -893,18 +1267,18 @@ TEE_Result tee_fs_htree_read_block(struct tee_fs_htree **ht_arg,
 	res = ht->stor->rpc_read_final(&op, &len);
 	if (res != TEE_SUCCESS)
 		goto out;
-	if (len != ht->stor->block_size) {
+	if (len != ht->block_size) {
 		res = TEE_ERROR_CORRUPT_OBJECT;
 		goto out;
 	}
 
 	res = authenc_init(&ctx, TEE_MODE_DECRYPT, ht, &node->node,
-			   ht->stor->block_size);
+			   ht->block_size);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	res = authenc_decrypt_final(ctx, node->node.tag, enc_block,
-				    ht->stor->block_size, block);
+				    ht->block_size, block);
 out:
 	if (res != TEE_SUCCESS)
 		tee_fs_htree_close(ht_arg);
@@ -916,21 +1290,33 @@ TEE_Result tee_fs_htree_truncate(struct tee_fs_htree **ht_arg, size_t block_num)
 	struct tee_fs_htree *ht = *ht_arg;
 	size_t node_id = BLOCK_NUM_TO_NODE_ID(block_num);
 	struct htree_node *node;
+	TEE_Result res;
+	size_t __maybe_unused n;
 
 	if (!ht)
 		return TEE_ERROR_CORRUPT_OBJECT;
 
 	while (node_id < ht->imeta.max_node_id) {
-		node = find_closest_node(ht, ht->imeta.max_node_id);
-		assert(node && node->id == ht->imeta.max_node_id);
-		assert(!node->child[0] && !node->child[1]);
+		/* The parent must be loaded before the node is removed */
+		res = get_node(ht, false, ht->imeta.max_node_id, &node);
+		if (res != TEE_SUCCESS) {
+			tee_fs_htree_close(ht_arg);
+			return res;
+		}
+		assert(node->id == ht->imeta.max_node_id);
+		for (n = 0; n < ht->fan_out; n++)
+			assert(!node->child[n]);
 		assert(node->parent);
-		assert(node->parent->child[node->id & 1] == node);
-		node->parent->child[node->id & 1] = NULL;
+		assert(node->parent->child[child_idx(ht, node->id)] == node);
+		node->parent->child[child_idx(ht, node->id)] = NULL;
 		free(node);
 		ht->imeta.max_node_id--;
 		ht->dirty = true;
 	}
 
+	/* Removed nodes must not be read back if the file grows again */
+	ht->disk_max_node_id = MIN(ht->disk_max_node_id,
+				   ht->imeta.max_node_id);
+
 	return TEE_SUCCESS;
 }
@@ -214,6 +214,84 @@ TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op)
 	return operation_commit(op);
 }
 
+static TEE_Result operation_vec(uint32_t id, unsigned int cmd, int fd,
+				const struct tee_fs_rpc_iovec *iov,
+				size_t num_iov)
+{
+	TEE_Result res;
+	struct tee_fs_rpc_operation op = { .id = id, .num_params = 2 };
+	struct optee_mrf_extent *ext;
+	struct mobj *mobj;
+	uint64_t cookie;
+	uint8_t *data;
+	size_t sz;
+	size_t n;
+
+	if (MUL_OVERFLOW(sizeof(*ext), num_iov, &sz))
+		return TEE_ERROR_BAD_PARAMETERS;
+	for (n = 0; n < num_iov; n++) {
+		if (iov[n].offs < 0 || ADD_OVERFLOW(sz, iov[n].len, &sz))
+			return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	ext = tee_fs_rpc_cache_alloc(sz, &mobj, &cookie);
+	if (!ext)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	data = (uint8_t *)(ext + num_iov);
+	for (n = 0; n < num_iov; n++) {
+		ext[n].offs = iov[n].offs;
+		ext[n].len = iov[n].len;
+		if (cmd == OPTEE_MRF_WRITEV)
+			memcpy(data, iov[n].data, iov[n].len);
+		data += iov[n].len;
+	}
+
+	op.params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+	op.params[0].u.value.a = cmd;
+	op.params[0].u.value.b = fd;
+	op.params[0].u.value.c = num_iov;
+
+	if (!msg_param_init_memparam(op.params + 1, mobj, 0, sz, cookie,
+				     cmd == OPTEE_MRF_WRITEV ?
+					MSG_PARAM_MEM_DIR_IN :
+					MSG_PARAM_MEM_DIR_INOUT))
+		return TEE_ERROR_BAD_STATE;
+
+	res = operation_commit(&op);
+	if (res != TEE_SUCCESS || cmd == OPTEE_MRF_WRITEV)
+		return res;
+
+	if (msg_param_get_buf_size(op.params + 1) != sz)
+		return TEE_ERROR_CORRUPT_OBJECT;
+
+	/* A short extent is treated like a short read of a single block */
+	for (n = 0; n < num_iov; n++)
+		if (ext[n].len != iov[n].len)
+			return TEE_ERROR_CORRUPT_OBJECT;
+
+	data = (uint8_t *)(ext + num_iov);
+	for (n = 0; n < num_iov; n++) {
+		memcpy(iov[n].data, data, iov[n].len);
+		data += iov[n].len;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_readv(uint32_t id, int fd,
+			    const struct tee_fs_rpc_iovec *iov, size_t num_iov)
+{
+	return operation_vec(id, OPTEE_MRF_READV, fd, iov, num_iov);
+}
+
+TEE_Result tee_fs_rpc_writev(uint32_t id, int fd,
+			     const struct tee_fs_rpc_iovec *iov,
+			     size_t num_iov)
+{
+	return operation_vec(id, OPTEE_MRF_WRITEV, fd, iov, num_iov);
+}
+
 TEE_Result tee_fs_rpc_truncate(uint32_t id, int fd, size_t len)
 {
 	struct tee_fs_rpc_operation op = { .id = id, .num_params = 1 };
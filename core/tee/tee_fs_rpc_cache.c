@@ -3,32 +3,148 @@
  * Copyright (c) 2016, Linaro Limited
  */
 
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
 #include <mm/mobj.h>
+#include <string.h>
 #include <tee/tee_fs_rpc.h>
+#include <util.h>
 
-void tee_fs_rpc_cache_clear(struct thread_specific_data *tsd)
+/*
+ * The payload cache of each thread holds one buffer per size class.
+ * Class n, except the last one, holds buffers of 4^n pages. The last
+ * class holds anything larger and is allocated with the size of the
+ * largest request seen so far (the high-water mark), which decays by
+ * half at each clear unless it's needed again.
+ */
+#define CLASS_SHIFT	2
+#define LAST_CLASS	(THREAD_RPC_FS_NUM_PAYLOAD - 1)
+
+#ifdef CFG_WITH_STATS
+static struct tee_fs_rpc_cache_stats cache_stats;
+static unsigned int cache_stats_lock = SPINLOCK_UNLOCK;
+
+static void incr_stat(size_t *counter)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&cache_stats_lock);
+
+	(*counter)++;
+	cpu_spin_unlock_xrestore(&cache_stats_lock, exceptions);
+}
+
+static void incr_hits(void)
+{
+	incr_stat(&cache_stats.hits);
+}
+
+static void incr_misses(void)
+{
+	incr_stat(&cache_stats.misses);
+}
+
+static void incr_evictions(void)
+{
+	incr_stat(&cache_stats.evictions);
+}
+
+void tee_fs_rpc_cache_get_stats(struct tee_fs_rpc_cache_stats *stats)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&cache_stats_lock);
+
+	*stats = cache_stats;
+	memset(&cache_stats, 0, sizeof(cache_stats));
+	cpu_spin_unlock_xrestore(&cache_stats_lock, exceptions);
+}
+#else /* CFG_WITH_STATS */
+static inline void incr_hits(void) { }
+static inline void incr_misses(void) { }
+static inline void incr_evictions(void) { }
+
+void tee_fs_rpc_cache_get_stats(struct tee_fs_rpc_cache_stats *stats)
+{
+	memset(stats, 0, sizeof(struct tee_fs_rpc_cache_stats));
+}
+#endif /* CFG_WITH_STATS */
+
+static size_t class_size(size_t class)
+{
+	return SMALL_PAGE_SIZE << (CLASS_SHIFT * class);
+}
+
+static size_t size_to_class(size_t size)
+{
+	size_t n;
+
+	for (n = 0; n < LAST_CLASS; n++)
+		if (size <= class_size(n))
+			break;
+	return n;
+}
+
+static void free_payload(struct thread_rpc_fs_payload *pl)
 {
-	if (tsd->rpc_fs_payload) {
-		thread_rpc_free_payload(tsd->rpc_fs_payload_cookie,
-					tsd->rpc_fs_payload_mobj);
-		tsd->rpc_fs_payload = NULL;
-		tsd->rpc_fs_payload_cookie = 0;
-		tsd->rpc_fs_payload_size = 0;
-		tsd->rpc_fs_payload_mobj = NULL;
+	if (pl->va) {
+		thread_rpc_free_payload(pl->cookie, pl->mobj);
+		memset(pl, 0, sizeof(*pl));
 	}
 }
 
-void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie)
+void tee_fs_rpc_cache_clear(struct thread_specific_data *tsd)
 {
-	struct thread_specific_data *tsd = thread_get_tsd();
-	size_t sz = size;
+	size_t n;
+
+	for (n = 0; n < THREAD_RPC_FS_NUM_PAYLOAD; n++)
+		free_payload(tsd->rpc_fs_payload + n);
+
+	/* Shrink the largest class towards what was used this time */
+	tsd->rpc_fs_payload_hwm = MAX(tsd->rpc_fs_payload_peak,
+				      ROUNDUP(tsd->rpc_fs_payload_hwm / 2,
+					      SMALL_PAGE_SIZE));
+	if (tsd->rpc_fs_payload_hwm <= class_size(LAST_CLASS - 1))
+		tsd->rpc_fs_payload_hwm = 0;
+	tsd->rpc_fs_payload_peak = 0;
+}
+
+static TEE_Result alloc_payload(struct thread_rpc_fs_payload *pl, size_t sz)
+{
+	struct mobj *mobj;
 	uint64_t c = 0;
 	paddr_t p;
 	void *va;
 
+	mobj = thread_rpc_alloc_payload(sz, &c);
+	if (!mobj)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	if (mobj_get_pa(mobj, 0, 0, &p))
+		goto err;
+
+	if (!ALIGNMENT_IS_OK(p, uint64_t))
+		goto err;
+
+	va = mobj_get_va(mobj, 0);
+	if (!va)
+		goto err;
+
+	pl->va = va;
+	pl->mobj = mobj;
+	pl->cookie = c;
+	pl->size = sz;
+	return TEE_SUCCESS;
+err:
+	thread_rpc_free_payload(c, mobj);
+	return TEE_ERROR_GENERIC;
+}
+
+void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie)
+{
+	struct thread_specific_data *tsd = thread_get_tsd();
+	struct thread_rpc_fs_payload *pl;
+	size_t class;
+	size_t sz;
+
 	if (!size)
 		return NULL;
 
@@ -37,34 +153,33 @@ void *tee_fs_rpc_cache_alloc(size_t size, struct mobj **mobj, uint64_t *cookie)
 	 * memory as complete pages.
 	 */
 	sz = ROUNDUP(size, SMALL_PAGE_SIZE);
+	class = size_to_class(sz);
+	pl = tsd->rpc_fs_payload + class;
 
-	if (sz > tsd->rpc_fs_payload_size) {
-		tee_fs_rpc_cache_clear(tsd);
-
-		*mobj = thread_rpc_alloc_payload(sz,  &c);
-		if (!*mobj)
-			return NULL;
-
-		if (mobj_get_pa(*mobj, 0, 0, &p))
-			goto err;
+	if (class == LAST_CLASS) {
+		tsd->rpc_fs_payload_peak = MAX(tsd->rpc_fs_payload_peak, sz);
+		tsd->rpc_fs_payload_hwm = MAX(tsd->rpc_fs_payload_hwm, sz);
+	}
 
-		if (!ALIGNMENT_IS_OK(p, uint64_t))
-			goto err;
+	if (sz <= pl->size) {
+		incr_hits();
+	} else {
+		incr_misses();
+		if (pl->va) {
+			incr_evictions();
+			free_payload(pl);
+		}
 
-		va = mobj_get_va(*mobj, 0);
-		if (!va)
-			goto err;
+		if (class == LAST_CLASS)
+			sz = tsd->rpc_fs_payload_hwm;
+		else
+			sz = class_size(class);
 
-		tsd->rpc_fs_payload = va;
-		tsd->rpc_fs_payload_mobj = *mobj;
-		tsd->rpc_fs_payload_cookie = c;
-		tsd->rpc_fs_payload_size = sz;
-	} else
-		*mobj = tsd->rpc_fs_payload_mobj;
+		if (alloc_payload(pl, sz))
+			return NULL;
+	}
 
-	*cookie = tsd->rpc_fs_payload_cookie;
-	return tsd->rpc_fs_payload;
-err:
-	thread_rpc_free_payload(c, *mobj);
-	return NULL;
+	*mobj = pl->mobj;
+	*cookie = pl->cookie;
+	return pl->va;
 }
@@ -28,11 +28,43 @@
 
 #define BLOCK_SIZE	(1 << BLOCK_SHIFT)
 
+#if CFG_REE_FS_BLOCK_SHIFT < BLOCK_SHIFT || \
+	CFG_REE_FS_BLOCK_SHIFT > BLOCK_SHIFT + TEE_FS_HTREE_MAX_BLOCK_SHIFT
+#error CFG_REE_FS_BLOCK_SHIFT is out of range
+#endif
+
+#if CFG_REE_FS_HTREE_FAN_OUT < 2 || \
+	CFG_REE_FS_HTREE_FAN_OUT > TEE_FS_HTREE_MAX_FAN_OUT
+#error CFG_REE_FS_HTREE_FAN_OUT is out of range
+#endif
+
+/*
+ * struct block_cache_entry - decrypted and authenticated data block
+ * @link:	link in struct tee_fs_fd::block_cache, most recently used
+ *		first
+ * @block_num:	block number in the file
+ * @dirty:	block is modified and not yet passed to the hash tree
+ * @data:	plain text of the block, tee_fs_fd::block_size bytes
+ */
+struct block_cache_entry {
+	TAILQ_ENTRY(block_cache_entry) link;
+	size_t block_num;
+	bool dirty;
+	uint8_t data[];
+};
+
+TAILQ_HEAD(block_cache_head, block_cache_entry);
+
 struct tee_fs_fd {
 	struct tee_fs_htree *ht;
+	size_t block_size;
 	int fd;
 	struct tee_fs_dirfile_fileh dfh;
 	const TEE_UUID *uuid;
+#ifdef CFG_REE_FS_BLOCK_CACHE
+	struct block_cache_head block_cache;
+	size_t num_cached_blocks;
+#endif
 };
 
 struct tee_fs_dir {
@@ -42,22 +74,32 @@ struct tee_fs_dir {
 	const TEE_UUID *uuid;
 };
 
-static int pos_to_block_num(int position)
+static size_t pos_to_block_num(struct tee_fs_fd *fdp, size_t position)
 {
-	return position >> BLOCK_SHIFT;
+	return position / fdp->block_size;
 }
 
 static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
 
 #ifdef CFG_WITH_PAGER
+/* Size of the data blocks of new files */
+#define TMP_BLOCK_SIZE	(1 << CFG_REE_FS_BLOCK_SHIFT)
+
 static void *ree_fs_tmp_block;
 static bool ree_fs_tmp_block_busy;
 
-static void *get_tmp_block(void)
+/*
+ * Files created with a larger CFG_REE_FS_BLOCK_SHIFT than the current one
+ * get their temporary block from the heap instead.
+ */
+static void *get_tmp_block(size_t size)
 {
+	if (size > TMP_BLOCK_SIZE)
+		return malloc(size);
+
 	assert(!ree_fs_tmp_block_busy);
 	if (!ree_fs_tmp_block)
-		ree_fs_tmp_block = tee_pager_alloc(BLOCK_SIZE,
+		ree_fs_tmp_block = tee_pager_alloc(TMP_BLOCK_SIZE,
 						   TEE_MATTR_LOCKED);
 
 	if (ree_fs_tmp_block)
@@ -68,15 +110,19 @@ static void *get_tmp_block(void)
 
 static void put_tmp_block(void *tmp_block)
 {
+	if (tmp_block != ree_fs_tmp_block) {
+		free(tmp_block);
+		return;
+	}
+
 	assert(ree_fs_tmp_block_busy);
-	assert(tmp_block == ree_fs_tmp_block);
-	tee_pager_release_phys(tmp_block, BLOCK_SIZE);
+	tee_pager_release_phys(tmp_block, TMP_BLOCK_SIZE);
 	ree_fs_tmp_block_busy = false;
 }
 #else
-static void *get_tmp_block(void)
+static void *get_tmp_block(size_t size)
 {
-	return malloc(BLOCK_SIZE);
+	return malloc(size);
 }
 
 static void put_tmp_block(void *tmp_block)
@@ -85,36 +131,265 @@ static void put_tmp_block(void *tmp_block)
 }
 #endif
 
+#ifdef CFG_REE_FS_BLOCK_CACHE
+/*
+ * Each open file keeps up to CFG_REE_FS_BLOCK_CACHE_SIZE data blocks in
+ * plain text. A block enters the cache only after it has been
+ * authenticated when it's decrypted, or when it's created. Modified blocks
+ * stay in the cache until the file is committed with sync_to_storage() or
+ * the block is evicted, so several writes to one block are encrypted and
+ * sent to normal world only once.
+ *
+ * The cache is protected by ree_fs_mutex like the rest of the file.
+ */
+#ifdef CFG_WITH_STATS
+static struct tee_ree_fs_cache_stats cache_stats;
+
+static inline void incr_hits(struct tee_fs_fd *fdp)
+{
+	cache_stats.hits++;
+	cache_stats.bytes_saved += fdp->block_size;
+}
+
+static inline void incr_misses(void)
+{
+	cache_stats.misses++;
+}
+
+static inline void incr_coalesced(struct tee_fs_fd *fdp)
+{
+	cache_stats.coalesced++;
+	cache_stats.bytes_saved += fdp->block_size;
+}
+
+static inline void incr_evictions(void)
+{
+	cache_stats.evictions++;
+}
+
+void tee_ree_fs_get_cache_stats(struct tee_ree_fs_cache_stats *stats)
+{
+	mutex_lock(&ree_fs_mutex);
+	*stats = cache_stats;
+	memset(&cache_stats, 0, sizeof(cache_stats));
+	mutex_unlock(&ree_fs_mutex);
+}
+#else
+static inline void incr_hits(struct tee_fs_fd *fdp __unused) { }
+static inline void incr_misses(void) { }
+static inline void incr_coalesced(struct tee_fs_fd *fdp __unused) { }
+static inline void incr_evictions(void) { }
+#endif
+
+static void bcache_init(struct tee_fs_fd *fdp)
+{
+	TAILQ_INIT(&fdp->block_cache);
+	fdp->num_cached_blocks = 0;
+}
+
+static void bcache_remove(struct tee_fs_fd *fdp, struct block_cache_entry *e)
+{
+	TAILQ_REMOVE(&fdp->block_cache, e, link);
+	fdp->num_cached_blocks--;
+	free(e);
+}
+
+/* Drops all blocks from @block_num and onwards, modified or not */
+static void bcache_invalidate(struct tee_fs_fd *fdp, size_t block_num)
+{
+	struct block_cache_entry *e;
+	struct block_cache_entry *next;
+
+	TAILQ_FOREACH_SAFE(e, &fdp->block_cache, link, next)
+		if (e->block_num >= block_num)
+			bcache_remove(fdp, e);
+}
+
+static TEE_Result bcache_write_back(struct tee_fs_fd *fdp,
+				    struct block_cache_entry *e)
+{
+	TEE_Result res;
+
+	if (!e->dirty)
+		return TEE_SUCCESS;
+
+	res = tee_fs_htree_write_block(&fdp->ht, e->block_num, e->data);
+	if (res == TEE_SUCCESS)
+		e->dirty = false;
+	return res;
+}
+
+static TEE_Result bcache_flush(struct tee_fs_fd *fdp)
+{
+	TEE_Result res;
+	struct block_cache_entry *e;
+
+	TAILQ_FOREACH(e, &fdp->block_cache, link) {
+		res = bcache_write_back(fdp, e);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Returns the cached block @block_num in @ret, reading it from the hash
+ * tree if @in_file or else initializing it with zeroes. @ret is NULL if
+ * the block couldn't be cached, the caller then has to access the hash
+ * tree directly.
+ */
+static TEE_Result bcache_get(struct tee_fs_fd *fdp, size_t block_num,
+			     bool in_file, struct block_cache_entry **ret)
+{
+	TEE_Result res;
+	struct block_cache_entry *e;
+
+	*ret = NULL;
+
+	TAILQ_FOREACH(e, &fdp->block_cache, link) {
+		if (e->block_num == block_num) {
+			incr_hits(fdp);
+			goto out;
+		}
+	}
+
+	if (fdp->num_cached_blocks < CFG_REE_FS_BLOCK_CACHE_SIZE) {
+		e = malloc(sizeof(*e) + fdp->block_size);
+		if (!e && TAILQ_EMPTY(&fdp->block_cache))
+			return TEE_SUCCESS;
+	}
+
+	if (e) {
+		fdp->num_cached_blocks++;
+	} else {
+		e = TAILQ_LAST(&fdp->block_cache, block_cache_head);
+		res = bcache_write_back(fdp, e);
+		if (res != TEE_SUCCESS)
+			return res;
+		TAILQ_REMOVE(&fdp->block_cache, e, link);
+		incr_evictions();
+	}
+
+	e->block_num = block_num;
+	e->dirty = false;
+	if (in_file) {
+		incr_misses();
+		res = tee_fs_htree_read_block(&fdp->ht, block_num, e->data);
+		if (res != TEE_SUCCESS) {
+			free(e);
+			fdp->num_cached_blocks--;
+			return res;
+		}
+	} else {
+		memset(e->data, 0, fdp->block_size);
+	}
+	TAILQ_INSERT_HEAD(&fdp->block_cache, e, link);
+	*ret = e;
+	return TEE_SUCCESS;
+out:
+	if (e != TAILQ_FIRST(&fdp->block_cache)) {
+		TAILQ_REMOVE(&fdp->block_cache, e, link);
+		TAILQ_INSERT_HEAD(&fdp->block_cache, e, link);
+	}
+	*ret = e;
+	return TEE_SUCCESS;
+}
+
+static void bcache_set_dirty(struct tee_fs_fd *fdp,
+			     struct block_cache_entry *e)
+{
+	if (e->dirty)
+		incr_coalesced(fdp);
+	e->dirty = true;
+}
+#else /*CFG_REE_FS_BLOCK_CACHE*/
+static void bcache_init(struct tee_fs_fd *fdp __unused)
+{
+}
+
+static void bcache_invalidate(struct tee_fs_fd *fdp __unused,
+			      size_t block_num __unused)
+{
+}
+
+static TEE_Result bcache_flush(struct tee_fs_fd *fdp __unused)
+{
+	return TEE_SUCCESS;
+}
+
+static TEE_Result bcache_get(struct tee_fs_fd *fdp __unused,
+			     size_t block_num __unused, bool in_file __unused,
+			     struct block_cache_entry **ret)
+{
+	*ret = NULL;
+	return TEE_SUCCESS;
+}
+
+static void bcache_set_dirty(struct tee_fs_fd *fdp __unused,
+			     struct block_cache_entry *e __unused)
+{
+}
+#endif /*CFG_REE_FS_BLOCK_CACHE*/
+
+static TEE_Result sync_to_storage(struct tee_fs_fd *fdp)
+{
+	TEE_Result res = bcache_flush(fdp);
+
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+}
+
 static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 				     const void *buf, size_t len)
 {
-	TEE_Result res;
-	size_t start_block_num = pos_to_block_num(pos);
-	size_t end_block_num = pos_to_block_num(pos + len - 1);
+	TEE_Result res = TEE_SUCCESS;
+	size_t start_block_num = pos_to_block_num(fdp, pos);
+	size_t end_block_num = pos_to_block_num(fdp, pos + len - 1);
+	size_t block_size = fdp->block_size;
 	size_t remain_bytes = len;
 	uint8_t *data_ptr = (uint8_t *)buf;
+	uint8_t *tmp_block = NULL;
 	uint8_t *block;
+	struct block_cache_entry *bce;
 	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
 
-	block = get_tmp_block();
-	if (!block)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
 	while (start_block_num <= end_block_num) {
-		size_t offset = pos % BLOCK_SIZE;
-		size_t size_to_write = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t offset = pos % block_size;
+		size_t size_to_write = MIN(remain_bytes, block_size);
+		bool in_file = start_block_num * block_size <
+			       ROUNDUP(meta->length, block_size);
 
-		if (size_to_write + offset > BLOCK_SIZE)
-			size_to_write = BLOCK_SIZE - offset;
+		if (size_to_write + offset > block_size)
+			size_to_write = block_size - offset;
 
-		if (start_block_num * BLOCK_SIZE <
-		    ROUNDUP(meta->length, BLOCK_SIZE)) {
-			res = tee_fs_htree_read_block(&fdp->ht,
-						      start_block_num, block);
-			if (res != TEE_SUCCESS)
-				goto exit;
+		res = bcache_get(fdp, start_block_num, in_file, &bce);
+		if (res != TEE_SUCCESS)
+			goto exit;
+
+		if (bce) {
+			block = bce->data;
 		} else {
-			memset(block, 0, BLOCK_SIZE);
+			if (!tmp_block) {
+				tmp_block = get_tmp_block(block_size);
+				if (!tmp_block) {
+					res = TEE_ERROR_OUT_OF_MEMORY;
+					goto exit;
+				}
+			}
+			block = tmp_block;
+
+			if (in_file) {
+				res = tee_fs_htree_read_block(&fdp->ht,
+							      start_block_num,
+							      block);
+				if (res != TEE_SUCCESS)
+					goto exit;
+			} else {
+				memset(block, 0, block_size);
+			}
 		}
 
 		if (data_ptr)
@@ -122,10 +397,14 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 		else
 			memset(block + offset, 0, size_to_write);
 
-		res = tee_fs_htree_write_block(&fdp->ht, start_block_num,
-					       block);
-		if (res != TEE_SUCCESS)
-			goto exit;
+		if (bce) {
+			bcache_set_dirty(fdp, bce);
+		} else {
+			res = tee_fs_htree_write_block(&fdp->ht,
+						       start_block_num, block);
+			if (res != TEE_SUCCESS)
+				goto exit;
+		}
 
 		if (data_ptr)
 			data_ptr += size_to_write;
@@ -140,17 +419,20 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, size_t pos,
 	}
 
 exit:
-	if (block)
-		put_tmp_block(block);
+	if (tmp_block)
+		put_tmp_block(tmp_block);
 	return res;
 }
 
 static TEE_Result get_offs_size(enum tee_fs_htree_type type, size_t idx,
-				uint8_t vers, size_t *offs, size_t *size)
+				uint8_t vers, size_t block_size, size_t *offs,
+				size_t *size)
 {
 	const size_t node_size = sizeof(struct tee_fs_htree_node_image);
 	const size_t block_nodes = BLOCK_SIZE / (node_size * 2);
-	size_t pbn;
+	/* Data blocks following each phys block of nodes */
+	const size_t chunk_blocks = block_nodes * 2 - 1;
+	const size_t chunk_size = BLOCK_SIZE + chunk_blocks * block_size;
 	size_t bidx;
 
 	assert(vers == 0 || vers == 1);
@@ -203,6 +485,11 @@ static TEE_Result get_offs_size(enum tee_fs_htree_type type, size_t idx,
 	 * phys block 66:
 	 * data block 31 vers 1
 	 * ...
+	 *
+	 * The head and the nodes are always stored in phys blocks of
+	 * BLOCK_SIZE. Files with larger data blocks have the same layout
+	 * except that each phys block holding a data block is @block_size
+	 * large.
 	 */
 
 	switch (type) {
@@ -211,17 +498,16 @@ static TEE_Result get_offs_size(enum tee_fs_htree_type type, size_t idx,
 		*size = sizeof(struct tee_fs_htree_image);
 		return TEE_SUCCESS;
 	case TEE_FS_HTREE_TYPE_NODE:
-		pbn = 1 + ((idx / block_nodes) * block_nodes * 2);
-		*offs = pbn * BLOCK_SIZE +
+		*offs = BLOCK_SIZE + (idx / block_nodes) * chunk_size +
 			2 * node_size * (idx % block_nodes) +
 			node_size * vers;
 		*size = node_size;
 		return TEE_SUCCESS;
 	case TEE_FS_HTREE_TYPE_BLOCK:
 		bidx = 2 * idx + vers;
-		pbn = 2 + bidx + bidx / (block_nodes * 2 - 1);
-		*offs = pbn * BLOCK_SIZE;
-		*size = BLOCK_SIZE;
+		*offs = 2 * BLOCK_SIZE + (bidx / chunk_blocks) * chunk_size +
+			(bidx % chunk_blocks) * block_size;
+		*size = block_size;
 		return TEE_SUCCESS;
 	default:
 		return TEE_ERROR_GENERIC;
@@ -238,7 +524,7 @@ static TEE_Result ree_fs_rpc_read_init(void *aux,
 	size_t offs;
 	size_t size;
 
-	res = get_offs_size(type, idx, vers, &offs, &size);
+	res = get_offs_size(type, idx, vers, fdp->block_size, &offs, &size);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -256,7 +542,7 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 	size_t offs;
 	size_t size;
 
-	res = get_offs_size(type, idx, vers, &offs, &size);
+	res = get_offs_size(type, idx, vers, fdp->block_size, &offs, &size);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -264,12 +550,82 @@ static TEE_Result ree_fs_rpc_write_init(void *aux,
 				     offs, size, data);
 }
 
+#ifdef CFG_REE_FS_VECTORED_RPC
+static TEE_Result ree_fs_rpc_vec(void *aux, bool write,
+				 const struct tee_fs_htree_extent *ext,
+				 size_t num_ext)
+{
+	struct tee_fs_fd *fdp = aux;
+	struct tee_fs_rpc_iovec *iov;
+	TEE_Result res;
+	size_t offs;
+	size_t size;
+	size_t n;
+
+	iov = calloc(num_ext, sizeof(*iov));
+	if (!iov)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	for (n = 0; n < num_ext; n++) {
+		res = get_offs_size(ext[n].type, ext[n].idx, ext[n].vers,
+				    fdp->block_size, &offs, &size);
+		if (res != TEE_SUCCESS)
+			goto out;
+		if (size != ext[n].len) {
+			res = TEE_ERROR_BAD_PARAMETERS;
+			goto out;
+		}
+		iov[n].offs = offs;
+		iov[n].data = ext[n].data;
+		iov[n].len = size;
+	}
+
+	if (write)
+		res = tee_fs_rpc_writev(OPTEE_MSG_RPC_CMD_FS, fdp->fd, iov,
+					num_ext);
+	else
+		res = tee_fs_rpc_readv(OPTEE_MSG_RPC_CMD_FS, fdp->fd, iov,
+				       num_ext);
+out:
+	free(iov);
+	return res;
+}
+
+static TEE_Result ree_fs_rpc_read_vec(void *aux,
+				      const struct tee_fs_htree_extent *ext,
+				      size_t num_ext)
+{
+	return ree_fs_rpc_vec(aux, false, ext, num_ext);
+}
+
+static TEE_Result ree_fs_rpc_write_vec(void *aux,
+				       const struct tee_fs_htree_extent *ext,
+				       size_t num_ext)
+{
+	return ree_fs_rpc_vec(aux, true, ext, num_ext);
+}
+#endif /*CFG_REE_FS_VECTORED_RPC*/
+
+static void ree_fs_set_block_size(void *aux, size_t block_size)
+{
+	struct tee_fs_fd *fdp = aux;
+
+	fdp->block_size = block_size;
+}
+
 static const struct tee_fs_htree_storage ree_fs_storage_ops = {
 	.block_size = BLOCK_SIZE,
+	.block_shift = CFG_REE_FS_BLOCK_SHIFT - BLOCK_SHIFT,
+	.fan_out = CFG_REE_FS_HTREE_FAN_OUT,
 	.rpc_read_init = ree_fs_rpc_read_init,
 	.rpc_read_final = tee_fs_rpc_read_final,
 	.rpc_write_init = ree_fs_rpc_write_init,
 	.rpc_write_final = tee_fs_rpc_write_final,
+#ifdef CFG_REE_FS_VECTORED_RPC
+	.rpc_read_vec = ree_fs_rpc_read_vec,
+	.rpc_write_vec = ree_fs_rpc_write_vec,
+#endif
+	.set_block_size = ree_fs_set_block_size,
 };
 
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
@@ -285,17 +641,20 @@ static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
 		if (res != TEE_SUCCESS)
 			return res;
 	} else {
+		size_t bs = fdp->block_size;
 		size_t offs;
 		size_t sz;
 
+		/* Blocks past the new end mustn't be written back later */
+		bcache_invalidate(fdp, new_file_len / bs + 1);
+
 		res = get_offs_size(TEE_FS_HTREE_TYPE_BLOCK,
-				    ROUNDUP(new_file_len, BLOCK_SIZE) /
-					BLOCK_SIZE, 1, &offs, &sz);
+				    ROUNDUP(new_file_len, bs) / bs, 1, bs,
+				    &offs, &sz);
 		if (res != TEE_SUCCESS)
 			return res;
 
-		res = tee_fs_htree_truncate(&fdp->ht,
-					    new_file_len / BLOCK_SIZE);
+		res = tee_fs_htree_truncate(&fdp->ht, new_file_len / bs);
 		if (res != TEE_SUCCESS)
 			return res;
 
@@ -315,11 +674,13 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 					void *buf, size_t *len)
 {
 	TEE_Result res;
-	int start_block_num;
-	int end_block_num;
+	size_t start_block_num;
+	size_t end_block_num;
+	size_t block_size;
 	size_t remain_bytes;
 	uint8_t *data_ptr = buf;
 	uint8_t *block = NULL;
+	struct block_cache_entry *bce;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 	struct tee_fs_htree_meta *meta = tee_fs_htree_get_meta(fdp->ht);
 
@@ -336,27 +697,39 @@ static TEE_Result ree_fs_read_primitive(struct tee_file_handle *fh, size_t pos,
 		goto exit;
 	}
 
-	start_block_num = pos_to_block_num(pos);
-	end_block_num = pos_to_block_num(pos + remain_bytes - 1);
-
-	block = get_tmp_block();
-	if (!block) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto exit;
-	}
+	block_size = fdp->block_size;
+	start_block_num = pos_to_block_num(fdp, pos);
+	end_block_num = pos_to_block_num(fdp, pos + remain_bytes - 1);
 
 	while (start_block_num <= end_block_num) {
-		size_t offset = pos % BLOCK_SIZE;
-		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
+		size_t offset = pos % block_size;
+		size_t size_to_read = MIN(remain_bytes, block_size);
 
-		if (size_to_read + offset > BLOCK_SIZE)
-			size_to_read = BLOCK_SIZE - offset;
+		if (size_to_read + offset > block_size)
+			size_to_read = block_size - offset;
 
-		res = tee_fs_htree_read_block(&fdp->ht, start_block_num, block);
+		res = bcache_get(fdp, start_block_num, true, &bce);
 		if (res != TEE_SUCCESS)
 			goto exit;
 
-		memcpy(data_ptr, block + offset, size_to_read);
+		if (bce) {
+			memcpy(data_ptr, bce->data + offset, size_to_read);
+		} else {
+			if (!block) {
+				block = get_tmp_block(block_size);
+				if (!block) {
+					res = TEE_ERROR_OUT_OF_MEMORY;
+					goto exit;
+				}
+			}
+
+			res = tee_fs_htree_read_block(&fdp->ht,
+						      start_block_num, block);
+			if (res != TEE_SUCCESS)
+				goto exit;
+
+			memcpy(data_ptr, block + offset, size_to_read);
+		}
 
 		data_ptr += size_to_read;
 		remain_bytes -= size_to_read;
@@ -420,6 +793,8 @@ static TEE_Result ree_fs_open_primitive(bool create, uint8_t *hash,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	fdp->fd = -1;
 	fdp->uuid = uuid;
+	fdp->block_size = BLOCK_SIZE;
+	bcache_init(fdp);
 
 	if (create)
 		res = tee_fs_rpc_create_dfh(OPTEE_MSG_RPC_CMD_FS,
@@ -455,6 +830,7 @@ static void ree_fs_close_primitive(struct tee_file_handle *fh)
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
 	if (fdp) {
+		bcache_invalidate(fdp, 0);
 		tee_fs_htree_close(&fdp->ht);
 		tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
 		free(fdp);
@@ -467,7 +843,7 @@ static TEE_Result ree_dirf_commit_writes(struct tee_file_handle *fh,
 	TEE_Result res;
 	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 
 	if (!res && hash)
 		memcpy(hash, fdp->dfh.hash, sizeof(fdp->dfh.hash));
@@ -740,7 +1116,7 @@ static TEE_Result ree_fs_create(struct tee_pobj *po, bool overwrite,
 	}
 
 	fdp = (struct tee_fs_fd *)*fh;
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
@@ -776,7 +1152,7 @@ static TEE_Result ree_fs_write(struct tee_file_handle *fh, size_t pos,
 	if (res)
 		goto out;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
@@ -896,7 +1272,7 @@ static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 	if (res)
 		goto out;
 
-	res = tee_fs_htree_sync_to_storage(&fdp->ht, fdp->dfh.hash);
+	res = sync_to_storage(fdp);
 	if (res)
 		goto out;
 
@@ -263,6 +263,38 @@ static struct tee_rpmb_ctx *rpmb_ctx;
  */
 static struct mutex rpmb_mutex = MUTEX_INITIALIZER;
 
+#ifdef CFG_RPMB_FS_FAT_CACHE
+/*
+ * Copy of the FAT kept in secure memory, entries[n] is the n:th FAT entry
+ * up to and including the first one flagged FILE_IS_LAST_ENTRY. Active
+ * entries are also hashed on their filename.
+ *
+ * The copy is valid as long as the RPMB write counter is @wr_cnt. The
+ * counter is advanced with each of our own writes, any other change of
+ * the counter means that the FAT has to be read again.
+ */
+#define FAT_CACHE_HASH_BITS	5
+
+struct fat_cache_entry {
+	struct rpmb_fat_entry fe;
+	size_t idx;
+	LIST_ENTRY(fat_cache_entry) link;
+};
+
+LIST_HEAD(fat_cache_bucket, fat_cache_entry);
+
+struct rpmb_fat_cache {
+	struct fat_cache_entry **entries;
+	size_t num_entries;
+	size_t max_entries;
+	struct fat_cache_bucket hash[BIT(FAT_CACHE_HASH_BITS)];
+	uint32_t wr_cnt;
+	bool valid;
+};
+
+static struct rpmb_fat_cache fat_cache;
+#endif
+
 #ifdef CFG_RPMB_TESTKEY
 
 static const uint8_t rpmb_test_key[RPMB_KEY_MAC_SIZE] = {
@@ -444,6 +476,39 @@ struct tee_rpmb_mem {
 	size_t resp_size;
 };
 
+#ifdef CFG_WITH_STATS
+static struct tee_rpmb_fs_stats rpmb_stats;
+
+static void incr_requests(struct tee_rpmb_mem *mem)
+{
+	rpmb_stats.requests++;
+	rpmb_stats.frames += (mem->req_size - sizeof(struct rpmb_req) +
+			      mem->resp_size) / RPMB_DATA_FRAME_SIZE;
+}
+
+static inline void incr_fat_loads(void)
+{
+	rpmb_stats.fat_loads++;
+}
+
+static inline void incr_fat_hits(void)
+{
+	rpmb_stats.fat_hits++;
+}
+
+void tee_rpmb_fs_get_stats(struct tee_rpmb_fs_stats *stats)
+{
+	mutex_lock(&rpmb_mutex);
+	*stats = rpmb_stats;
+	memset(&rpmb_stats, 0, sizeof(rpmb_stats));
+	mutex_unlock(&rpmb_mutex);
+}
+#else
+static inline void incr_requests(struct tee_rpmb_mem *mem __unused) { }
+static inline void incr_fat_loads(void) { }
+static inline void incr_fat_hits(void) { }
+#endif
+
 static void tee_rpmb_free(struct tee_rpmb_mem *mem)
 {
 	if (!mem)
@@ -515,6 +580,7 @@ static TEE_Result tee_rpmb_invoke(struct tee_rpmb_mem *mem)
 				     MSG_PARAM_MEM_DIR_OUT))
 		return TEE_ERROR_BAD_STATE;
 
+	incr_requests(mem);
 	return thread_rpc_cmd(OPTEE_MSG_RPC_CMD_RPMB, 2, params);
 }
 
@@ -1161,8 +1227,13 @@ static TEE_Result tee_rpmb_init(uint16_t dev_id)
 
 		memcpy(rpmb_ctx->cid, dev_info.cid, RPMB_EMMC_CID_SIZE);
 
-#ifdef RPMB_DRIVER_MULTIPLE_WRITE_FIXED
-		rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
+#ifdef CFG_RPMB_MULTIPLE_BLOCK_WRITE
+		/*
+		 * Reliable Write Sector Count is in 512 byte sectors, some
+		 * devices report 0 which is to be read as 1.
+		 */
+		rpmb_ctx->rel_wr_blkcnt = MAX(dev_info.rel_wr_sec_c, 1) *
+					  (512 / RPMB_DATA_SIZE);
 #else
 		rpmb_ctx->rel_wr_blkcnt = 1;
 #endif
@@ -1290,6 +1361,247 @@ func_exit:
 	return res;
 }
 
+#ifdef CFG_RPMB_FS_FAT_CACHE
+static struct fat_cache_bucket *fat_cache_bucket(const char *filename)
+{
+	uint32_t h = 2166136261;	/* FNV-1a */
+	size_t n;
+
+	for (n = 0; n < TEE_RPMB_FS_FILENAME_LENGTH && filename[n]; n++) {
+		h ^= (uint8_t)filename[n];
+		h *= 16777619;
+	}
+
+	return fat_cache.hash + (h & (BIT(FAT_CACHE_HASH_BITS) - 1));
+}
+
+static void fat_cache_clear(void)
+{
+	size_t n;
+
+	for (n = 0; n < fat_cache.num_entries; n++)
+		free(fat_cache.entries[n]);
+	free(fat_cache.entries);
+	memset(&fat_cache, 0, sizeof(fat_cache));
+}
+
+static TEE_Result fat_cache_set(size_t idx, const struct rpmb_fat_entry *fe)
+{
+	struct fat_cache_entry *ce;
+	void *p;
+	size_t n;
+
+	if (idx >= fat_cache.max_entries) {
+		n = ROUNDUP(idx + 1, N_ENTRIES);
+		p = realloc(fat_cache.entries, n * sizeof(*fat_cache.entries));
+		if (!p)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		fat_cache.entries = p;
+		fat_cache.max_entries = n;
+	}
+
+	while (fat_cache.num_entries <= idx) {
+		ce = calloc(1, sizeof(*ce));
+		if (!ce)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		ce->idx = fat_cache.num_entries;
+		fat_cache.entries[ce->idx] = ce;
+		fat_cache.num_entries++;
+	}
+
+	ce = fat_cache.entries[idx];
+	if (ce->fe.flags & FILE_IS_ACTIVE)
+		LIST_REMOVE(ce, link);
+	ce->fe = *fe;
+	if (ce->fe.flags & FILE_IS_ACTIVE)
+		LIST_INSERT_HEAD(fat_cache_bucket(ce->fe.filename), ce, link);
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result fat_cache_load(void)
+{
+	TEE_Result res;
+	struct rpmb_fat_entry *fat_entries;
+	uint32_t fat_address = fs_par->fat_start_address;
+	size_t size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
+	size_t idx = 0;
+	size_t i;
+
+	fat_cache_clear();
+
+	fat_entries = malloc(size);
+	if (!fat_entries)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	while (true) {
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+				    (uint8_t *)fat_entries, size, NULL, NULL);
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		for (i = 0; i < N_ENTRIES; i++) {
+			res = fat_cache_set(idx, fat_entries + i);
+			if (res != TEE_SUCCESS)
+				goto out;
+			idx++;
+
+			if (fat_entries[i].flags & FILE_IS_LAST_ENTRY)
+				goto done;
+		}
+
+		fat_address += size;
+	}
+
+done:
+	/* tee_rpmb_read() has synced the write counter */
+	fat_cache.wr_cnt = rpmb_ctx->wr_cnt;
+	fat_cache.valid = true;
+	incr_fat_loads();
+out:
+	if (res != TEE_SUCCESS)
+		fat_cache_clear();
+	free(fat_entries);
+	return res;
+}
+
+/* Reloads the FAT cache unless it's known to match RPMB */
+static TEE_Result fat_cache_sync(void)
+{
+	TEE_Result res;
+
+	res = tee_rpmb_init(CFG_RPMB_FS_DEV_ID);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (fat_cache.valid && fat_cache.wr_cnt == rpmb_ctx->wr_cnt)
+		return TEE_SUCCESS;
+
+	if (fat_cache.valid)
+		DMSG("RPMB write counter changed, reloading FAT");
+	return fat_cache_load();
+}
+
+static bool fat_cache_is_synced(void)
+{
+	return fat_cache.valid && rpmb_ctx && rpmb_ctx->wr_cnt_synced &&
+	       fat_cache.wr_cnt == rpmb_ctx->wr_cnt;
+}
+
+/* Called for each successful write request made by us */
+static void fat_cache_wr_cnt_incr(uint32_t wr_cnt)
+{
+	if (fat_cache.valid && fat_cache.wr_cnt + 1 == wr_cnt)
+		fat_cache.wr_cnt = wr_cnt;
+}
+
+/* Looks up the first active entry named like @fh, as read_fat() would */
+static TEE_Result fat_cache_find(struct rpmb_file_handle *fh)
+{
+	TEE_Result res;
+	struct fat_cache_entry *ce;
+	struct fat_cache_entry *found = NULL;
+
+	res = fat_cache_sync();
+	if (res != TEE_SUCCESS)
+		return res;
+
+	LIST_FOREACH(ce, fat_cache_bucket(fh->filename), link)
+		if (!strcmp(ce->fe.filename, fh->filename) &&
+		    (!found || ce->idx < found->idx))
+			found = ce;
+
+	if (!found)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	incr_fat_hits();
+	fh->rpmb_fat_address = fs_par->fat_start_address +
+			       found->idx * sizeof(struct rpmb_fat_entry);
+	fh->fat_entry = found->fe;
+	return TEE_SUCCESS;
+}
+
+/* Returns true if @fe is what RPMB already holds at @fat_address */
+static bool fat_cache_is_clean(uint32_t fat_address,
+			       const struct rpmb_fat_entry *fe)
+{
+	size_t idx;
+
+	if (!fat_cache_is_synced() || fat_address < fs_par->fat_start_address)
+		return false;
+
+	idx = (fat_address - fs_par->fat_start_address) / sizeof(*fe);
+	return idx < fat_cache.num_entries &&
+	       !memcmp(&fat_cache.entries[idx]->fe, fe, sizeof(*fe));
+}
+
+/* Called when @fe has been written at @fat_address */
+static void fat_cache_update(uint32_t fat_address,
+			     const struct rpmb_fat_entry *fe)
+{
+	if (!fat_cache.valid)
+		return;
+
+	if (fat_address < fs_par->fat_start_address ||
+	    fat_cache_set((fat_address - fs_par->fat_start_address) /
+			  sizeof(*fe), fe) != TEE_SUCCESS)
+		fat_cache_clear();
+}
+
+static TEE_Result read_fat_entries(uint32_t fat_address,
+				   struct rpmb_fat_entry *fat_entries,
+				   size_t num_entries)
+{
+	TEE_Result res;
+	size_t idx;
+	size_t n;
+
+	res = fat_cache_sync();
+	if (res != TEE_SUCCESS)
+		return res;
+
+	idx = (fat_address - fs_par->fat_start_address) /
+	      sizeof(struct rpmb_fat_entry);
+	for (n = 0; n < num_entries; n++, idx++) {
+		if (idx < fat_cache.num_entries)
+			fat_entries[n] = fat_cache.entries[idx]->fe;
+		else
+			memset(fat_entries + n, 0, sizeof(*fat_entries));
+	}
+
+	return TEE_SUCCESS;
+}
+#else /* CFG_RPMB_FS_FAT_CACHE */
+static inline TEE_Result fat_cache_load(void)
+{
+	return TEE_SUCCESS;
+}
+
+static inline void fat_cache_clear(void) { }
+static inline void fat_cache_wr_cnt_incr(uint32_t wr_cnt __unused) { }
+
+static inline bool fat_cache_is_clean(uint32_t fat_address __unused,
+				      const struct rpmb_fat_entry *fe __unused)
+{
+	return false;
+}
+
+static inline void fat_cache_update(uint32_t fat_address __unused,
+				    const struct rpmb_fat_entry *fe __unused)
+{
+}
+
+static TEE_Result read_fat_entries(uint32_t fat_address,
+				   struct rpmb_fat_entry *fat_entries,
+				   size_t num_entries)
+{
+	return tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+			     (uint8_t *)fat_entries,
+			     num_entries * sizeof(struct rpmb_fat_entry),
+			     NULL, NULL);
+}
+#endif /* CFG_RPMB_FS_FAT_CACHE */
+
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
 				     const uint8_t *fek, const TEE_UUID *uuid)
@@ -1401,6 +1713,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 			goto out;
 		}
 
+		fat_cache_wr_cnt_incr(wr_cnt);
 		tmp_blk_idx += tmp_blkcnt;
 	}
 
@@ -1419,6 +1732,40 @@ static bool tee_rpmb_write_is_atomic(uint16_t dev_id __unused, uint32_t addr,
 	return (blkcnt <= rpmb_ctx->rel_wr_blkcnt);
 }
 
+/*
+ * Read the blocks which are only partially covered by a write of @len
+ * bytes at @byte_offset in the @blkcnt blocks starting at @blk_idx. The
+ * blocks in between are completely overwritten and aren't read.
+ */
+static TEE_Result tee_rpmb_read_partial_blks(uint16_t dev_id,
+					     uint16_t blk_idx, uint8_t *data,
+					     uint16_t blkcnt,
+					     uint8_t byte_offset,
+					     uint32_t len, const uint8_t *fek,
+					     const TEE_UUID *uuid)
+{
+	TEE_Result res = TEE_SUCCESS;
+	uint32_t addr = blk_idx * RPMB_DATA_SIZE;
+	uint32_t last_offs = (blkcnt - 1) * RPMB_DATA_SIZE;
+	bool first = byte_offset;
+	bool last = (byte_offset + len) % RPMB_DATA_SIZE;
+
+	/* Adjacent blocks are read with a single request */
+	if (first && last && blkcnt <= 2)
+		return tee_rpmb_read(dev_id, addr, data,
+				     blkcnt * RPMB_DATA_SIZE, fek, uuid);
+
+	if (first)
+		res = tee_rpmb_read(dev_id, addr, data, RPMB_DATA_SIZE, fek,
+				    uuid);
+
+	if (!res && last && (last_offs || !first))
+		res = tee_rpmb_read(dev_id, addr + last_offs, data + last_offs,
+				    RPMB_DATA_SIZE, fek, uuid);
+
+	return res;
+}
+
 /*
  * Write RPMB data in bytes.
  *
@@ -1456,9 +1803,10 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 			goto func_exit;
 		}
 
-		/* Read the complete blocks */
-		res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE, data_tmp,
-				    blkcnt * RPMB_DATA_SIZE, fek, uuid);
+		/* Read the first and last blocks which are partially updated */
+		res = tee_rpmb_read_partial_blks(dev_id, blk_idx, data_tmp,
+						 blkcnt, byte_offset, len, fek,
+						 uuid);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 
@@ -1535,6 +1883,7 @@ func_exit:
 
 static TEE_Result get_fat_start_address(uint32_t *addr);
 
+#if (TRACE_LEVEL >= TRACE_FLOW)
 static void dump_fat(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
@@ -1556,8 +1905,7 @@ static void dump_fat(void)
 	}
 
 	while (!last_entry_found) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL, NULL);
+		res = read_fat_entries(fat_address, fat_entries, N_ENTRIES);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -1582,6 +1930,11 @@ static void dump_fat(void)
 out:
 	free(fat_entries);
 }
+#else
+static void dump_fat(void)
+{
+}
+#endif
 
 #if (TRACE_LEVEL >= TRACE_DEBUG)
 static void dump_fh(struct rpmb_file_handle *fh)
@@ -1640,9 +1993,19 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 			goto out;
 	}
 
+	if (fat_cache_is_clean(fh->rpmb_fat_address, &fh->fat_entry)) {
+		/* Nothing to write back */
+		res = TEE_SUCCESS;
+		goto out;
+	}
+
 	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, fh->rpmb_fat_address,
 			     (uint8_t *)&fh->fat_entry,
 			     sizeof(struct rpmb_fat_entry), NULL, NULL);
+	if (res == TEE_SUCCESS)
+		fat_cache_update(fh->rpmb_fat_address, &fh->fat_entry);
+	else
+		fat_cache_clear();
 
 	dump_fat();
 
@@ -1740,6 +2103,9 @@ store_fs_par:
 	fs_par->fat_start_address = partition_data->fat_start_address;
 	fs_par->max_rpmb_address = max_rpmb_block << RPMB_BLOCK_SIZE_SHIFT;
 
+	if (res == TEE_SUCCESS)
+		res = fat_cache_load();
+
 	dump_fat();
 
 out:
@@ -1791,6 +2157,16 @@ static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 	if (res != TEE_SUCCESS)
 		goto out;
 
+#ifdef CFG_RPMB_FS_FAT_CACHE
+	/* Lookups don't need to scan the FAT */
+	if (!p) {
+		res = fat_cache_find(fh);
+		if (res == TEE_ERROR_ITEM_NOT_FOUND && fh->rpmb_fat_address)
+			res = TEE_SUCCESS;
+		goto out;
+	}
+#endif
+
 	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
 	fat_entries = malloc(size);
 	if (!fat_entries) {
@@ -1805,8 +2181,7 @@ static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
 	 * the pool.
 	 */
 	while (!last_entry_found && (!entry_found || p)) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL, NULL);
+		res = read_fat_entries(fat_address, fat_entries, N_ENTRIES);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -2397,8 +2772,7 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 
 	pathlen = strlen(path);
 	while (!last_entry_found) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL, NULL);
+		res = read_fat_entries(fat_address, fat_entries, N_ENTRIES);
 		if (res != TEE_SUCCESS)
 			goto out;
 
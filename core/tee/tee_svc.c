@@ -28,6 +28,7 @@
 #include <util.h>
 #include <kernel/tee_common_otp.h>
 #include <kernel/tee_common.h>
+#include <kernel/tee_misc.h>
 #include <tee_api_types.h>
 #include <kernel/tee_ta_manager.h>
 #include <utee_types.h>
@@ -43,6 +44,7 @@
 #include <kernel/trace_ta.h>
 #include <kernel/chip_services.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/spinlock.h>
 #include <mm/mobj.h>
 
 vaddr_t tee_svc_uref_base;
@@ -534,6 +536,7 @@ static void utee_param_to_param(struct tee_ta_param *p, struct utee_params *up)
 			p->u[n].mem.mobj = &mobj_virt;
 			p->u[n].mem.offs = a;
 			p->u[n].mem.size = b;
+			p->u[n].mem.read_only = false;
 			break;
 		case TEE_PARAM_TYPE_VALUE_INPUT:
 		case TEE_PARAM_TYPE_VALUE_INOUT:
@@ -547,6 +550,117 @@ static void utee_param_to_param(struct tee_ta_param *p, struct utee_params *up)
 	}
 }
 
+#ifdef CFG_WITH_STATS
+static struct tee_svc_param_stats param_stats;
+static unsigned int param_stats_lock = SPINLOCK_UNLOCK;
+
+static void incr_copied(size_t size)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&param_stats_lock);
+
+	param_stats.copied_memrefs++;
+	param_stats.copied_bytes += size;
+	cpu_spin_unlock_xrestore(&param_stats_lock, exceptions);
+}
+
+static void __maybe_unused incr_mapped(size_t size)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&param_stats_lock);
+
+	param_stats.mapped_memrefs++;
+	param_stats.mapped_bytes += size;
+	cpu_spin_unlock_xrestore(&param_stats_lock, exceptions);
+}
+
+void tee_svc_get_param_stats(struct tee_svc_param_stats *stats)
+{
+	uint32_t exceptions = cpu_spin_lock_xsave(&param_stats_lock);
+
+	*stats = param_stats;
+	memset(&param_stats, 0, sizeof(param_stats));
+	cpu_spin_unlock_xrestore(&param_stats_lock, exceptions);
+}
+#else /* CFG_WITH_STATS */
+static inline void incr_copied(size_t size __unused) { }
+static inline void incr_mapped(size_t size __unused) { }
+
+void tee_svc_get_param_stats(struct tee_svc_param_stats *stats)
+{
+	memset(stats, 0, sizeof(struct tee_svc_param_stats));
+}
+#endif /* CFG_WITH_STATS */
+
+#ifdef CFG_TA_PARAM_ZERO_COPY
+static bool is_memref(const struct tee_ta_param *param, size_t n)
+{
+	switch (TEE_PARAM_TYPE_GET(param->types, n)) {
+	case TEE_PARAM_TYPE_MEMREF_INPUT:
+	case TEE_PARAM_TYPE_MEMREF_OUTPUT:
+	case TEE_PARAM_TYPE_MEMREF_INOUT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * A memref to private memory of the calling TA is mapped into the called
+ * TA instead of being copied if:
+ * - it covers complete pages only so nothing else of the caller is
+ *   exposed
+ * - none of its pages are referenced by another memref, which could
+ *   require other permissions
+ * - the memory isn't paged or demand-zero, the mappings of such memory
+ *   are private to the owning TA
+ * Input memrefs are mapped read-only.
+ */
+static bool memref_is_mappable(struct user_ta_ctx *utc,
+			       const struct tee_ta_param *param, size_t idx)
+{
+	uint32_t flags = TEE_MEMORY_ACCESS_READ;
+	vaddr_t va = param->u[idx].mem.offs;
+	size_t size = param->u[idx].mem.size;
+	struct mobj *mobj;
+	size_t offs;
+	size_t n;
+
+	if (!is_memref(param, idx) || !va || !size ||
+	    ((va | size) & CORE_MMU_USER_PARAM_MASK))
+		return false;
+
+	for (n = 0; n < TEE_NUM_PARAMS; n++) {
+		vaddr_t b;
+		vaddr_t e;
+
+		if (n == idx || !is_memref(param, n) || !param->u[n].mem.size)
+			continue;
+		b = ROUNDDOWN(param->u[n].mem.offs, CORE_MMU_USER_PARAM_SIZE);
+		e = ROUNDUP(param->u[n].mem.offs + param->u[n].mem.size,
+			    CORE_MMU_USER_PARAM_SIZE);
+		/* e <= b only if the buffer wraps around */
+		if (e <= b || core_is_buffer_intersect(va, size, b, e - b))
+			return false;
+	}
+
+	if (TEE_PARAM_TYPE_GET(param->types, idx) !=
+	    TEE_PARAM_TYPE_MEMREF_INPUT)
+		flags |= TEE_MEMORY_ACCESS_WRITE;
+	if (tee_mmu_check_access_rights(utc, flags, va, size))
+		return false;
+
+	if (tee_mmu_vbuf_to_mobj_offs(utc, (void *)va, size, &mobj, &offs))
+		return false;
+	return !mobj_is_paged(mobj) && !mobj_is_dz(mobj);
+}
+#else
+static bool memref_is_mappable(struct user_ta_ctx *utc __unused,
+			       const struct tee_ta_param *param __unused,
+			       size_t idx __unused)
+{
+	return false;
+}
+#endif
+
 static TEE_Result alloc_temp_sec_mem(size_t size, struct mobj **mobj,
 				     uint8_t **va)
 {
@@ -567,7 +681,8 @@ static TEE_Result alloc_temp_sec_mem(size_t size, struct mobj **mobj,
  * TA invokes some TA with parameter.
  * If some parameters are memory references:
  * - either the memref is inside TA private RAM: TA is not allowed to expose
- *   its private RAM: use a temporary memory buffer and copy the data.
+ *   its private RAM: use a temporary memory buffer and copy the data,
+ *   unless the memref can be mapped as is, see memref_is_mappable().
  * - or the memref is not in the TA private RAM:
  *   - if the memref was mapped to the TA, TA is allowed to expose it.
  *   - if so, converts memref virtual address into a physical address.
@@ -585,10 +700,13 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 	size_t s;
 	uint8_t *dst = 0;
 	bool ta_private_memref[TEE_NUM_PARAMS];
+	bool mappable[TEE_NUM_PARAMS];
 	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
 	void *va;
 	size_t dst_offs;
 
+	memset(tmp_buf_va, 0, sizeof(void *) * TEE_NUM_PARAMS);
+
 	/* fill 'param' input struct with caller params description buffer */
 	if (!callee_params) {
 		memset(param, 0, sizeof(*param));
@@ -608,6 +726,10 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 
 	/* All mobj in param are of type MOJB_TYPE_VIRT */
 
+	/* Needs all memrefs as virtual addresses, so before they're updated */
+	for (n = 0; n < TEE_NUM_PARAMS; n++)
+		mappable[n] = memref_is_mappable(utc, param, n);
+
 	for (n = 0; n < TEE_NUM_PARAMS; n++) {
 
 		ta_private_memref[n] = false;
@@ -624,7 +746,8 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 				break;
 			}
 			/* uTA cannot expose its private memory */
-			if (tee_mmu_is_vbuf_inside_ta_private(utc, va, s)) {
+			if (tee_mmu_is_vbuf_inside_ta_private(utc, va, s) &&
+			    !mappable[n]) {
 
 				s = ROUNDUP(s, sizeof(uint32_t));
 				if (ADD_OVERFLOW(req_mem, s, &req_mem))
@@ -638,6 +761,12 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 							&param->u[n].mem.offs);
 			if (res != TEE_SUCCESS)
 				return res;
+			if (mappable[n]) {
+				param->u[n].mem.read_only =
+					TEE_PARAM_TYPE_GET(param->types, n) ==
+					TEE_PARAM_TYPE_MEMREF_INPUT;
+				incr_mapped(s);
+			}
 			break;
 		default:
 			break;
@@ -668,6 +797,7 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 						param->u[n].mem.size);
 				if (res != TEE_SUCCESS)
 					return res;
+				incr_copied(param->u[n].mem.size);
 				param->u[n].mem.offs = dst_offs;
 				param->u[n].mem.mobj = *mobj_tmp;
 				tmp_buf_va[n] = dst;
@@ -729,9 +859,10 @@ static TEE_Result tee_svc_update_out_param(
 
 			/*
 			 * If we called a kernel TA the parameters are in shared
-			 * memory and no copy is needed.
+			 * memory and no copy is needed. Neither if the memref
+			 * was mapped into the called TA.
 			 */
-			if (have_private_mem_map &&
+			if (have_private_mem_map && tmp_buf_va[n] &&
 			    param->u[n].mem.size <=
 			    usr_param->vals[n * 2 + 1]) {
 				uint8_t *src = tmp_buf_va[n];
@@ -741,7 +872,7 @@ static TEE_Result tee_svc_update_out_param(
 						 param->u[n].mem.size);
 				if (res != TEE_SUCCESS)
 					return res;
-
+				incr_copied(param->u[n].mem.size);
 			}
 			usr_param->vals[n * 2 + 1] = param->u[n].mem.size;
 			break;
@@ -190,6 +190,8 @@ void __mpa_abs_mul_word(mpanum dest, const mpanum op1, mpa_word_t op2);
 
 void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2);
 
+void __mpa_abs_sqr(mpanum dest, const mpanum op);
+
 /*------------------------------------------------------------
  *
  *  From mpa_div.c
@@ -229,6 +231,16 @@ void __mpa_montgomery_mul_add(mpanum dest, mpanum src, mpa_word_t w);
 void __mpa_montgomery_mul(mpanum dest,
 			  mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv);
 
+void __mpa_montgomery_sqr(mpanum dest, mpanum op, mpanum n, mpa_word_t n_inv);
+
+void __mpa_montgomery_mul_words(mpa_word_t *t, const mpa_word_t *a,
+				mpa_usize_t a_len, const mpa_word_t *b,
+				const mpa_word_t *n, mpa_usize_t len,
+				mpa_word_t n_inv);
+void __mpa_montgomery_sqr_words(mpa_word_t *t, const mpa_word_t *a,
+				const mpa_word_t *n, mpa_usize_t len,
+				mpa_word_t n_inv);
+
 /*------------------------------------------------------------
  *
  *  From mpa_misc.c
@@ -170,12 +170,20 @@ typedef mpa_scratch_mem_base *mpa_scratch_mem;
 #define mpa_StaticVarSizeInU32(n)  \
 	((((n)+31)/32) + MPA_NUMBASE_METADATA_SIZE_IN_U32)
 
+/*
+ * The size in bits of the temporary variables used with max_bits
+ * operands. That's a double size product plus one word, the Montgomery
+ * squaring builds the square in its destination together with a carry
+ * word.
+ */
+#define mpa_StaticTempVarSizeInBits(max_bits) \
+	(2 * (max_bits) + MPA_WORD_SIZE)
+
 /*
  *
  */
 #define mpa_StaticTempVarSizeInU32(max_bits) \
-	(2 * mpa_StaticVarSizeInU32((max_bits)) - \
-	 MPA_NUMBASE_METADATA_SIZE_IN_U32)
+	mpa_StaticVarSizeInU32(mpa_StaticTempVarSizeInBits((max_bits)))
 
 /*
  *
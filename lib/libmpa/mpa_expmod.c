@@ -33,22 +33,30 @@
 		*b = tmp; \
 	} while (0)
 
+/*
+ * Moduli of at least this many bits are exponentiated with the fixed
+ * window engine below, smaller ones with the Montgomery ladder.
+ */
+#ifndef CFG_MPA_EXPMOD_WINDOW_MIN_BITS
+#define CFG_MPA_EXPMOD_WINDOW_MIN_BITS	1024
+#endif
+
 /*------------------------------------------------------------
  *
- *  mpa_exp_mod
+ *  exp_mod_ladder
  *
  *  Calculates dest = op1 ^ op2 mod n
  *
  * This function uses the Montgomery ladder concept as proposed by Marc Joye and
  * Sun-Ming Yen, which makes the function more resistant to timing attacks.
  */
-void mpa_exp_mod(mpanum dest,
-		 const mpanum op1,
-		 const mpanum op2,
-		 const mpanum n,
-		 const mpanum r_modn,
-		 const mpanum r2_modn,
-		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+static void exp_mod_ladder(mpanum dest,
+			   const mpanum op1,
+			   const mpanum op2,
+			   const mpanum n,
+			   const mpanum r_modn,
+			   const mpanum r2_modn,
+			   const mpa_word_t n_inv, mpa_scratch_mem pool)
 {
 	mpanum A;
 	mpanum tmp_a;
@@ -88,16 +96,15 @@ void mpa_exp_mod(mpanum dest,
 					     *ptr_xtilde, n, n_inv);
 
 			/* A = A^2 */
-			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_a, n,
-					     n_inv);
+			__mpa_montgomery_sqr(*ptr_tmp_a, *ptr_a, n, n_inv);
 		} else {
 			/* A = A*x' */
 			__mpa_montgomery_mul(*ptr_tmp_a, *ptr_a, *ptr_xtilde, n,
 					     n_inv);
 
 			/* x' = x'^2 */
-			__mpa_montgomery_mul(*ptr_tmp_xtilde, *ptr_xtilde,
-					     *ptr_xtilde, n, n_inv);
+			__mpa_montgomery_sqr(*ptr_tmp_xtilde, *ptr_xtilde, n,
+					     n_inv);
 		}
 
 		/*
@@ -119,3 +126,187 @@ void mpa_exp_mod(mpanum dest,
 	mpa_free_static_temp_var(&xtilde, pool);
 	mpa_free_static_temp_var(&tmp_xtilde, pool);
 }
+
+/*
+ * Returns the w bits of e starting at bit pos, bits above the most
+ * significant word of e read as zero.
+ */
+static uint32_t get_window(const mpanum e, uint32_t pos, uint32_t w)
+{
+	uint32_t v = 0;
+	uint32_t i;
+
+	for (i = 0; i < w; i++) {
+		uint32_t idx = pos + i;
+		mpa_usize_t widx = idx >> LOG_OF_WORD_SIZE;
+		mpa_word_t word = __mpanum_get_word(widx, e);
+
+		v |= ((word >> (idx & (WORD_SIZE - 1))) & 1) << i;
+	}
+
+	return v;
+}
+
+/*
+ * Copies table entry idx into dest. Every word of every entry is read
+ * and combined with a mask so that neither the memory access pattern
+ * nor the branches depend on idx.
+ */
+static void select_entry(mpanum dest, const mpa_word_t *table,
+			 uint32_t num_entries, mpa_usize_t stride, uint32_t idx)
+{
+	uint32_t e;
+	mpa_usize_t i;
+
+	for (i = 0; i < stride; i++)
+		dest->d[i] = 0;
+
+	for (e = 0; e < num_entries; e++) {
+		mpa_word_t mask = 0 - (((e ^ idx) - 1) >> 31);
+		const mpa_word_t *entry = table + e * stride;
+
+		for (i = 0; i < stride; i++)
+			dest->d[i] |= entry[i] & mask;
+	}
+
+	dest->size = stride;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+	__mpa_set_unused_digits_to_zero(dest);
+}
+
+static void store_entry(mpa_word_t *entry, const mpanum src,
+			mpa_usize_t stride)
+{
+	mpa_usize_t i;
+
+	for (i = 0; i < stride; i++)
+		entry[i] = __mpanum_get_word(i, src);
+}
+
+/*------------------------------------------------------------
+ *
+ *  exp_mod_window
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ *
+ * Fixed window exponentiation with w bit windows. The 2^w Montgomery
+ * powers of op1 are precomputed in a table and each window costs w
+ * squarings and one multiplication, also when the window is zero. Table
+ * entries are fetched with select_entry() to keep the accesses
+ * independent of the exponent.
+ *
+ * Returns false, without touching dest, if the scratch memory pool
+ * can't hold the table.
+ */
+static bool exp_mod_window(mpanum dest,
+			   const mpanum op1,
+			   const mpanum op2,
+			   const mpanum n,
+			   const mpanum r_modn,
+			   const mpanum r2_modn,
+			   const mpa_word_t n_inv, mpa_scratch_mem pool,
+			   uint32_t w)
+{
+	uint32_t num_entries = 1 << w;
+	mpa_usize_t stride = __mpanum_size(n);
+	size_t table_size = num_entries * stride * sizeof(mpa_word_t);
+	mpa_word_t *table;
+	mpanum A;
+	mpanum tmp;
+	mpanum sel;
+	mpanum t;
+	uint32_t pos;
+	uint32_t e;
+	uint32_t i;
+
+	table = mempool_alloc(pool->pool, table_size);
+	if (!table)
+		return false;
+
+	mpa_alloc_static_temp_var(&A, pool);
+	mpa_alloc_static_temp_var(&tmp, pool);
+	mpa_alloc_static_temp_var(&sel, pool);
+
+	/* table[e] = op1^e in Montgomery space */
+	store_entry(table, r_modn, stride);
+	__mpa_montgomery_mul(sel, op1, r2_modn, n, n_inv);
+	store_entry(table + stride, sel, stride);
+	mpa_copy(A, sel);
+	for (e = 2; e < num_entries; e++) {
+		__mpa_montgomery_mul(tmp, A, sel, n, n_inv);
+		t = A;
+		A = tmp;
+		tmp = t;
+		store_entry(table + e * stride, A, stride);
+	}
+
+	/* Start with the most significant, possibly partial, window */
+	pos = ((mpa_highest_bit_index(op2) + w) / w - 1) * w;
+	select_entry(A, table, num_entries, stride, get_window(op2, pos, w));
+
+	while (pos) {
+		pos -= w;
+
+		for (i = 0; i < w; i++) {
+			__mpa_montgomery_sqr(tmp, A, n, n_inv);
+			t = A;
+			A = tmp;
+			tmp = t;
+		}
+
+		select_entry(sel, table, num_entries, stride,
+			     get_window(op2, pos, w));
+		__mpa_montgomery_mul(tmp, A, sel, n, n_inv);
+		t = A;
+		A = tmp;
+		tmp = t;
+	}
+
+	/* Transform back from Montgomery space */
+	__mpa_montgomery_mul(tmp, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, tmp);
+
+	mpa_memset(table, 0, table_size);
+	mempool_free(pool->pool, table);
+	mpa_free_static_temp_var(&A, pool);
+	mpa_free_static_temp_var(&tmp, pool);
+	mpa_free_static_temp_var(&sel, pool);
+
+	return true;
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_exp_mod
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ *
+ * Moduli of at least CFG_MPA_EXPMOD_WINDOW_MIN_BITS bits use the fixed
+ * window engine with 5 bit windows for long exponents and 4 bit windows
+ * otherwise. Smaller moduli, or when the scratch memory pool is too small
+ * for the table, fall back to the Montgomery ladder.
+ */
+void mpa_exp_mod(mpanum dest,
+		 const mpanum op1,
+		 const mpanum op2,
+		 const mpanum n,
+		 const mpanum r_modn,
+		 const mpanum r2_modn,
+		 const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	int ebits = mpa_highest_bit_index(op2) + 1;
+
+	if (CFG_MPA_EXPMOD_WINDOW_MIN_BITS &&
+	    mpa_highest_bit_index(n) + 1 >= CFG_MPA_EXPMOD_WINDOW_MIN_BITS &&
+	    ebits > 0) {
+		if (ebits >= 512 && exp_mod_window(dest, op1, op2, n, r_modn,
+						   r2_modn, n_inv, pool, 5))
+			return;
+		if (exp_mod_window(dest, op1, op2, n, r_modn, r2_modn, n_inv,
+				   pool, 4))
+			return;
+	}
+
+	exp_mod_ladder(dest, op1, op2, n, r_modn, r2_modn, n_inv, pool);
+}
@@ -125,6 +125,157 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src)
 
 #endif /* USE_ARM_ASM */
 
+/*  --------------------------------------------------------------------
+ *  Function:  montgomery_mul_words
+ *  Calculates t = (a * b + m * n) / 2^(WORD_SIZE * len) with m chosen
+ *  to make the division exact, that is one Montgomery multiplication
+ *  without the final subtraction. Words of a from a_len and up are
+ *  treated as zero, b must have len words.
+ *  t must be zero on entry and be able to hold len + 1 words.
+ */
+static void montgomery_mul_words(mpa_word_t *t, const mpa_word_t *a,
+				 mpa_usize_t a_len, const mpa_word_t *b,
+				 const mpa_word_t *n, mpa_usize_t len,
+				 mpa_word_t n_inv)
+{
+#if defined(MPA_SUPPORT_DWORD_T)
+	mpa_dword_t p;
+	mpa_word_t top;
+	mpa_word_t ai;
+	mpa_word_t m;
+	mpa_word_t c;
+	mpa_usize_t i;
+	mpa_usize_t j;
+
+	for (i = 0; i < len; i++) {
+		ai = i < a_len ? a[i] : 0;
+
+		/* t = t + ai * b */
+		c = 0;
+		for (j = 0; j < len; j++) {
+			p = (mpa_dword_t)ai * b[j] + t[j] + c;
+			t[j] = (mpa_word_t)p;
+			c = (mpa_word_t)(p >> WORD_SIZE);
+		}
+		p = (mpa_dword_t)t[len] + c;
+		t[len] = (mpa_word_t)p;
+		top = (mpa_word_t)(p >> WORD_SIZE);
+
+		/* t = (t + m * n) / 2^WORD_SIZE */
+		m = t[0] * n_inv;
+		p = (mpa_dword_t)m * n[0] + t[0];
+		c = (mpa_word_t)(p >> WORD_SIZE);
+		for (j = 1; j < len; j++) {
+			p = (mpa_dword_t)m * n[j] + t[j] + c;
+			t[j - 1] = (mpa_word_t)p;
+			c = (mpa_word_t)(p >> WORD_SIZE);
+		}
+		p = (mpa_dword_t)t[len] + c;
+		t[len - 1] = (mpa_word_t)p;
+		t[len] = top + (mpa_word_t)(p >> WORD_SIZE);
+	}
+#else
+#error write non-dword code for montgomery_mul_words
+#endif
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:  montgomery_sqr_words
+ *  Calculates t = (a^2 + m * n) / 2^(WORD_SIZE * len) like
+ *  montgomery_mul_words(), a must have len words. The square is computed
+ *  first, each cross product a[i] * a[j] only once and then doubled,
+ *  and then reduced one word at a time. That's about 1.5 * len^2 word
+ *  multiplications instead of 2 * len^2.
+ *  t must be zero on entry and be able to hold 2 * len + 1 words, the
+ *  result is left in t[len] to t[2 * len].
+ */
+static void montgomery_sqr_words(mpa_word_t *t, const mpa_word_t *a,
+				 const mpa_word_t *n, mpa_usize_t len,
+				 mpa_word_t n_inv)
+{
+#if defined(MPA_SUPPORT_DWORD_T)
+	mpa_dword_t p;
+	mpa_word_t lo;
+	mpa_word_t hi;
+	mpa_word_t m;
+	mpa_word_t c;
+	mpa_word_t cc;
+	mpa_usize_t i;
+	mpa_usize_t j;
+
+	/* t = sum of a[i] * a[j] for i < j */
+	for (i = 0; i < len - 1; i++) {
+		c = 0;
+		for (j = i + 1; j < len; j++) {
+			p = (mpa_dword_t)a[i] * a[j] + t[i + j] + c;
+			t[i + j] = (mpa_word_t)p;
+			c = (mpa_word_t)(p >> WORD_SIZE);
+		}
+		t[i + len] = c;
+	}
+
+	/* t = 2 * t + sum of a[i]^2, cc is the bit shifted out of t */
+	c = 0;
+	cc = 0;
+	for (i = 0; i < len; i++) {
+		lo = t[2 * i];
+		hi = t[2 * i + 1];
+		p = (mpa_dword_t)a[i] * a[i] + (mpa_word_t)(lo << 1) + cc + c;
+		t[2 * i] = (mpa_word_t)p;
+		p = (p >> WORD_SIZE) + (mpa_word_t)(hi << 1) +
+		    (lo >> (WORD_SIZE - 1));
+		t[2 * i + 1] = (mpa_word_t)p;
+		c = (mpa_word_t)(p >> WORD_SIZE);
+		cc = hi >> (WORD_SIZE - 1);
+	}
+
+	/* t = t / 2^(WORD_SIZE * len) mod n */
+	cc = 0;
+	for (i = 0; i < len; i++) {
+		m = t[i] * n_inv;
+		c = 0;
+		for (j = 0; j < len; j++) {
+			p = (mpa_dword_t)m * n[j] + t[i + j] + c;
+			t[i + j] = (mpa_word_t)p;
+			c = (mpa_word_t)(p >> WORD_SIZE);
+		}
+		p = (mpa_dword_t)t[i + len] + c + cc;
+		t[i + len] = (mpa_word_t)p;
+		cc = (mpa_word_t)(p >> WORD_SIZE);
+	}
+	t[2 * len] = cc;
+#else
+#error write non-dword code for montgomery_sqr_words
+#endif
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:  __mpa_montgomery_mul_words
+ *  The word kernel used by __mpa_montgomery_mul(), see
+ *  montgomery_mul_words() for the arguments. Exported for the
+ *  known-answer tests.
+ */
+void __mpa_montgomery_mul_words(mpa_word_t *t, const mpa_word_t *a,
+				mpa_usize_t a_len, const mpa_word_t *b,
+				const mpa_word_t *n, mpa_usize_t len,
+				mpa_word_t n_inv)
+{
+	montgomery_mul_words(t, a, a_len, b, n, len, n_inv);
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:  __mpa_montgomery_sqr_words
+ *  The word kernel used by __mpa_montgomery_sqr(), see
+ *  montgomery_sqr_words() for the arguments. Exported for the
+ *  known-answer tests.
+ */
+void __mpa_montgomery_sqr_words(mpa_word_t *t, const mpa_word_t *a,
+				const mpa_word_t *n, mpa_usize_t len,
+				mpa_word_t n_inv)
+{
+	montgomery_sqr_words(t, a, n, len, n_inv);
+}
+
 /*------------------------------------------------------------
  *
  *  __mpa_montgomery_mul
@@ -136,26 +287,47 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src)
 void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 			  mpa_word_t n_inv)
 {
+	mpa_usize_t len = __mpanum_size(n);
+	mpa_usize_t size1 = __mpanum_size(op1);
+	mpa_usize_t size2 = __mpanum_size(op2);
 	mpa_word_t u;
 	mpa_usize_t idx;
 
 	/* set dest to zero (with all unused digits to zero as well) */
 	mpa_wipe(dest);
 
-	for (idx = 0; idx < n->size; idx++) {
-		u = (dest->d[0] +
-		     __mpanum_get_word(idx, op1) *
-		     __mpanum_get_word(0, op2)) * n_inv;
+	/*
+	 * The word kernels need one operand with all len words, that's
+	 * almost always the case as both operands are reduced modulo n.
+	 */
+	if (size2 == len || (size1 == len && size2 < len)) {
+		if (size2 == len)
+			montgomery_mul_words(dest->d, op1->d,
+					     __MIN(size1, len), op2->d, n->d,
+					     len, n_inv);
+		else
+			montgomery_mul_words(dest->d, op2->d, size2, op1->d,
+					     n->d, len, n_inv);
+
+		dest->size = len + 1;
+		while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+			dest->size--;
+	} else {
+		for (idx = 0; idx < len; idx++) {
+			u = (dest->d[0] +
+			     __mpanum_get_word(idx, op1) *
+			     __mpanum_get_word(0, op2)) * n_inv;
 
-		__mpa_montgomery_mul_add(dest, op2,
-					 __mpanum_get_word(idx, op1));
-		__mpa_montgomery_mul_add(dest, n, u);
+			__mpa_montgomery_mul_add(dest, op2,
+						 __mpanum_get_word(idx, op1));
+			__mpa_montgomery_mul_add(dest, n, u);
 
-		/* Shift right one mpa_word */
-		dest->size--;
-		for (mpa_usize_t i = 0; i < dest->size; i++)
-			dest->d[i] = dest->d[i + 1];
-		*(dest->d + dest->size) = 0;	/* set unused digit to zero. */
+			/* Shift right one mpa_word */
+			dest->size--;
+			for (mpa_usize_t i = 0; i < dest->size; i++)
+				dest->d[i] = dest->d[i + 1];
+			*(dest->d + dest->size) = 0;	/* unused digit */
+		}
 	}
 
 	/* check if dest > n, if so set dest = dest - n */
@@ -163,6 +335,42 @@ void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 		__mpa_montgomery_sub_ack(dest, n);
 }
 
+/*------------------------------------------------------------
+ *
+ *  __mpa_montgomery_sqr
+ *
+ *  Same as __mpa_montgomery_mul(dest, op, op, n, n_inv) but with
+ *  fewer word multiplications. The square is built in dest before it's
+ *  reduced, so if dest can't hold twice the size of n plus one word this
+ *  falls back to __mpa_montgomery_mul().
+ *
+ */
+void __mpa_montgomery_sqr(mpanum dest, mpanum op, mpanum n, mpa_word_t n_inv)
+{
+	mpa_usize_t len = __mpanum_size(n);
+
+	if (__mpanum_size(op) != len ||
+	    __mpanum_alloced(dest) < (mpa_asize_t)(2 * len + 1)) {
+		__mpa_montgomery_mul(dest, op, op, n, n_inv);
+		return;
+	}
+
+	mpa_wipe(dest);
+	montgomery_sqr_words(dest->d, op->d, n->d, len, n_inv);
+
+	/* Move the result down from dest->d[len] */
+	mpa_memmove(dest->d, dest->d + len, (len + 1) * BYTES_PER_WORD);
+	mpa_memset(dest->d + len + 1, 0, len * BYTES_PER_WORD);
+
+	dest->size = len + 1;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+
+	/* check if dest > n, if so set dest = dest - n */
+	if (__mpa_abs_cmp(dest, n) >= 0)
+		__mpa_montgomery_sub_ack(dest, n);
+}
+
 /*************************************************************
  *
  *   LIB FUNCTIONS
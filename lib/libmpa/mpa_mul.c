@@ -26,6 +26,23 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include "mpa.h"
+#include <compiler.h>
+
+/*
+ * Operands with at least this many words are multiplied with Karatsuba,
+ * 0 disables it. Below 4 words the middle product doesn't shrink.
+ */
+#ifndef CFG_MPA_KARATSUBA_MIN_WORDS
+#define CFG_MPA_KARATSUBA_MIN_WORDS	32
+#endif
+
+#if CFG_MPA_KARATSUBA_MIN_WORDS && CFG_MPA_KARATSUBA_MIN_WORDS < 4
+#error "CFG_MPA_KARATSUBA_MIN_WORDS must be 0 or at least 4"
+#endif
+
+/* Schoolbook squaring is about twice as fast so it breaks even later */
+#define KARATSUBA_MIN_WORDS(sqr)	\
+	((sqr) ? 2 * CFG_MPA_KARATSUBA_MIN_WORDS : CFG_MPA_KARATSUBA_MIN_WORDS)
 
 /*************************************************************
  *
@@ -154,6 +171,252 @@ void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2)
 		dest->size++;
 }
 
+/*
+ * r = a^2 where r is 2 * len words and distinct from a. Each cross
+ * product a[i] * a[j] with i != j is calculated once and doubled, which
+ * saves almost half of the word multiplications.
+ */
+static void sqr_words(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t len)
+{
+	mpa_usize_t i;
+	mpa_usize_t j;
+	mpa_word_t carry;
+	mpa_word_t shift;
+	mpa_word_t lo;
+	mpa_word_t hi;
+
+	mpa_memset(r, 0, 2 * len * BYTES_PER_WORD);
+	for (i = 0; i + 1 < len; i++) {
+		carry = 0;
+		for (j = i + 1; j < len; j++)
+			__mpa_mul_add_word_cum(a[i], a[j], r + i + j, &carry);
+		r[i + len] = carry;
+	}
+
+	/* r = 2 * r + sum of a[i]^2, shift is the bit shifted out of r */
+	shift = 0;
+	carry = 0;
+	for (i = 0; i < len; i++) {
+		lo = (r[2 * i] << 1) | shift;
+		hi = (r[2 * i + 1] << 1) | (r[2 * i] >> (WORD_SIZE - 1));
+		shift = r[2 * i + 1] >> (WORD_SIZE - 1);
+		__mpa_mul_add_word_cum(a[i], a[i], &lo, &carry);
+		hi += carry;
+		carry = hi < carry;
+		r[2 * i] = lo;
+		r[2 * i + 1] = hi;
+	}
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_abs_sqr
+ *
+ *  Calculates |op|^2 and puts result in dest.
+ *  dest must be big enough to hold result and cannot be the same as op.
+ */
+void __mpa_abs_sqr(mpanum dest, const mpanum op)
+{
+	mpa_usize_t len = __mpanum_size(op);
+
+	mpa_memset(dest->d, 0, dest->alloc * BYTES_PER_WORD);
+	sqr_words(dest->d, op->d, len);
+
+	dest->size = 2 * len;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+}
+
+#if CFG_MPA_KARATSUBA_MIN_WORDS
+/*
+ * r = a * b where r is 2 * len words and distinct from a and b
+ */
+static void mul_words(mpa_word_t *r, const mpa_word_t *a,
+		      const mpa_word_t *b, mpa_usize_t len)
+{
+	mpa_usize_t i;
+	mpa_usize_t j;
+	mpa_word_t carry;
+
+	mpa_memset(r, 0, 2 * len * BYTES_PER_WORD);
+	for (i = 0; i < len; i++) {
+		carry = 0;
+		for (j = 0; j < len; j++)
+			__mpa_mul_add_word_cum(a[i], b[j], r + i + j, &carry);
+		r[i + len] = carry;
+	}
+}
+
+/*
+ * r = a + b where alen >= blen, r is alen words and may be the same as
+ * a. Returns the carry out.
+ */
+static mpa_word_t add_words(mpa_word_t *r, const mpa_word_t *a,
+			    mpa_usize_t alen, const mpa_word_t *b,
+			    mpa_usize_t blen)
+{
+	mpa_usize_t i;
+	mpa_word_t carry = 0;
+	mpa_word_t t;
+
+	for (i = 0; i < blen; i++) {
+		t = a[i] + carry;
+		carry = t < carry;
+		r[i] = t + b[i];
+		carry += r[i] < t;
+	}
+	for (; i < alen; i++) {
+		r[i] = a[i] + carry;
+		carry = r[i] < carry;
+	}
+
+	return carry;
+}
+
+/*
+ * r = r - b where rlen >= blen and r >= b
+ */
+static void sub_words(mpa_word_t *r, mpa_usize_t rlen, const mpa_word_t *b,
+		      mpa_usize_t blen)
+{
+	mpa_usize_t i;
+	mpa_word_t borrow = 0;
+	mpa_word_t t;
+
+	for (i = 0; i < blen; i++) {
+		t = r[i] - borrow;
+		borrow = t > r[i];
+		r[i] = t - b[i];
+		borrow += r[i] > t;
+	}
+	for (; i < rlen && borrow; i++) {
+		t = r[i] - borrow;
+		borrow = t > r[i];
+		r[i] = t;
+	}
+}
+
+/*
+ * Number of scratch words karatsuba_words() needs for len word operands
+ */
+static size_t karatsuba_scratch_words(mpa_usize_t len)
+{
+	size_t words = 0;
+
+	/* Multiplication recurses deeper than squaring */
+	while (len >= CFG_MPA_KARATSUBA_MIN_WORDS) {
+		len = len - len / 2 + 1;
+		words += 4 * len;
+	}
+
+	return words;
+}
+
+/*
+ * r = a * b where a and b are len words and r is 2 * len words. With
+ * a = a1 * B + a0 and b = b1 * B + b0:
+ *
+ * a * b = a1 * b1 * B^2 + ((a0 + a1) * (b0 + b1) - a0 * b0 - a1 * b1) * B
+ *	   + a0 * b0
+ *
+ * which takes three half size products instead of four. a == b is
+ * handed down the recursion so squaring ends up in sqr_words().
+ */
+static void karatsuba_words(mpa_word_t *r, const mpa_word_t *a,
+			    const mpa_word_t *b, mpa_usize_t len,
+			    mpa_word_t *scratch)
+{
+	mpa_usize_t l = len / 2;
+	mpa_usize_t h = len - l;
+	mpa_word_t *sa = scratch;
+	mpa_word_t *sb = sa + h + 1;
+	mpa_word_t *m = sb + h + 1;
+
+	if (len < KARATSUBA_MIN_WORDS(a == b)) {
+		if (a == b)
+			sqr_words(r, a, len);
+		else
+			mul_words(r, a, b, len);
+		return;
+	}
+
+	/* r = a1 * b1 * B^2 + a0 * b0 */
+	karatsuba_words(r, a, b, l, scratch);
+	karatsuba_words(r + 2 * l, a + l, b + l, h, scratch);
+
+	/* m = (a0 + a1) * (b0 + b1) - a0 * b0 - a1 * b1 */
+	sa[h] = add_words(sa, a + l, h, a, l);
+	if (a == b)
+		sb = sa;
+	else
+		sb[h] = add_words(sb, b + l, h, b, l);
+	karatsuba_words(m, sa, sb, h + 1, m + 2 * h + 2);
+	sub_words(m, 2 * h + 2, r, 2 * l);
+	sub_words(m, 2 * h + 2, r + 2 * l, 2 * h);
+
+	/* The product fits in r so the carry out is always zero */
+	add_words(r + l, r + l, 2 * len - l, m, 2 * h + 2);
+}
+
+/*
+ * Calculates |op1| * |op2| with Karatsuba if the operands are large
+ * enough and of similar size. Returns false if the operands are too
+ * small or if the pool can't hold the scratch memory, dest is left
+ * untouched in that case.
+ */
+static bool karatsuba_mul(mpanum dest, const mpanum op1, const mpanum op2,
+			  mpa_scratch_mem pool)
+{
+	mpa_usize_t size1 = __mpanum_size(op1);
+	mpa_usize_t size2 = __mpanum_size(op2);
+	mpa_usize_t len = size1 > size2 ? size1 : size2;
+	size_t words;
+	mpa_word_t *buf;
+	mpa_word_t *r;
+	mpa_word_t *a;
+	mpa_word_t *b;
+
+	if (__MIN(size1, size2) < KARATSUBA_MIN_WORDS(op1 == op2) ||
+	    2 * __MIN(size1, size2) < len)
+		return false;
+
+	/* r, zero padded copies of the operands and scratch */
+	words = 4 * len + karatsuba_scratch_words(len);
+	buf = mempool_alloc(pool->pool, words * BYTES_PER_WORD);
+	if (!buf)
+		return false;
+
+	r = buf;
+	a = r + 2 * len;
+	b = a + len;
+	mpa_memset(a, 0, 2 * len * BYTES_PER_WORD);
+	mpa_memmove(a, op1->d, size1 * BYTES_PER_WORD);
+	if (op1 == op2)
+		b = a;
+	else
+		mpa_memmove(b, op2->d, size2 * BYTES_PER_WORD);
+
+	karatsuba_words(r, a, b, len, b + len);
+
+	mpa_memset(dest->d, 0, dest->alloc * BYTES_PER_WORD);
+	mpa_memmove(dest->d, r, (size1 + size2) * BYTES_PER_WORD);
+	dest->size = size1 + size2;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+
+	mpa_memset(buf, 0, words * BYTES_PER_WORD);
+	mempool_free(pool->pool, buf);
+
+	return true;
+}
+#else
+static bool karatsuba_mul(mpanum dest __unused, const mpanum op1 __unused,
+			  const mpanum op2 __unused,
+			  mpa_scratch_mem pool __unused)
+{
+	return false;
+}
+#endif
+
 /*************************************************************
  *
  *   LIB FUNCTIONS
@@ -183,7 +446,12 @@ void mpa_mul(mpanum dest,
 	else
 		tmp_dest = dest;
 
-	__mpa_abs_mul(tmp_dest, op1, op2);
+	if (!karatsuba_mul(tmp_dest, op1, op2, pool)) {
+		if (op1 == op2)
+			__mpa_abs_sqr(tmp_dest, op1);
+		else
+			__mpa_abs_mul(tmp_dest, op1, op2);
+	}
 
 	if (__mpanum_sign(op1) != __mpanum_sign(op2))
 		__mpanum_neg(tmp_dest);
@@ -62,6 +62,7 @@ static TAILQ_HEAD(ta_sessions, ta_session) ta_sessions =
 		TAILQ_HEAD_INITIALIZER(ta_sessions);
 
 static bool init_done;
+static bool heap_init_done;
 
 /* From user_ta_header.c, built within TA */
 extern uint8_t ta_heap[];
@@ -75,15 +76,24 @@ static TEE_Result init_instance(void)
 {
 	trace_set_level(tahead_get_trace_level());
 	__utee_gprof_init();
-	malloc_add_pool(ta_heap, ta_heap_size);
-	_TEE_MathAPI_Init();
+	if (!heap_init_done) {
+		heap_init_done = true;
+		malloc_add_pool(ta_heap, ta_heap_size);
+		_TEE_MathAPI_Init();
+	}
 	return TA_CreateEntryPoint();
 }
 
+/*
+ * A TA with TA_FLAG_INSTANCE_LINGER may be reused for new sessions after
+ * this, if the core keeps it loaded, in which case init_instance() is
+ * called again.
+ */
 static void uninit_instance(void)
 {
 	__utee_gprof_fini();
 	TA_DestroyEntryPoint();
+	init_done = false;
 }
 
 static void ta_header_save_params(uint32_t param_types,
@@ -68,5 +68,67 @@
 #define PTA_MUTEX_TEST_READER			1
 #define PTA_INVOKE_TESTS_CMD_MUTEX		7
 
+/*
+ * Measures the time needed to open FS hash-trees of a 1 MiB and a 64 MiB
+ * object. The read and write throughput with a few different block sizes
+ * and fan-outs is printed on the secure console.
+ *
+ * [out] value[0].a	open time of the 1 MiB object in microseconds
+ * [out] value[0].b	open time of the 64 MiB object in microseconds, 0 if
+ *			the object could not be opened due to lack of memory
+ */
+#define PTA_INVOKE_TESTS_CMD_FS_HTREE_BENCH	8
+
+/*
+ * Counts the RPMB requests and data frames needed to create, open, rename
+ * and remove a number of files in the RPMB FS. Each value holds the totals
+ * for all the files, the figures per file are printed on the secure
+ * console. The files are kept in a storage of their own, the command fails
+ * with TEE_ERROR_ACCESS_CONFLICT if any of them already exists.
+ *
+ * [out] value[0].a	requests to create the files
+ * [out] value[0].b	frames to create the files
+ * [out] value[1].a	requests to open the files
+ * [out] value[1].b	frames to open the files
+ * [out] value[2].a	requests to rename the files
+ * [out] value[2].b	frames to rename the files
+ * [out] value[3].a	requests to remove the files
+ * [out] value[3].b	frames to remove the files
+ */
+#define PTA_INVOKE_TESTS_CMD_RPMB_FS_BENCH	9
+
+/*
+ * Measures the time needed to switch the MMU between the calling user TA
+ * and a second user TA context. Only supported when called from a user TA.
+ *
+ * [out] value[0].a	counter ticks per switch
+ * [out] value[0].b	nanoseconds per switch
+ */
+#define PTA_INVOKE_TESTS_CMD_MMU_SWITCH_BENCH	10
+
+/*
+ * Measures RSA PKCS#1 v1.5 SHA-256 signing and verification with a key
+ * generated for the purpose, mostly the modular exponentiation in libmpa.
+ *
+ * [in]  value[0].a	key size in bits, 0 for 2048
+ * [out] value[1].a	signatures per second
+ * [out] value[1].b	verifications per second
+ */
+#define PTA_INVOKE_TESTS_CMD_RSA_BENCH		11
+
+/*
+ * Compares the Montgomery multiplication and squaring kernels of libmpa
+ * with a reference for edge case operands. Squares are also compared with
+ * the product of the operand with itself.
+ */
+#define PTA_INVOKE_TESTS_CMD_MPA_MONTGOMERY	12
+
+/*
+ * Tests that a new ASID generation is started when the ASIDs are used up
+ * and that contexts of the previous generation get new ASIDs. Only
+ * supported when called from a user TA.
+ */
+#define PTA_INVOKE_TESTS_CMD_MMU_ASID		13
+
 #endif /*__PTA_INVOKE_TESTS_H*/
 
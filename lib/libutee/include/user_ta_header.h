@@ -43,8 +43,14 @@
 	 * (pseudo-TAs only).
 	 */
 #define TA_FLAG_CONCURRENT		(1 << 8)
+	/*
+	 * Single instance TA which may be kept loaded after its last session
+	 * is closed and reused as is, global data included, for the next
+	 * session (see CFG_TA_LINGER_CTX_NUM).
+	 */
+#define TA_FLAG_INSTANCE_LINGER		(1 << 9)
 
-#define TA_FLAGS_MASK			GENMASK_32(8, 2)
+#define TA_FLAGS_MASK			GENMASK_32(9, 2)
 
 /* Deprecated macros that will be removed in the 3.2 release */
 #define TA_FLAG_USER_MODE		0
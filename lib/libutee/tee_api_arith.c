@@ -79,9 +79,10 @@ void _TEE_MathAPI_Init(void)
 	/*
 	 * The default size (bits) of a big number that will be required is
 	 * equal to the max size of the computation (for example 4096
-	 * bits), multiplied by 2 to allow overflow in computation
+	 * bits), multiplied by 2 to allow overflow in computation, plus one
+	 * word for the Montgomery squaring
 	 */
-	mem.bn_bits = CFG_TA_BIGNUM_MAX_BITS * 2;
+	mem.bn_bits = mpa_StaticTempVarSizeInBits(CFG_TA_BIGNUM_MAX_BITS);
 	mempool = &mem;
 	mpa_set_random_generator(get_rng_array);
 }
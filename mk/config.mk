@@ -88,6 +88,21 @@ CFG_WITH_SOFTWARE_PRNG ?= y
 # Number of threads
 CFG_NUM_THREADS ?= 2
 
+# Allocate the thread stacks from TA RAM when the threads are first used
+# instead of reserving a stack for each of the CFG_NUM_THREADS threads
+# statically. Stacks of free threads are released again as long as more
+# than CFG_THREAD_POOL_MIN threads have a stack. With the pager the thread
+# stacks are already backed by paged memory, only allocated when used.
+# The stacks compete with TAs for TA RAM: all of them together,
+# CFG_NUM_THREADS * 8 KiB, may take at most half of TA RAM which is
+# checked at boot. A call that finds TA RAM exhausted is refused with
+# OPTEE_SMC_RETURN_ETHREAD_LIMIT, the same as when all threads are busy.
+CFG_THREAD_DYN_STACKS ?= n
+CFG_THREAD_POOL_MIN ?= 2
+ifeq ($(CFG_WITH_PAGER),y)
+$(call force,CFG_THREAD_DYN_STACKS,n,conflicts with CFG_WITH_PAGER)
+endif
+
 # API implementation version
 CFG_TEE_API_VERSION ?= GPD-1.1-dev
 
@@ -127,6 +142,37 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 # TEE_STORAGE_PRIVATE is passed to the trusted storage API)
 CFG_REE_FS ?= y
 
+# Geometry of the hash tree of new REE FS objects. Data blocks are
+# 2^CFG_REE_FS_BLOCK_SHIFT bytes, from 4 KiB (12) to 64 KiB (16), and each
+# node of the hash tree has CFG_REE_FS_HTREE_FAN_OUT (2 to 8) children.
+# Larger blocks and a larger fan-out give fewer nodes to hash and fewer
+# RPCs for large objects at the cost of more space for small objects.
+# The geometry is recorded in each object so objects created with other
+# values, or before the geometry was recorded, can still be opened.
+CFG_REE_FS_BLOCK_SHIFT ?= 12
+CFG_REE_FS_HTREE_FAN_OUT ?= 2
+
+# Let the REE FS read and write several hash tree nodes with a single
+# RPC (OPTEE_MRF_READV and OPTEE_MRF_WRITEV), which reduces the number of
+# world switches when opening or committing a file. Requires a
+# tee-supplicant which supports these requests.
+CFG_REE_FS_VECTORED_RPC ?= n
+
+# Per open file cache of decrypted and authenticated REE FS data blocks,
+# kept in secure memory. Modified blocks are encrypted and written only
+# once when the file is committed. CFG_REE_FS_BLOCK_CACHE_SIZE is the
+# maximum number of data blocks cached per open file.
+CFG_REE_FS_BLOCK_CACHE ?= n
+CFG_REE_FS_BLOCK_CACHE_SIZE ?= 4
+$(eval $(call cfg-depends-all,CFG_REE_FS_BLOCK_CACHE,CFG_REE_FS))
+
+# Verify the hash tree of a secure storage object lazily. When enabled only
+# the root node is verified when an object is opened, the other nodes are
+# loaded and verified when they are first used. Opening a large object is
+# then as fast as opening a small one and only the nodes on the path to
+# used blocks are kept in memory.
+CFG_FS_HTREE_LAZY_VERIFY ?= n
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -135,6 +181,22 @@ CFG_RPMB_FS ?= n
 # tee-supplicant process will open /dev/mmcblk<id>rpmb
 CFG_RPMB_FS_DEV_ID ?= 0
 
+# Let a single RPMB write request carry as many data frames as the eMMC
+# reliable write size (EXT_CSD REL_WR_SEC_C) allows, instead of one frame
+# per request. Requires a normal world RPMB driver which handles multiple
+# block writes.
+CFG_RPMB_MULTIPLE_BLOCK_WRITE ?= n
+$(eval $(call cfg-depends-all,CFG_RPMB_MULTIPLE_BLOCK_WRITE,CFG_RPMB_FS))
+
+# Keep a copy of the RPMB FS FAT in secure memory, read once when the file
+# system is first used. Files are then looked up with a hash index on their
+# names instead of reading the FAT from RPMB for each operation, and only
+# FAT entries which are modified are written back. The copy is read again
+# if the RPMB write counter shows that the FAT may have been changed by
+# someone else.
+CFG_RPMB_FS_FAT_CACHE ?= n
+$(eval $(call cfg-depends-all,CFG_RPMB_FS_FAT_CACHE,CFG_RPMB_FS))
+
 # Enables RPMB key programming by the TEE, in case the RPMB partition has not
 # been configured yet.
 # !!! Security warning !!!
@@ -214,9 +276,81 @@ endif
 # Enable paging, requires SRAM, can't be enabled by default
 CFG_WITH_PAGER ?= n
 
+# Page replacement policy of the pager:
+# fifo  - evict the oldest page, the oldest pages are hidden after each
+#         fault and a hidden page which is accessed is moved to the back
+# clock - second chance, pages are hidden by the clock hand as it looks
+#         for a page to evict and skipped if they're accessed again before
+#         the hand comes back
+# lru   - approximate LRU, the accessed state of all pages is sampled
+#         regularly to age them and the page with the lowest age is evicted
+CFG_PAGER_POLICY ?= fifo
+ifeq ($(filter fifo clock lru,$(CFG_PAGER_POLICY)),)
+$(error CFG_PAGER_POLICY must be one of fifo, clock or lru)
+endif
+CFG_PAGER_POLICY_CLOCK := $(if $(filter clock,$(CFG_PAGER_POLICY)),y,n)
+CFG_PAGER_POLICY_LRU := $(if $(filter lru,$(CFG_PAGER_POLICY)),y,n)
+
+# Fault-around window of the pager, in pages. A fault on a read-only page,
+# or on a read-write page which has been saved before, also loads the
+# other pages of the same area inside the naturally aligned window of this
+# many pages, as long as there are free or hidden pages to load them into.
+# Must be a power of 2, 1 disables fault-around.
+CFG_PAGER_FAULT_AROUND ?= 1
+
+# Only check the hashes of the init part of the pageable area at boot.
+# The rest of the pageable area is checked page by page when it's paged
+# in, as all pages are each time they're loaded, which saves hashing the
+# whole pageable area upfront.
+CFG_PAGER_LAZY_HASH_CHECK ?= n
+$(eval $(call cfg-depends-all,CFG_PAGER_LAZY_HASH_CHECK,CFG_WITH_PAGER))
+
+# Number of clean physical pages each CPU keeps in reserve for the pager.
+# Read-only and read-write pages, including those of paged user TAs, are
+# loaded into a page from the reserve of the faulting CPU, which means
+# that copying and hashing or decrypting the page is done without holding
+# the pager lock. Reserves are refilled in batches from the global list
+# of pages and given back to it when it runs short of pages. 0 disables
+# the reserves.
+CFG_PAGER_CPU_RESERVE ?= 0
+
 # Use the pager for user TAs
 CFG_PAGED_USER_TA ?= $(CFG_WITH_PAGER)
 
+# Demand-zero memory for user TAs which aren't paged. Only the part of the
+# TA image initialized from the ELF is allocated when the TA is loaded, the
+# remaining .bss, heap and stack pages are allocated from TA RAM and zeroed
+# on first access. Note that running out of TA RAM on first access to such
+# a page panics the TA, or the core if the access was made by the core on
+# behalf of the TA.
+CFG_DEMAND_ZERO_USER_TA ?= n
+ifeq ($(CFG_PAGED_USER_TA),y)
+$(call force,CFG_DEMAND_ZERO_USER_TA,n,conflicts with CFG_PAGED_USER_TA)
+endif
+
+# Number of translation tables in the pool shared by the user TA contexts.
+# With CFG_PAGED_USER_TA the tables of contexts that aren't mapped are
+# kept in the same pool until they are needed by someone else, so a
+# larger pool means fewer page faults when a context is mapped again.
+# Leave empty for two tables per thread, but at least four. Values below
+# two tables per thread are rejected at build time.
+CFG_PGT_CACHE_ENTRIES ?=
+
+# Number of TA contexts kept loaded after their last session is closed,
+# the least recently closed is unloaded first. Opening a new session to
+# such a TA saves loading it and, with CFG_PAGED_USER_TA, can reuse its
+# cached translation tables. Only single instance TAs which opt in with
+# TA_FLAG_INSTANCE_LINGER are kept: the TA instance is reused as is,
+# TA_DestroyEntryPoint() and TA_CreateEntryPoint() are called but global
+# data and the heap aren't reinitialized.
+CFG_TA_LINGER_CTX_NUM ?= 0
+
+# Map memory references to private memory of a user TA directly into the
+# user TA it invokes instead of copying them via a temporary buffer. Only
+# done for memrefs which cover complete pages of memory that isn't paged,
+# others are still copied. Input memrefs are mapped read-only.
+CFG_TA_PARAM_ZERO_COPY ?= n
+
 # Enable support for detected undefined behavior in C
 # Uses a lot of memory, can't be enabled by default
 CFG_CORE_SANITIZE_UNDEFINED ?= n
@@ -312,3 +446,17 @@ CFG_TA_BIGNUM_MAX_BITS ?= 2048
 # implemented by the TEE core.
 # Set this to a lower value to reduce the memory footprint.
 CFG_CORE_BIGNUM_MAX_BITS ?= 4096
+
+# Modular exponentiation in libmpa (RSA, DH, DSA) uses a constant-time fixed
+# window algorithm for moduli of at least this many bits, which needs around
+# 40% fewer Montgomery multiplications than the Montgomery ladder used for
+# smaller moduli. The window table (up to 32 entries of the modulus size) is
+# taken from the bignum scratch memory pool, the ladder is used if it doesn't
+# fit. Set to 0 to always use the Montgomery ladder.
+CFG_MPA_EXPMOD_WINDOW_MIN_BITS ?= 1024
+
+# mpa_mul() in libmpa switches from schoolbook to Karatsuba multiplication
+# for operands of at least this many 32-bit words (twice as many when
+# squaring). The scratch memory is taken from the bignum memory pool,
+# schoolbook is used if it doesn't fit. Set to 0 to disable Karatsuba.
+CFG_MPA_KARATSUBA_MIN_WORDS ?= 32